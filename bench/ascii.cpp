@@ -0,0 +1,2 @@
+#define ASCII_BENCHMARK
+#include <common/ascii.h>
@@ -0,0 +1,8 @@
+#define BLOCK_ALLOCATOR_BENCHMARK
+#include <common/block_allocator.h>
+
+int main()
+{
+	BlockAllocatorBenchmark();
+	return 0;
+}
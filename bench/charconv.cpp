@@ -0,0 +1,2 @@
+#define CHARCONV_BENCHMARK
+#include <common/charconv.h>
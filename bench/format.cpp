@@ -0,0 +1,2 @@
+#define FORMAT_BENCHMARK
+#include <common/format.h>
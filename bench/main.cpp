@@ -0,0 +1,3 @@
+#include <common/benchmark.h>
+
+BENCHMARK_MAIN()
@@ -0,0 +1,2 @@
+#define SEARCH_BENCHMARK
+#include <common/stl_search.h>
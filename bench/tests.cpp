@@ -0,0 +1,18 @@
+#define CHARCONV_TEST
+#define FORMAT_TEST
+#define STL_SEARCH_TEST
+#define UTF8_TEST
+#include <common/charconv.h>
+#include <common/format.h>
+#include <common/stl_search.h>
+#include <common/utf8.h>
+
+int main()
+{
+	int failures = 0;
+	failures += internal_charconv_test::run();
+	failures += internal_format_test::run();
+	failures += internal_stl_search_test::run();
+	failures += internal_utf8_test::run();
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,2 @@
+#define UTF8_BENCHMARK
+#include <common/utf8.h>
@@ -0,0 +1,2 @@
+#define UTIL_SLEEP_BENCHMARK
+#include <common/util.h>
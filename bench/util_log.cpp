@@ -0,0 +1,2 @@
+#define UTIL_LOG_BENCHMARK
+#include <common/util_log.h>
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <common/util.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COMMON_ASCII_SSE2 1
+#include <emmintrin.h>
+#else
+#define COMMON_ASCII_SSE2 0
+#endif
+
+#if COMMON_ASCII_SSE2 && defined(__AVX2__)
+#define COMMON_ASCII_AVX2 1
+#include <immintrin.h>
+#else
+#define COMMON_ASCII_AVX2 0
+#endif
+
+// Bulk ASCII case conversion, comparison and hashing, 32 (AVX2) or 16 (SSE2)
+// bytes per step. Bytes outside A-Z and a-z, including UTF-8 sequences, are
+// left unchanged.
+
+namespace util {
+namespace internal {
+
+#if COMMON_ASCII_SSE2
+// Sets bit 0x20 of the bytes in [first, first + 26) of v to lower, clears it to upper.
+inline __m128i change_case_ascii(__m128i v, char first, bool lower) noexcept
+{
+	const __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(0x80 - first)));
+	const __m128i letter = _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(0x80 + 26)));
+	const __m128i bit = _mm_and_si128(letter, _mm_set1_epi8(0x20));
+	return lower ? _mm_or_si128(v, bit) : _mm_xor_si128(v, bit);
+}
+#endif
+
+#if COMMON_ASCII_AVX2
+inline __m256i change_case_ascii(__m256i v, char first, bool lower) noexcept
+{
+	const __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(0x80 - first)));
+	const __m256i letter = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(0x80 + 26)), shifted);
+	const __m256i bit = _mm256_and_si256(letter, _mm256_set1_epi8(0x20));
+	return lower ? _mm256_or_si256(v, bit) : _mm256_xor_si256(v, bit);
+}
+#endif
+
+inline void change_case_ascii(const char* in, size_t size, char* out, bool lower) noexcept
+{
+	size_t i = 0;
+#if COMMON_ASCII_SSE2
+	const char first = lower ? 'A' : 'a';
+#endif
+#if COMMON_ASCII_AVX2
+	for (; i + 32 <= size; i += 32)
+	{
+		const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), change_case_ascii(v, first, lower));
+	}
+#endif
+#if COMMON_ASCII_SSE2
+	for (; i + 16 <= size; i += 16)
+	{
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), change_case_ascii(v, first, lower));
+	}
+#endif
+	for (; i < size; ++i)
+	{
+		out[i] = lower ? to_lower_ascii(in[i]) : to_upper_ascii(in[i]);
+	}
+}
+
+inline uint64_t load_lower_ascii(const char* str, size_t size) noexcept
+{
+	char lower[8] = {};
+	change_case_ascii(str, size, lower, true);
+	uint64_t word;
+	::std::memcpy(&word, lower, sizeof(word));
+	return word;
+}
+
+inline uint64_t mix_hash(uint64_t hash, uint64_t word) noexcept
+{
+	hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+	return hash ^ (hash >> 29);
+}
+
+} // namespace internal
+
+inline void to_lower_ascii(char* str, size_t size) noexcept
+{
+	internal::change_case_ascii(str, size, str, true);
+}
+
+inline void to_upper_ascii(char* str, size_t size) noexcept
+{
+	internal::change_case_ascii(str, size, str, false);
+}
+
+// Copies size characters to out, which may be str.
+inline void to_lower_ascii(const char* str, size_t size, char* out) noexcept
+{
+	internal::change_case_ascii(str, size, out, true);
+}
+
+inline void to_upper_ascii(const char* str, size_t size, char* out) noexcept
+{
+	internal::change_case_ascii(str, size, out, false);
+}
+
+// Compares like strcmp after lowering both strings.
+inline int icompare_ascii(::std::string_view a, ::std::string_view b) noexcept
+{
+	const size_t size = (a.size() < b.size()) ? a.size() : b.size();
+	size_t i = 0;
+#if COMMON_ASCII_SSE2
+	for (; i + 16 <= size; i += 16)
+	{
+		const __m128i x = internal::change_case_ascii(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a.data() + i)), 'A', true);
+		const __m128i y = internal::change_case_ascii(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b.data() + i)), 'A', true);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff)
+		{
+			break;
+		}
+	}
+#endif
+	for (; i < size; ++i)
+	{
+		const unsigned char x = to_lower_ascii(static_cast<unsigned char>(a[i]));
+		const unsigned char y = to_lower_ascii(static_cast<unsigned char>(b[i]));
+		if (x != y)
+		{
+			return (x < y) ? -1 : 1;
+		}
+	}
+	return (a.size() == b.size()) ? 0 : (a.size() < b.size()) ? -1 : 1;
+}
+
+inline bool iequals_ascii(::std::string_view a, ::std::string_view b) noexcept
+{
+	if (a.size() != b.size())
+	{
+		return false;
+	}
+	const size_t size = a.size();
+	size_t i = 0;
+#if COMMON_ASCII_AVX2
+	for (; i + 32 <= size; i += 32)
+	{
+		const __m256i x = internal::change_case_ascii(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.data() + i)), 'A', true);
+		const __m256i y = internal::change_case_ascii(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b.data() + i)), 'A', true);
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != -1)
+		{
+			return false;
+		}
+	}
+#endif
+#if COMMON_ASCII_SSE2
+	for (; i + 16 <= size; i += 16)
+	{
+		const __m128i x = internal::change_case_ascii(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a.data() + i)), 'A', true);
+		const __m128i y = internal::change_case_ascii(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b.data() + i)), 'A', true);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff)
+		{
+			return false;
+		}
+	}
+#endif
+	for (; i < size; ++i)
+	{
+		if (to_lower_ascii(a[i]) != to_lower_ascii(b[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Hash of the lowered string, equal for strings equal by iequals_ascii.
+inline size_t ihash_ascii(::std::string_view str) noexcept
+{
+	const char* data = str.data();
+	size_t size = str.size();
+	uint64_t hash = 0x243f6a8885a308d3ull ^ size;
+#if COMMON_ASCII_SSE2
+	for (; size >= 16; data += 16, size -= 16)
+	{
+		alignas(16) uint64_t words[2];
+		_mm_store_si128(reinterpret_cast<__m128i*>(words),
+			internal::change_case_ascii(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), 'A', true));
+		hash = internal::mix_hash(internal::mix_hash(hash, words[0]), words[1]);
+	}
+#endif
+	for (; size >= 8; data += 8, size -= 8)
+	{
+		hash = internal::mix_hash(hash, internal::load_lower_ascii(data, 8));
+	}
+	if (size != 0)
+	{
+		hash = internal::mix_hash(hash, internal::load_lower_ascii(data, size));
+	}
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	return static_cast<size_t>(hash);
+}
+
+// Functors for keying containers case-insensitively without lowered copies,
+// e.g. vector_map<std::string, V, ascii_iless> or
+// std::unordered_map<std::string, V, ascii_ihash, ascii_iequal_to>.
+
+struct ascii_iless
+{
+	using is_transparent = void;
+
+	bool operator()(::std::string_view a, ::std::string_view b) const noexcept
+	{
+		return icompare_ascii(a, b) < 0;
+	}
+};
+
+struct ascii_iequal_to
+{
+	using is_transparent = void;
+
+	bool operator()(::std::string_view a, ::std::string_view b) const noexcept
+	{
+		return iequals_ascii(a, b);
+	}
+};
+
+struct ascii_ihash
+{
+	using is_transparent = void;
+
+	size_t operator()(::std::string_view str) const noexcept
+	{
+		return ihash_ascii(str);
+	}
+};
+
+} // namespace util
+
+#ifdef ASCII_BENCHMARK
+#include <string>
+#include <common/benchmark.h>
+
+// Bulk case kernels against the per character table on a header name and on
+// a 64 KiB buffer of header lines.
+
+namespace internal_ascii_benchmark {
+
+inline ::std::string text(size_t size)
+{
+	::std::string str;
+	while (str.size() < size)
+		str += "Content-Type: Application/JSON; Charset=UTF-8\r\nX-Request-ID: 7F3A-19C2\r\n";
+	str.resize(size);
+	return str;
+}
+
+template <int Kind>
+inline void run(::bench::state& state, size_t size)
+{
+	::std::string str = text(size);
+	::std::string upper = str;
+	::util::to_upper_ascii(upper.data(), upper.size());
+	while (state.keep_running())
+	{
+		if (Kind == 0)
+		{
+			for (char& ch : str)
+				ch = ::util::to_lower_ascii(ch);
+			::bench::do_not_optimize(str);
+		}
+		else if (Kind == 1)
+		{
+			::util::to_lower_ascii(str.data(), str.size());
+			::bench::do_not_optimize(str);
+		}
+		else if (Kind == 2)
+		{
+			bool equal = true;
+			for (size_t i = 0; i < size && equal; ++i)
+				equal = ::util::to_lower_ascii(str[i]) == ::util::to_lower_ascii(upper[i]);
+			::bench::do_not_optimize(equal);
+		}
+		else if (Kind == 3)
+			::bench::do_not_optimize(::util::iequals_ascii(str, upper));
+		else
+			::bench::do_not_optimize(::util::ihash_ascii(upper));
+	}
+	state.set_bytes_processed(state.iterations() * size);
+}
+
+} // namespace internal_ascii_benchmark
+
+#define ASCII_BENCHMARK_SIZE(name, size) \
+	BENCHMARK(table_to_lower_##name) { internal_ascii_benchmark::run<0>(state, size); } \
+	BENCHMARK(to_lower_ascii_##name) { internal_ascii_benchmark::run<1>(state, size); } \
+	BENCHMARK(table_iequals_##name) { internal_ascii_benchmark::run<2>(state, size); } \
+	BENCHMARK(iequals_ascii_##name) { internal_ascii_benchmark::run<3>(state, size); } \
+	BENCHMARK(ihash_ascii_##name) { internal_ascii_benchmark::run<4>(state, size); }
+
+ASCII_BENCHMARK_SIZE(header_name, 24)
+ASCII_BENCHMARK_SIZE(buffer, 65536)
+
+#endif
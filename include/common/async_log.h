@@ -0,0 +1,1058 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <csignal>
+#include <algorithm>
+#include <condition_variable>
+#include <common/stl.h>
+#include <common/charconv.h>
+#include <common/string_builder.h>
+#include <common/binary_log.h>
+#include <common/util_log.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <io.h>
+#include <Windows.h>
+#else
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+// Asynchronous log backend, opt in by including this header. Once started,
+// util::clog and friends of util_log.h format the record on the calling
+// thread into a lock-free ring owned by that thread and return. A background
+// thread collects the records of all rings and writes them in batches with
+// writev. Records of one thread keep their order, records of different
+// threads are only ordered by the time the writer picks them up.
+//
+//   util::async_logger::instance().start();
+//   util::clog("order %d filled", id); // no syscall, no lock
+//   util::async_logger::instance().stop(); // or at exit
+//
+// The crash handler writes the records that are still buffered when the
+// process receives SIGSEGV, SIGBUS, SIGILL, SIGFPE or SIGABRT (an unhandled
+// SEH exception or SIGABRT on Windows) and then passes it on to the handler
+// installed before, or to the default handling.
+// It only makes async signal safe calls and formats deferred records into
+// buffers allocated by start, without flags, widths and float precisions.
+//
+// With log_encoding::deferred or binary, UTIL_CLOG from util_log.h only
+// copies the format id and the arguments, see binary_log.h.
+
+namespace util {
+
+enum class log_overflow
+{
+	drop,  // discard records that do not fit
+	block, // wait until the writer made room
+	count  // discard records and log how many were discarded
+};
+
+enum class log_encoding
+{
+	text,     // records are formatted by the logging thread
+	deferred, // UTIL_CLOG records are formatted by the writer thread
+	binary    // UTIL_CLOG records are written as binary, see binary_log.h
+};
+
+struct async_log_options
+{
+	// Per thread, rounded up to a power of two. The rings outlive stop(), so a
+	// restart keeps the size of the first start once a thread has logged.
+	size_t bufferSize = 1 << 20;
+	log_overflow overflow = log_overflow::count;
+	log_encoding encoding = log_encoding::text;
+	int fd = 2;
+	bool crashHandler = true;
+};
+
+struct async_log_statistics
+{
+	uint64_t records;
+	uint64_t bytes;
+	uint64_t dropped;
+	uint64_t blocked;
+	uint64_t writes;
+};
+
+namespace internal {
+
+struct log_segment
+{
+	const char* data;
+	size_t size;
+};
+
+// Writes all segments, continuing after partial writes and interrupts.
+// Only uses async signal safe calls.
+inline bool write_segments(int fd, log_segment* segments, size_t count) noexcept
+{
+#ifdef _WIN32
+	for (size_t i = 0; i < count; ++i)
+	{
+		const char* data = segments[i].data;
+		size_t size = segments[i].size;
+		while (size != 0)
+		{
+			const int n = ::_write(fd, data, static_cast<unsigned int>(::std::min<size_t>(size, 1 << 30)));
+			if (n <= 0)
+			{
+				return false;
+			}
+			data += n;
+			size -= static_cast<size_t>(n);
+		}
+	}
+	return true;
+#else
+	constexpr size_t max_batch = 64;
+	while (count != 0)
+	{
+		iovec vectors[max_batch];
+		const size_t batch = ::std::min(count, max_batch);
+		for (size_t i = 0; i < batch; ++i)
+		{
+			vectors[i].iov_base = const_cast<char*>(segments[i].data);
+			vectors[i].iov_len = segments[i].size;
+		}
+		const ssize_t n = ::writev(fd, vectors, static_cast<int>(batch));
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+		size_t written = static_cast<size_t>(n);
+		while (count != 0 && written >= segments->size)
+		{
+			written -= segments->size;
+			++segments;
+			--count;
+		}
+		if (count != 0)
+		{
+			segments->data += written;
+			segments->size -= written;
+		}
+	}
+	return true;
+#endif
+}
+
+// Single producer, single consumer ring of complete text records. The head
+// is published after the whole record was copied, so the consumer never
+// sees partial records.
+class log_ring
+{
+public:
+	explicit log_ring(size_t capacity)
+		: m_data(new char[capacity])
+		, m_capacity(capacity)
+	{
+	}
+
+	log_ring(const log_ring&) = delete;
+	log_ring& operator=(const log_ring&) = delete;
+
+	size_t capacity() const noexcept
+	{
+		return m_capacity;
+	}
+
+	// Pushes the parts as one record of size bytes.
+	bool try_push(const log_segment* parts, size_t count, size_t size) noexcept
+	{
+		uint64_t head = m_head.load(::std::memory_order_relaxed);
+		if (size > m_capacity - static_cast<size_t>(head - m_tail.load(::std::memory_order_acquire)))
+		{
+			return false;
+		}
+		const uint64_t end = head + size;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const size_t offset = static_cast<size_t>(head & (m_capacity - 1));
+			const size_t first = ::std::min(parts[i].size, m_capacity - offset);
+			::std::memcpy(m_data.get() + offset, parts[i].data, first);
+			::std::memcpy(m_data.get(), parts[i].data + first, parts[i].size - first);
+			head += parts[i].size;
+		}
+		m_head.store(end, ::std::memory_order_release);
+		return true;
+	}
+
+	void copy(uint64_t position, void* out, size_t size) const noexcept
+	{
+		const size_t offset = static_cast<size_t>(position & (m_capacity - 1));
+		const size_t first = ::std::min(size, m_capacity - offset);
+		::std::memcpy(out, m_data.get() + offset, first);
+		::std::memcpy(static_cast<char*>(out) + first, m_data.get(), size - first);
+	}
+
+	// Returns null if the bytes wrap around the end of the ring.
+	const char* contiguous(uint64_t position, size_t size) const noexcept
+	{
+		const size_t offset = static_cast<size_t>(position & (m_capacity - 1));
+		return (offset + size <= m_capacity) ? m_data.get() + offset : nullptr;
+	}
+
+	// Adds up to two segments of pending records and returns their end.
+	uint64_t pending(log_segment* segments, size_t& count) const noexcept
+	{
+		const uint64_t head = m_head.load(::std::memory_order_acquire);
+		const uint64_t tail = m_tail.load(::std::memory_order_relaxed);
+		if (head == tail)
+		{
+			return head;
+		}
+		const size_t offset = static_cast<size_t>(tail & (m_capacity - 1));
+		const size_t size = static_cast<size_t>(head - tail);
+		const size_t first = ::std::min(size, m_capacity - offset);
+		segments[count++] = { m_data.get() + offset, first };
+		if (first < size)
+		{
+			segments[count++] = { m_data.get(), size - first };
+		}
+		return head;
+	}
+
+	void release(uint64_t head) noexcept
+	{
+		m_tail.store(head, ::std::memory_order_release);
+	}
+
+	uint64_t head() const noexcept { return m_head.load(::std::memory_order_acquire); }
+	uint64_t tail() const noexcept { return m_tail.load(::std::memory_order_acquire); }
+
+	::std::atomic<bool> owned{ true };
+	::std::atomic<bool> pushing{ false };
+
+private:
+	const ::std::unique_ptr<char[]> m_data;
+	const size_t m_capacity;
+	alignas(64) ::std::atomic<uint64_t> m_head{ 0 };
+	alignas(64) ::std::atomic<uint64_t> m_tail{ 0 };
+};
+
+// Appends the text of the binary records in [from, to).
+template <class Builder, class Scratch>
+inline void format_log_records(const log_ring& ring, uint64_t from, uint64_t to, Builder& out, Scratch& scratch)
+{
+	while (from < to)
+	{
+		uint32_t header[2];
+		ring.copy(from, header, sizeof(header));
+		const size_t size = header[0] - log_record_header;
+		const char* payload = ring.contiguous(from + log_record_header, size);
+		if (payload == nullptr)
+		{
+			scratch.reset();
+			ring.copy(from + log_record_header, scratch.prepare(size), size);
+			payload = scratch.data();
+		}
+		append_log_record(out, header[1], payload, size);
+		from += header[0];
+	}
+}
+
+// Bounded output of the crash handler.
+struct crash_text
+{
+	char* pos;
+	char* end;
+
+	void append(const char* data, size_t size) noexcept
+	{
+		size = ::std::min(size, static_cast<size_t>(end - pos));
+		::std::memcpy(pos, data, size);
+		pos += size;
+	}
+
+	void append(char ch) noexcept
+	{
+		if (pos != end)
+		{
+			*pos++ = ch;
+		}
+	}
+
+	template <class Value>
+	void append_number(Value value, int base = 10, bool upper = false) noexcept
+	{
+		char buf[72];
+		char* const last = ::stl::to_chars(buf, buf + sizeof(buf), value, base).ptr;
+		for (char* digit = buf; upper && digit != last; ++digit)
+		{
+			*digit = (*digit >= 'a' && *digit <= 'z') ? static_cast<char>(*digit - 'a' + 'A') : *digit;
+		}
+		append(buf, static_cast<size_t>(last - buf));
+	}
+};
+
+// Appends the text of one record like append_log_record without snprintf.
+// Flags and widths are ignored, precisions only limit strings and floating
+// point values are written in the shortest form that reads back.
+inline void append_crash_record(crash_text& out, uint32_t id, const char* payload, size_t size) noexcept
+{
+	if (id == log_text_record)
+	{
+		return out.append(payload, size);
+	}
+	const char* format = log_site_registry::instance().format(id);
+	if (format == nullptr)
+	{
+		out.append("[unknown log format ", 20);
+		out.append_number(id);
+		return out.append("]\n", 2);
+	}
+	const char* pos = payload;
+	const char* const end = payload + size;
+	log_value value;
+	while (*format != 0)
+	{
+		if (*format != '%')
+		{
+			out.append(*format++);
+			continue;
+		}
+		const char* const percent = format++;
+		if (*format == '%')
+		{
+			out.append(*format++);
+			continue;
+		}
+		while (*format != 0 && ::std::strchr("-+ #0", *format) != nullptr)
+			++format;
+		if (*format == '*')
+			++format, read_log_value(pos, end, value);
+		while (*format >= '0' && *format <= '9')
+			++format;
+		size_t precision = ~size_t(0);
+		if (*format == '.')
+		{
+			++format;
+			if (*format == '*')
+			{
+				++format;
+				if (read_log_value(pos, end, value) && log_signed(value) >= 0)
+					precision = static_cast<size_t>(log_signed(value));
+			}
+			else
+			{
+				for (precision = 0; *format >= '0' && *format <= '9'; ++format)
+					precision = precision * 10 + static_cast<size_t>(*format - '0');
+			}
+		}
+		while (*format != 0 && ::std::strchr("hljztLIq0123456789", *format) != nullptr)
+			++format;
+		const char conversion = *format;
+		if (conversion == 0)
+		{
+			break;
+		}
+		++format;
+		if (!read_log_value(pos, end, value))
+		{
+			out.append("<?>", 3);
+			continue;
+		}
+		switch (conversion)
+		{
+		case 'd':
+		case 'i':
+			out.append_number(log_signed(value));
+			break;
+		case 'u':
+			out.append_number(log_unsigned(value));
+			break;
+		case 'o':
+			out.append_number(log_unsigned(value), 8);
+			break;
+		case 'x':
+		case 'X':
+			out.append_number(log_unsigned(value), 16, conversion == 'X');
+			break;
+		case 'c':
+			out.append(static_cast<char>(log_signed(value)));
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+		{
+			char buf[40];
+			out.append(buf, static_cast<size_t>(::stl::to_chars(buf, buf + sizeof(buf), log_double(value)).ptr - buf));
+			break;
+		}
+		case 's':
+			if (value.type == log_arg::string)
+				out.append(value.s, ::std::min(::std::strlen(value.s), precision));
+			else
+				out.append("<?>", 3);
+			break;
+		case 'p':
+			out.append("0x", 2);
+			out.append_number(value.u, 16);
+			break;
+		case 'n':
+			break;
+		default:
+			out.append(percent, static_cast<size_t>(format - percent));
+			break;
+		}
+	}
+	out.append('\n');
+}
+
+template <class Builder>
+inline void append_log_site_record(Builder& out, uint32_t id, const char* format)
+{
+	const size_t length = ::std::strlen(format) + 1;
+	const size_t size = log_record_header + sizeof(id) + length;
+	char* pos = out.prepare(size);
+	pos = write_log_value(pos, static_cast<uint32_t>(size));
+	pos = write_log_value(pos, log_site_record);
+	pos = write_log_value(pos, id);
+	::std::memcpy(pos, format, length);
+	out.commit(size);
+}
+
+} // namespace internal
+
+class async_logger final : public log_sink
+{
+public:
+	static constexpr size_t max_threads = 256;
+
+	static async_logger& instance()
+	{
+		static async_logger s_logger;
+		return s_logger;
+	}
+
+	// The started logger, or null.
+	static async_logger* active() noexcept
+	{
+		return active_pointer().load(::std::memory_order_acquire);
+	}
+
+	~async_logger()
+	{
+		stop();
+	}
+
+	void start(const async_log_options& options = async_log_options())
+	{
+		::std::lock_guard<::std::mutex> lock(m_control);
+		if (m_running.load(::std::memory_order_relaxed))
+		{
+			return;
+		}
+		m_options = options;
+		{
+			::std::lock_guard<::std::mutex> rings(m_ringMutex);
+			if (m_ringCount.load(::std::memory_order_relaxed) == 0)
+			{
+				m_bufferSize = 64;
+				while (m_bufferSize < options.bufferSize)
+				{
+					m_bufferSize *= 2;
+				}
+			}
+		}
+		m_sitesWritten = 0;
+		if (options.encoding == log_encoding::deferred)
+		{
+			// The crash handler can not allocate. All rings have m_bufferSize bytes.
+			m_crashText.reset(new char[crash_text_size]);
+			m_crashScratch.reset(new char[m_bufferSize]);
+		}
+		if (options.encoding == log_encoding::binary)
+		{
+			internal::log_segment magic{ log_file_magic, sizeof(log_file_magic) };
+			internal::write_segments(options.fd, &magic, 1);
+		}
+		m_running.store(true, ::std::memory_order_release);
+		m_accepting.store(true, ::std::memory_order_seq_cst);
+		m_writer = ::std::thread([this] { run(); });
+		if (options.crashHandler)
+		{
+			install_crash_handler();
+		}
+		active_pointer().store(this, ::std::memory_order_release);
+		set_log_sink(this);
+	}
+
+	// Writes all buffered records and stops the writer thread. Records queued
+	// while it stops are written too, later ones are refused and util::clog
+	// writes them to the standard stream.
+	void stop()
+	{
+		::std::lock_guard<::std::mutex> lock(m_control);
+		if (!m_running.load(::std::memory_order_relaxed))
+		{
+			return;
+		}
+		log_sink* self = this;
+		internal::log_sink_pointer().compare_exchange_strong(self, nullptr, ::std::memory_order_acq_rel);
+		active_pointer().store(nullptr, ::std::memory_order_release);
+		m_accepting.store(false, ::std::memory_order_seq_cst);
+		const size_t count = m_ringCount.load(::std::memory_order_seq_cst);
+		for (size_t i = 0; i < count; ++i)
+		{
+			while (m_rings[i].load(::std::memory_order_acquire)->pushing.load(::std::memory_order_seq_cst))
+			{
+				m_wakeup.notify_one();
+				::std::this_thread::yield();
+			}
+		}
+		m_running.store(false, ::std::memory_order_release);
+		m_wakeup.notify_one();
+		m_writer.join();
+	}
+
+	// Queues a complete line, including its line break. Returns false if the
+	// logger is not started, records dropped by the overflow policy count as queued.
+	bool write(const char* data, size_t size)
+	{
+		if (m_options.encoding == log_encoding::text)
+		{
+			const internal::log_segment part{ data, size };
+			return push(&part, 1, size);
+		}
+		char header[log_record_header];
+		internal::write_log_value(internal::write_log_value(header, static_cast<uint32_t>(size + sizeof(header))), log_text_record);
+		const internal::log_segment parts[2] = { { header, sizeof(header) }, { data, size } };
+		return push(parts, 2, size + sizeof(header));
+	}
+
+	// Queues a binary record for the format string with the given id, used
+	// with the deferred and binary encodings. Costs about a copy of the arguments.
+	template <class... Args>
+	bool write_args(uint32_t id, const log_format_args& spec, const Args&... args)
+	{
+		::stl::string_builder& builder = local_builder();
+		const size_t size = log_record_size(spec, args...);
+		builder.reset();
+		encode_log_record(builder.prepare(size), size, id, spec, args...);
+		return write_record(builder.data(), size);
+	}
+
+	template <class... Args>
+	bool printf(const char* format, Args... args)
+	{
+		::stl::string_builder& builder = local_builder();
+		builder.reset();
+		builder.append_printf(format, args...).append('\n');
+		return write(builder.data(), builder.size());
+	}
+
+	bool write_line(const char* data, size_t size) override
+	{
+		return write(data, size);
+	}
+
+	bool write_record(const char* data, size_t size) override
+	{
+		const internal::log_segment part{ data, size };
+		return push(&part, 1, size);
+	}
+
+	bool takes_records() const noexcept override
+	{
+		return m_options.encoding != log_encoding::text;
+	}
+
+	// Waits until the records queued before the call are written.
+	void flush()
+	{
+		uint64_t heads[max_threads];
+		const size_t count = m_ringCount.load(::std::memory_order_acquire);
+		for (size_t i = 0; i < count; ++i)
+		{
+			heads[i] = m_rings[i].load(::std::memory_order_acquire)->head();
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			internal::log_ring* ring = m_rings[i].load(::std::memory_order_acquire);
+			while (ring->tail() < heads[i] && m_running.load(::std::memory_order_acquire))
+			{
+				m_wakeup.notify_one();
+				::std::this_thread::sleep_for(::std::chrono::microseconds(50));
+			}
+		}
+	}
+
+	// Writes the buffered records from a crash or signal handler. Takes no
+	// locks and does not allocate, the writer thread may write some records twice.
+	void flush_on_crash() noexcept
+	{
+		if (m_options.encoding == log_encoding::binary)
+		{
+			// The writer thread may not have written the newest format strings.
+			const log_site_registry& sites = log_site_registry::instance();
+			const size_t siteCount = sites.size();
+			for (size_t id = 1; id <= siteCount; ++id)
+			{
+				const char* format = sites.format(static_cast<uint32_t>(id));
+				const size_t length = ::std::strlen(format) + 1;
+				char header[log_record_header + sizeof(uint32_t)];
+				char* pos = internal::write_log_value(header, static_cast<uint32_t>(sizeof(header) + length));
+				internal::write_log_value(internal::write_log_value(pos, log_site_record), static_cast<uint32_t>(id));
+				internal::log_segment segments[2] = { { header, sizeof(header) }, { format, length } };
+				internal::write_segments(m_options.fd, segments, 2);
+			}
+		}
+		const size_t count = m_ringCount.load(::std::memory_order_acquire);
+		for (size_t i = 0; i < count; ++i)
+		{
+			internal::log_ring* ring = m_rings[i].load(::std::memory_order_acquire);
+			internal::log_segment segments[2];
+			size_t segmentCount = 0;
+			const uint64_t head = ring->pending(segments, segmentCount);
+			if (segmentCount == 0)
+			{
+				continue;
+			}
+			const bool written = (m_options.encoding == log_encoding::deferred)
+				? write_crash_text(*ring, ring->tail(), head)
+				: internal::write_segments(m_options.fd, segments, segmentCount);
+			if (written)
+			{
+				ring->release(head);
+			}
+		}
+	}
+
+	async_log_statistics statistics() const noexcept
+	{
+		return {
+			m_records.load(::std::memory_order_relaxed),
+			m_bytes.load(::std::memory_order_relaxed),
+			m_dropped.load(::std::memory_order_relaxed),
+			m_blocked.load(::std::memory_order_relaxed),
+			m_writes.load(::std::memory_order_relaxed)
+		};
+	}
+
+	const async_log_options& options() const noexcept
+	{
+		return m_options;
+	}
+
+private:
+	async_logger() = default;
+
+	static ::std::atomic<async_logger*>& active_pointer() noexcept
+	{
+		static ::std::atomic<async_logger*> s_active{ nullptr };
+		return s_active;
+	}
+
+	static constexpr size_t crash_text_size = 1 << 16;
+
+	bool write_crash_text(size_t size) noexcept
+	{
+		internal::log_segment segment{ m_crashText.get(), size };
+		return internal::write_segments(m_options.fd, &segment, 1);
+	}
+
+	// Formats the deferred records in [from, to) for flush_on_crash.
+	bool write_crash_text(const internal::log_ring& ring, uint64_t from, uint64_t to) noexcept
+	{
+		char* const buffer = m_crashText.get();
+		internal::crash_text out{ buffer, buffer + crash_text_size };
+		bool written = true;
+		while (from < to)
+		{
+			uint32_t header[2];
+			ring.copy(from, header, sizeof(header));
+			const size_t size = header[0] - log_record_header;
+			const char* payload = ring.contiguous(from + log_record_header, size);
+			if (payload == nullptr)
+			{
+				ring.copy(from + log_record_header, m_crashScratch.get(), size);
+				payload = m_crashScratch.get();
+			}
+			// Records get at least half the buffer, text records are written as they are.
+			if (static_cast<size_t>(out.pos - buffer) > crash_text_size / 2 || header[1] == log_text_record)
+			{
+				written &= write_crash_text(static_cast<size_t>(out.pos - buffer));
+				out.pos = buffer;
+			}
+			if (header[1] == log_text_record)
+			{
+				internal::log_segment segment{ payload, size };
+				written &= internal::write_segments(m_options.fd, &segment, 1);
+			}
+			else
+			{
+				internal::append_crash_record(out, header[1], payload, size);
+			}
+			from += header[0];
+		}
+		return write_crash_text(static_cast<size_t>(out.pos - buffer)) && written;
+	}
+
+	static ::stl::string_builder& local_builder()
+	{
+		static thread_local ::stl::string_builder s_builder;
+		return s_builder;
+	}
+
+	// Rings are never freed. A ring is handed to a new thread after its
+	// owner exited, so their number is bounded by the concurrent threads.
+	internal::log_ring* local_ring()
+	{
+		struct owner
+		{
+			internal::log_ring* ring = nullptr;
+
+			~owner()
+			{
+				if (ring != nullptr)
+				{
+					ring->owned.store(false, ::std::memory_order_release);
+				}
+			}
+		};
+		static thread_local owner s_owner;
+		if (s_owner.ring == nullptr)
+		{
+			s_owner.ring = claim_ring();
+		}
+		return s_owner.ring;
+	}
+
+	// The ring is marked while the record is queued, so stop can wait for it.
+	bool push(const internal::log_segment* parts, size_t count, size_t size)
+	{
+		internal::log_ring* ring = local_ring();
+		if (ring == nullptr)
+		{
+			m_dropped.fetch_add(1, ::std::memory_order_relaxed);
+			return m_accepting.load(::std::memory_order_relaxed);
+		}
+		ring->pushing.store(true, ::std::memory_order_seq_cst);
+		const bool accepting = m_accepting.load(::std::memory_order_seq_cst);
+		if (accepting)
+		{
+			push_record(ring, parts, count, size);
+		}
+		ring->pushing.store(false, ::std::memory_order_release);
+		return accepting;
+	}
+
+	void push_record(internal::log_ring* ring, const internal::log_segment* parts, size_t count, size_t size)
+	{
+		if (size > ring->capacity())
+		{
+			m_dropped.fetch_add(1, ::std::memory_order_relaxed);
+			return;
+		}
+		if (!ring->try_push(parts, count, size))
+		{
+			if (m_options.overflow != log_overflow::block)
+			{
+				m_dropped.fetch_add(1, ::std::memory_order_relaxed);
+				return;
+			}
+			m_blocked.fetch_add(1, ::std::memory_order_relaxed);
+			do {
+				m_wakeup.notify_one();
+				::std::this_thread::yield();
+				if (!m_running.load(::std::memory_order_acquire))
+				{
+					m_dropped.fetch_add(1, ::std::memory_order_relaxed);
+					return;
+				}
+			} while (!ring->try_push(parts, count, size));
+		}
+		m_records.fetch_add(1, ::std::memory_order_relaxed);
+		::std::atomic_thread_fence(::std::memory_order_seq_cst);
+		if (m_sleeping.load(::std::memory_order_relaxed) && m_sleeping.exchange(false, ::std::memory_order_relaxed))
+		{
+			::std::lock_guard<::std::mutex> lock(m_sleepMutex);
+			m_wakeup.notify_one();
+		}
+	}
+
+	internal::log_ring* claim_ring()
+	{
+		::std::lock_guard<::std::mutex> lock(m_ringMutex);
+		const size_t count = m_ringCount.load(::std::memory_order_relaxed);
+		for (size_t i = 0; i < count; ++i)
+		{
+			internal::log_ring* ring = m_rings[i].load(::std::memory_order_relaxed);
+			bool expected = false;
+			if (ring->owned.compare_exchange_strong(expected, true, ::std::memory_order_acq_rel))
+			{
+				return ring;
+			}
+		}
+		if (count == max_threads)
+		{
+			return nullptr;
+		}
+		internal::log_ring* ring = new internal::log_ring(m_bufferSize);
+		m_rings[count].store(ring, ::std::memory_order_release);
+		m_ringCount.store(count + 1, ::std::memory_order_seq_cst);
+		return ring;
+	}
+
+	bool drain()
+	{
+		// The first segment is the text of the writer: format strings,
+		// formatted records and the drop report.
+		internal::log_segment segments[2 * max_threads + 1];
+		uint64_t heads[max_threads];
+		size_t segmentCount = 1;
+		const size_t count = m_ringCount.load(::std::memory_order_acquire);
+		m_output.reset();
+		for (size_t i = 0; i < count; ++i)
+		{
+			internal::log_ring* ring = m_rings[i].load(::std::memory_order_acquire);
+			const size_t first = segmentCount;
+			heads[i] = ring->pending(segments, segmentCount);
+			if (m_options.encoding == log_encoding::deferred)
+			{
+				internal::format_log_records(*ring, ring->tail(), heads[i], m_output, m_scratch);
+				segmentCount = first;
+			}
+		}
+		if (m_options.encoding == log_encoding::binary)
+		{
+			// Registered before any record read above used them.
+			const log_site_registry& sites = log_site_registry::instance();
+			const size_t siteCount = sites.size();
+			for (size_t id = m_sitesWritten + 1; id <= siteCount; ++id)
+			{
+				internal::append_log_site_record(m_output, static_cast<uint32_t>(id), sites.format(static_cast<uint32_t>(id)));
+			}
+			m_sitesWritten = siteCount;
+		}
+		const uint64_t dropped = m_dropped.load(::std::memory_order_relaxed);
+		if (m_options.overflow == log_overflow::count && dropped != m_reportedDropped)
+		{
+			char report[64];
+			const size_t length = static_cast<size_t>(::std::snprintf(report, sizeof(report), "[%llu log records dropped]\n",
+				static_cast<unsigned long long>(dropped - m_reportedDropped)));
+			if (m_options.encoding == log_encoding::binary)
+			{
+				char* header = m_output.prepare(log_record_header);
+				internal::write_log_value(internal::write_log_value(header, static_cast<uint32_t>(length + log_record_header)), log_text_record);
+				m_output.commit(log_record_header);
+			}
+			m_output.append(report, length);
+			m_reportedDropped = dropped;
+		}
+		size_t first = 1;
+		if (!m_output.empty())
+		{
+			first = 0;
+			segments[0] = { m_output.data(), m_output.size() };
+		}
+		if (segmentCount == first)
+		{
+			return false;
+		}
+		size_t bytes = 0;
+		for (size_t i = first; i < segmentCount; ++i)
+		{
+			bytes += segments[i].size;
+		}
+		internal::write_segments(m_options.fd, segments + first, segmentCount - first);
+		for (size_t i = 0; i < count; ++i)
+		{
+			m_rings[i].load(::std::memory_order_relaxed)->release(heads[i]);
+		}
+		m_bytes.fetch_add(bytes, ::std::memory_order_relaxed);
+		m_writes.fetch_add(1, ::std::memory_order_relaxed);
+		return true;
+	}
+
+	bool has_pending() const noexcept
+	{
+		const size_t count = m_ringCount.load(::std::memory_order_acquire);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const internal::log_ring* ring = m_rings[i].load(::std::memory_order_acquire);
+			if (ring->head() != ring->tail())
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void run()
+	{
+		while (m_running.load(::std::memory_order_acquire))
+		{
+			if (drain())
+			{
+				continue;
+			}
+			::std::unique_lock<::std::mutex> lock(m_sleepMutex);
+			m_sleeping.store(true, ::std::memory_order_relaxed);
+			::std::atomic_thread_fence(::std::memory_order_seq_cst);
+			if (!has_pending() && m_running.load(::std::memory_order_acquire))
+			{
+				m_wakeup.wait_for(lock, ::std::chrono::milliseconds(10));
+			}
+			m_sleeping.store(false, ::std::memory_order_relaxed);
+		}
+		while (drain())
+		{
+		}
+	}
+
+#ifdef _WIN32
+	struct previous_handlers
+	{
+		LPTOP_LEVEL_EXCEPTION_FILTER filter;
+		void (*abort)(int);
+	};
+#else
+	static constexpr size_t crash_signal_count = 5;
+
+	static int crash_signal(size_t index) noexcept
+	{
+		static const int s_signals[crash_signal_count] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+		return s_signals[index];
+	}
+
+	struct previous_handlers
+	{
+		struct sigaction actions[crash_signal_count];
+	};
+#endif
+
+	// The handlers installed before the crash handler, which it chains to.
+	static previous_handlers& previous() noexcept
+	{
+		static previous_handlers s_previous;
+		return s_previous;
+	}
+
+	// Flushes once, a chained handler may abort and enter the handler again.
+	static void flush_active_on_crash() noexcept
+	{
+		if (async_logger* logger = active_pointer().exchange(nullptr, ::std::memory_order_acq_rel))
+		{
+			logger->flush_on_crash();
+		}
+	}
+
+#ifdef _WIN32
+	static LONG WINAPI on_crash_exception(EXCEPTION_POINTERS* exception)
+	{
+		flush_active_on_crash();
+		const LPTOP_LEVEL_EXCEPTION_FILTER filter = previous().filter;
+		return (filter != nullptr) ? filter(exception) : EXCEPTION_CONTINUE_SEARCH;
+	}
+
+	static void on_crash_signal(int signal)
+	{
+		flush_active_on_crash();
+		void (*handler)(int) = previous().abort;
+		if (handler != SIG_DFL && handler != SIG_IGN && handler != SIG_ERR)
+		{
+			::std::signal(signal, handler);
+			return handler(signal);
+		}
+		::std::signal(signal, SIG_DFL);
+		::std::raise(signal);
+	}
+#else
+	// Restores the previous action and calls it, or raises the signal again
+	// for the default action once the handler returns.
+	static void on_crash_signal(int signal, siginfo_t* info, void* context)
+	{
+		flush_active_on_crash();
+		for (size_t i = 0; i < crash_signal_count; ++i)
+		{
+			if (crash_signal(i) != signal)
+			{
+				continue;
+			}
+			const struct sigaction& action = previous().actions[i];
+			::sigaction(signal, &action, nullptr);
+			if ((action.sa_flags & SA_SIGINFO) != 0 && action.sa_sigaction != nullptr)
+			{
+				return action.sa_sigaction(signal, info, context);
+			}
+			if (action.sa_handler != SIG_DFL && action.sa_handler != SIG_IGN)
+			{
+				return action.sa_handler(signal);
+			}
+			break;
+		}
+		::std::raise(signal);
+	}
+#endif
+
+	static void install_crash_handler()
+	{
+		static ::std::once_flag s_once;
+		::std::call_once(s_once, [] {
+#ifdef _WIN32
+			previous().filter = ::SetUnhandledExceptionFilter(&async_logger::on_crash_exception);
+			previous().abort = ::std::signal(SIGABRT, &async_logger::on_crash_signal);
+#else
+			for (size_t i = 0; i < crash_signal_count; ++i)
+			{
+				struct sigaction action;
+				::std::memset(&action, 0, sizeof(action));
+				action.sa_sigaction = &async_logger::on_crash_signal;
+				sigemptyset(&action.sa_mask);
+				action.sa_flags = SA_SIGINFO | SA_RESETHAND;
+				::sigaction(crash_signal(i), &action, &previous().actions[i]);
+			}
+#endif
+		});
+	}
+
+	async_log_options m_options;
+	size_t m_bufferSize = 1 << 20;
+	::std::atomic<bool> m_running{ false };
+	::std::atomic<bool> m_sleeping{ false };
+	::std::atomic<bool> m_accepting{ false };
+	::std::mutex m_control;
+	::std::mutex m_sleepMutex;
+	::std::condition_variable m_wakeup;
+	::std::thread m_writer;
+	::std::mutex m_ringMutex;
+	::std::atomic<size_t> m_ringCount{ 0 };
+	::std::atomic<internal::log_ring*> m_rings[max_threads] = {};
+	::std::atomic<uint64_t> m_records{ 0 };
+	::std::atomic<uint64_t> m_bytes{ 0 };
+	::std::atomic<uint64_t> m_dropped{ 0 };
+	::std::atomic<uint64_t> m_blocked{ 0 };
+	::std::atomic<uint64_t> m_writes{ 0 };
+	uint64_t m_reportedDropped = 0;
+	size_t m_sitesWritten = 0;
+	::stl::string_builder m_output;
+	::stl::string_builder m_scratch;
+	::std::unique_ptr<char[]> m_crashText;
+	::std::unique_ptr<char[]> m_crashScratch;
+};
+
+} // namespace util
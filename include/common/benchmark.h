@@ -0,0 +1,535 @@
+#pragma once
+
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <common/stl.h>
+#include <common/time_counter.h>
+#include <common/perf_counters.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Micro benchmark harness on top of util::time_counter.
+//
+//   BENCHMARK(vector_map_find)
+//   {
+//       vector_map<int, int> map = ...;
+//       while (state.keep_running())
+//           bench::do_not_optimize(map.find(42));
+//   }
+//
+//   BENCHMARK_MAIN()
+//
+// Every benchmark is warmed up, its iteration count is calibrated to a
+// minimum trial time and then several trials are timed. Results report the
+// median time per iteration and the median absolute deviation (MAD).
+// Command line options:
+//   --filter=<text>       run benchmarks whose name contains text
+//   --trials=<n>          number of timed trials (default 15)
+//   --min-time-ms=<n>     minimum duration of one trial (default 20)
+//   --cpu=<n>             pin the benchmark thread to a cpu
+//   --json=<file>         write results as json
+//   --baseline=<file>     compare with a json file written by --json
+//   --threshold=<pct>     regression threshold in percent (default 5)
+//   --perf=0              do not read hardware performance counters
+//
+// Where perf_event_open is permitted, results also report IPC and cache and
+// branch misses per iteration.
+
+namespace bench {
+
+#if defined(__GNUC__) || defined(__clang__)
+
+template <class Type>
+inline void do_not_optimize(const Type& value)
+{
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void clobber_memory()
+{
+	asm volatile("" : : : "memory");
+}
+
+#else
+
+namespace internal {
+
+__declspec(noinline) inline void use_char_pointer(const volatile char*) {}
+
+} // namespace internal
+
+template <class Type>
+inline void do_not_optimize(const Type& value)
+{
+	internal::use_char_pointer(&reinterpret_cast<const volatile char&>(value));
+	_ReadWriteBarrier();
+}
+
+inline void clobber_memory()
+{
+	_ReadWriteBarrier();
+}
+
+#endif
+
+inline bool pin_to_cpu(int cpu)
+{
+#ifdef _WIN32
+	return ::SetThreadAffinityMask(::GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return ::sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	(void)cpu;
+	return false;
+#endif
+}
+
+class state
+{
+public:
+	using timer = ::util::time_counter<::std::chrono::nanoseconds, ::util::time_counter_default_printer>;
+
+	explicit state(size_t iterations, ::util::perf_counter_group* counters = nullptr)
+		: m_iterations(iterations)
+		, m_remaining(iterations)
+		, m_counters(counters)
+	{
+	}
+
+	// Starts timing on the first call and stops after the last iteration,
+	// so setup code before the loop is not measured.
+	bool keep_running()
+	{
+		if (m_remaining == m_iterations)
+		{
+			if (m_counters != nullptr)
+			{
+				m_counters->start();
+			}
+			m_timer.start();
+		}
+		if (m_remaining != 0)
+		{
+			--m_remaining;
+			return true;
+		}
+		m_elapsed = m_timer.stop();
+		if (m_counters != nullptr)
+		{
+			m_counts = m_counters->stop();
+		}
+		return false;
+	}
+
+	size_t iterations() const noexcept { return m_iterations; }
+	::std::chrono::nanoseconds elapsed() const noexcept { return m_elapsed; }
+	const ::util::perf_sample& counters() const noexcept { return m_counts; }
+
+	void set_items_processed(size_t items) noexcept { m_items = items; }
+	void set_bytes_processed(size_t bytes) noexcept { m_bytes = bytes; }
+	size_t items_processed() const noexcept { return m_items; }
+	size_t bytes_processed() const noexcept { return m_bytes; }
+
+private:
+	const size_t m_iterations;
+	size_t m_remaining;
+	size_t m_items = 0;
+	size_t m_bytes = 0;
+	::util::perf_counter_group* const m_counters;
+	::util::perf_sample m_counts;
+	timer m_timer;
+	::std::chrono::nanoseconds m_elapsed = ::std::chrono::nanoseconds(0);
+};
+
+using function = void (*)(state&);
+
+struct entry
+{
+	const char* name;
+	function func;
+};
+
+inline ::std::vector<entry>& registry()
+{
+	static ::std::vector<entry> s_entries;
+	return s_entries;
+}
+
+struct registrar
+{
+	registrar(const char* name, function func)
+	{
+		registry().push_back({ name, func });
+	}
+};
+
+struct options
+{
+	::std::string filter;
+	::std::string jsonFile;
+	::std::string baselineFile;
+	size_t trials = 15;
+	::std::chrono::milliseconds minTime = ::std::chrono::milliseconds(20);
+	double threshold = 5.0;
+	int cpu = -1;
+	bool perf = true;
+};
+
+struct result
+{
+	::std::string name;
+	size_t iterations = 0;
+	double median = 0.0; // ns per iteration
+	double mad = 0.0;
+	double min = 0.0;
+	double mean = 0.0;
+	double itemsPerSecond = 0.0;
+	double bytesPerSecond = 0.0;
+	double baseline = 0.0; // median of the baseline, 0 if unknown
+	::util::perf_sample counters; // summed over all trials
+	size_t countedIterations = 0;
+};
+
+namespace internal {
+
+inline double median(::std::vector<double> values)
+{
+	if (values.empty())
+	{
+		return 0.0;
+	}
+	const size_t mid = values.size() / 2;
+	::std::nth_element(values.begin(), values.begin() + mid, values.end());
+	const double upper = values[mid];
+	if (values.size() % 2 != 0)
+	{
+		return upper;
+	}
+	return (upper + *::std::max_element(values.begin(), values.begin() + mid)) / 2.0;
+}
+
+inline double run_once(function func, size_t iterations)
+{
+	state s(iterations);
+	func(s);
+	return static_cast<double>(s.elapsed().count());
+}
+
+// Grows the iteration count until one run takes at least minTime.
+// The runs double as warm-up.
+inline size_t calibrate(function func, ::std::chrono::nanoseconds minTime)
+{
+	const double target = static_cast<double>(minTime.count());
+	size_t iterations = 1;
+	for (;;)
+	{
+		const double elapsed = run_once(func, iterations);
+		if (elapsed >= target || iterations >= (size_t(1) << 40))
+		{
+			return iterations;
+		}
+		double factor = (elapsed > 0.0) ? target * 1.4 / elapsed : 10.0;
+		factor = ::std::min(::std::max(factor, 2.0), 10.0);
+		iterations = static_cast<size_t>(static_cast<double>(iterations) * factor);
+	}
+}
+
+inline result run(const entry& e, const options& opts, ::util::perf_counter_group* counters)
+{
+	const size_t iterations = calibrate(e.func, opts.minTime);
+	::std::vector<double> samples;
+	samples.reserve(opts.trials);
+	double items = 0.0;
+	double bytes = 0.0;
+	::util::perf_sample counts;
+	for (size_t trial = 0; trial < opts.trials; ++trial)
+	{
+		state s(iterations, counters);
+		e.func(s);
+		counts += s.counters();
+		const double ns = static_cast<double>(s.elapsed().count());
+		samples.push_back(ns / static_cast<double>(iterations));
+		items = static_cast<double>(s.items_processed());
+		bytes = static_cast<double>(s.bytes_processed());
+	}
+	result r;
+	r.name = e.name;
+	r.iterations = iterations;
+	r.counters = counts;
+	r.countedIterations = iterations * opts.trials;
+	r.median = median(samples);
+	::std::vector<double> deviations;
+	deviations.reserve(samples.size());
+	for (double sample : samples)
+	{
+		deviations.push_back(::std::fabs(sample - r.median));
+	}
+	r.mad = median(deviations);
+	r.min = samples.empty() ? 0.0 : *::std::min_element(samples.begin(), samples.end());
+	double sum = 0.0;
+	for (double sample : samples)
+	{
+		sum += sample;
+	}
+	r.mean = samples.empty() ? 0.0 : sum / static_cast<double>(samples.size());
+	const double seconds = r.median * static_cast<double>(iterations) / 1e9;
+	if (seconds > 0.0)
+	{
+		r.itemsPerSecond = items / seconds;
+		r.bytesPerSecond = bytes / seconds;
+	}
+	return r;
+}
+
+inline ::std::string escape_json(const ::std::string& str)
+{
+	::std::string escaped;
+	for (const char ch : str)
+	{
+		if (ch == '"' || ch == '\\')
+		{
+			escaped += '\\';
+			escaped += ch;
+		}
+		else if (static_cast<unsigned char>(ch) < 0x20)
+		{
+			escaped += ::stl::string_format("\\u%04x", static_cast<unsigned int>(ch));
+		}
+		else
+		{
+			escaped += ch;
+		}
+	}
+	return escaped;
+}
+
+// Reads name and median pairs from a file written by write_json, names stay escaped.
+inline ::std::vector<::std::pair<::std::string, double>> read_baseline(const ::std::string& file)
+{
+	::std::vector<::std::pair<::std::string, double>> baseline;
+	::std::ifstream stream(file);
+	::std::string line;
+	const char nameKey[] = "\"name\": \"";
+	const char medianKey[] = "\"median_ns\": ";
+	while (::std::getline(stream, line))
+	{
+		const size_t name = line.find(nameKey);
+		const size_t median = line.find(medianKey);
+		if (name == ::std::string::npos || median == ::std::string::npos)
+		{
+			continue;
+		}
+		const size_t begin = name + sizeof(nameKey) - 1;
+		size_t end = begin;
+		while (end < line.size() && line[end] != '"')
+		{
+			end += (line[end] == '\\') ? 2 : 1;
+		}
+		if (end >= line.size())
+		{
+			continue;
+		}
+		const double value = ::std::strtod(line.c_str() + median + sizeof(medianKey) - 1, nullptr);
+		baseline.emplace_back(line.substr(begin, end - begin), value);
+	}
+	return baseline;
+}
+
+inline bool starts_with(const char* arg, const char* prefix, const char** value)
+{
+	const size_t length = ::std::strlen(prefix);
+	if (::std::strncmp(arg, prefix, length) == 0)
+	{
+		*value = arg + length;
+		return true;
+	}
+	return false;
+}
+
+} // namespace internal
+
+inline bool is_regression(const result& r, const options& opts)
+{
+	return (r.baseline > 0.0) && (r.median > r.baseline * (1.0 + opts.threshold / 100.0));
+}
+
+inline void write_console_header(::std::ostream& stream)
+{
+	stream << ::stl::string_format("%-48s %14s %12s %10s %12s %14s\n",
+		"benchmark", "median [ns]", "mad [ns]", "mad [%]", "iterations", "vs baseline").c_str();
+}
+
+inline void write_console(::std::ostream& stream, const result& r, const options& opts)
+{
+	const double madPercent = (r.median > 0.0) ? r.mad / r.median * 100.0 : 0.0;
+	::std::string comparison = "-";
+	if (r.baseline > 0.0)
+	{
+		const double change = (r.median / r.baseline - 1.0) * 100.0;
+		comparison = ::stl::string_format("%+.1f%%%s", change, is_regression(r, opts) ? " REGRESSION" : "").c_str();
+	}
+	stream << ::stl::string_format("%-48s %14.2f %12.2f %10.1f %12llu %14s\n",
+		r.name.c_str(), r.median, r.mad, madPercent,
+		static_cast<unsigned long long>(r.iterations), comparison.c_str()).c_str();
+	if (r.itemsPerSecond > 0.0 || r.bytesPerSecond > 0.0)
+	{
+		stream << ::stl::string_format("%-48s items/s: %.4g bytes/s: %.4g\n",
+			"", r.itemsPerSecond, r.bytesPerSecond).c_str();
+	}
+	if (r.countedIterations != 0 && r.counters.has(::util::perf_event::cycles))
+	{
+		stream << ::stl::string_format("%-48s %s (per iteration)\n", "",
+			::util::format_perf_sample(r.counters, static_cast<double>(r.countedIterations)).c_str()).c_str();
+	}
+}
+
+inline void write_json(::std::ostream& stream, const ::std::vector<result>& results)
+{
+	stream << "{\n\"benchmarks\": [\n";
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const result& r = results[i];
+		::std::string counters;
+		const double units = static_cast<double>(::std::max<size_t>(r.countedIterations, 1));
+		const struct { ::util::perf_event event; const char* key; } fields[] = {
+			{ ::util::perf_event::cycles, "cycles" },
+			{ ::util::perf_event::instructions, "instructions" },
+			{ ::util::perf_event::l1d_misses, "l1d_misses" },
+			{ ::util::perf_event::llc_misses, "llc_misses" },
+			{ ::util::perf_event::branch_misses, "branch_misses" },
+		};
+		for (const auto& field : fields)
+		{
+			if (r.counters.has(field.event))
+			{
+				counters += ::stl::string_format(", \"%s\": %.4f", field.key,
+					static_cast<double>(r.counters.get(field.event)) / units).c_str();
+			}
+		}
+		if (r.counters.has(::util::perf_event::cycles) && r.counters.has(::util::perf_event::instructions))
+		{
+			counters += ::stl::string_format(", \"ipc\": %.4f", r.counters.instructions_per_cycle()).c_str();
+		}
+		stream << ::stl::string_format(
+			"{\"name\": \"%s\", \"iterations\": %llu, \"median_ns\": %.4f, \"mad_ns\": %.4f, "
+			"\"min_ns\": %.4f, \"mean_ns\": %.4f, \"items_per_second\": %.6g, \"bytes_per_second\": %.6g%s}%s\n",
+			internal::escape_json(r.name).c_str(), static_cast<unsigned long long>(r.iterations),
+			r.median, r.mad, r.min, r.mean, r.itemsPerSecond, r.bytesPerSecond, counters.c_str(),
+			(i + 1 < results.size()) ? "," : "").c_str();
+	}
+	stream << "]\n}\n";
+}
+
+// Runs all registered benchmarks. Returns 1 if a regression against
+// the baseline was detected, 0 otherwise.
+inline int run_all(const options& opts, ::std::ostream& stream = ::std::cout)
+{
+	if (opts.cpu >= 0 && !pin_to_cpu(opts.cpu))
+	{
+		stream << "Failed to pin to cpu " << opts.cpu << "\n";
+	}
+	::std::vector<::std::pair<::std::string, double>> baseline;
+	if (!opts.baselineFile.empty())
+	{
+		baseline = internal::read_baseline(opts.baselineFile);
+	}
+	::std::unique_ptr<::util::perf_counter_group> counters;
+	if (opts.perf)
+	{
+		counters.reset(new ::util::perf_counter_group());
+		if (!counters->available())
+		{
+			counters.reset();
+		}
+	}
+	::std::vector<result> results;
+	bool regression = false;
+	write_console_header(stream);
+	for (const entry& e : registry())
+	{
+		if (!opts.filter.empty() && ::std::strstr(e.name, opts.filter.c_str()) == nullptr)
+		{
+			continue;
+		}
+		result r = internal::run(e, opts, counters.get());
+		const ::std::string escapedName = internal::escape_json(r.name);
+		for (const auto& base : baseline)
+		{
+			if (base.first == escapedName)
+			{
+				r.baseline = base.second;
+			}
+		}
+		regression |= is_regression(r, opts);
+		write_console(stream, r, opts);
+		results.push_back(r);
+	}
+	if (!opts.jsonFile.empty())
+	{
+		::std::ofstream json(opts.jsonFile);
+		write_json(json, results);
+	}
+	return regression ? 1 : 0;
+}
+
+inline options parse_options(int argc, char** argv)
+{
+	options opts;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* value = nullptr;
+		if (internal::starts_with(argv[i], "--filter=", &value))
+			opts.filter = value;
+		else if (internal::starts_with(argv[i], "--json=", &value))
+			opts.jsonFile = value;
+		else if (internal::starts_with(argv[i], "--baseline=", &value))
+			opts.baselineFile = value;
+		else if (internal::starts_with(argv[i], "--trials=", &value))
+			opts.trials = ::std::max<size_t>(1, ::std::strtoul(value, nullptr, 10));
+		else if (internal::starts_with(argv[i], "--min-time-ms=", &value))
+			opts.minTime = ::std::chrono::milliseconds(::std::strtoul(value, nullptr, 10));
+		else if (internal::starts_with(argv[i], "--threshold=", &value))
+			opts.threshold = ::std::strtod(value, nullptr);
+		else if (internal::starts_with(argv[i], "--cpu=", &value))
+			opts.cpu = ::std::atoi(value);
+		else if (internal::starts_with(argv[i], "--perf=", &value))
+			opts.perf = ::std::atoi(value) != 0;
+	}
+	return opts;
+}
+
+} // namespace bench
+
+#define BENCHMARK(name) \
+	static void name(::bench::state& state); \
+	static ::bench::registrar name##_registrar(#name, name); \
+	static void name(::bench::state& state)
+
+#define BENCHMARK_MAIN() \
+	int main(int argc, char** argv) \
+	{ \
+		return ::bench::run_all(::bench::parse_options(argc, argv)); \
+	}
@@ -0,0 +1,713 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include <string_view>
+#include <type_traits>
+#include <common/string_builder.h>
+
+// Binary log records for deferred formatting. The logging thread stores the
+// id of the printf format string of the call site and the raw argument
+// values, the text is produced later by the async_logger writer thread
+// (log_encoding::deferred) or offline from a binary log file
+// (log_encoding::binary) with decode_binary_log:
+//
+//   // decoder.cpp
+//   #include <common/binary_log.h>
+//   BINARY_LOG_DECODER_MAIN()
+//
+// A record is, in native byte order, the uint32 size of the whole record,
+// the uint32 format id and for each argument a log_arg tag followed by the
+// value. Strings are copied as uint32 length and characters plus null.
+// Character pointers are copied as strings only for %s conversions, up to the
+// precision of %.*s, and as pointers otherwise.
+// Format id 0 marks an already formatted line, log_site_record a format
+// string definition {uint32 id, characters} in binary files.
+
+namespace util {
+
+enum class log_arg : uint8_t
+{
+	int32 = 1,
+	uint32,
+	int64,
+	uint64,
+	float64,
+	string,
+	pointer
+};
+
+constexpr uint32_t log_text_record = 0;
+constexpr uint32_t log_site_record = 0xffffffff;
+constexpr size_t log_record_header = 8;
+constexpr size_t max_log_sites = 1 << 14;
+constexpr char log_file_magic[8] = { 'C', 'L', 'O', 'G', 'B', 'I', 'N', '1' };
+
+// The arguments of a printf format read by %s and those of them bounded by a
+// %.*s precision, as bits by argument index. The default reads every
+// character pointer as a string.
+struct log_format_args
+{
+	uint64_t strings = ~uint64_t(0);
+	uint64_t bounded = 0;
+};
+
+constexpr size_t max_log_args = 64;
+
+inline log_format_args parse_log_format(const char* format) noexcept
+{
+	log_format_args result;
+	result.strings = 0;
+	size_t index = 0;
+	for (; *format != 0; ++format)
+	{
+		if (*format != '%')
+		{
+			continue;
+		}
+		++format;
+		if (*format == '%')
+		{
+			continue;
+		}
+		while (*format != 0 && ::std::strchr("-+ #0", *format) != nullptr)
+			++format;
+		if (*format == '*')
+			++format, ++index;
+		while (*format >= '0' && *format <= '9')
+			++format;
+		bool boundedString = false;
+		if (*format == '.')
+		{
+			++format;
+			if (*format == '*')
+				++format, ++index, boundedString = true;
+			while (*format >= '0' && *format <= '9')
+				++format;
+		}
+		while (*format != 0 && ::std::strchr("hljztLIq0123456789", *format) != nullptr)
+			++format;
+		if (*format == 0)
+		{
+			break;
+		}
+		if (*format == 's' && index < max_log_args)
+		{
+			result.strings |= uint64_t(1) << index;
+			result.bounded |= boundedString ? uint64_t(1) << index : 0;
+		}
+		++index;
+	}
+	return result;
+}
+
+// Format strings by id. Lookups are lock-free, so the crash handler can use them.
+class log_site_registry
+{
+public:
+	static log_site_registry& instance()
+	{
+		static log_site_registry s_registry;
+		return s_registry;
+	}
+
+	// Returns the id stored in site, or 0 if all ids are used.
+	uint32_t add(::std::atomic<uint32_t>& site, const char* format)
+	{
+		::std::lock_guard<::std::mutex> lock(m_mutex);
+		uint32_t id = site.load(::std::memory_order_relaxed);
+		const size_t count = m_count.load(::std::memory_order_relaxed);
+		if (id == 0 && count + 1 < max_log_sites)
+		{
+			id = static_cast<uint32_t>(count + 1);
+			m_formats[id].store(format, ::std::memory_order_relaxed);
+			m_count.store(count + 1, ::std::memory_order_release);
+			site.store(id, ::std::memory_order_release);
+		}
+		return id;
+	}
+
+	const char* format(uint32_t id) const noexcept
+	{
+		return (id != 0 && id <= size()) ? m_formats[id].load(::std::memory_order_relaxed) : nullptr;
+	}
+
+	size_t size() const noexcept
+	{
+		return m_count.load(::std::memory_order_acquire);
+	}
+
+private:
+	log_site_registry() = default;
+
+	::std::mutex m_mutex;
+	::std::atomic<size_t> m_count{ 0 };
+	::std::atomic<const char*> m_formats[max_log_sites] = {};
+};
+
+// Static per call site, gets its id on first use.
+class log_site
+{
+public:
+	constexpr log_site() noexcept = default;
+
+	log_site(const log_site&) = delete;
+	log_site& operator=(const log_site&) = delete;
+
+	uint32_t id(const char* format)
+	{
+		const uint32_t id = m_id.load(::std::memory_order_acquire);
+		if (id != 0)
+		{
+			return id;
+		}
+		const log_format_args args = parse_log_format(format);
+		m_strings.store(args.strings, ::std::memory_order_relaxed);
+		m_bounded.store(args.bounded, ::std::memory_order_relaxed);
+		return log_site_registry::instance().add(m_id, format);
+	}
+
+	// Valid once id returned a nonzero id.
+	log_format_args args() const noexcept
+	{
+		log_format_args args;
+		args.strings = m_strings.load(::std::memory_order_relaxed);
+		args.bounded = m_bounded.load(::std::memory_order_relaxed);
+		return args;
+	}
+
+private:
+	::std::atomic<uint32_t> m_id{ 0 };
+	::std::atomic<uint64_t> m_strings{ 0 };
+	::std::atomic<uint64_t> m_bounded{ 0 };
+};
+
+namespace internal {
+
+template <class T>
+struct is_log_string : ::std::false_type
+{
+};
+
+template <>
+struct is_log_string<const char*> : ::std::true_type
+{
+};
+
+template <>
+struct is_log_string<char*> : ::std::true_type
+{
+};
+
+template <class Traits, class Allocator>
+struct is_log_string<::std::basic_string<char, Traits, Allocator>> : ::std::true_type
+{
+};
+
+template <class T>
+struct dependent_false : ::std::false_type
+{
+};
+
+template <class T>
+constexpr log_arg log_arg_of() noexcept
+{
+	using type = typename ::std::decay<T>::type;
+	if constexpr (::std::is_enum<type>::value)
+	{
+		return log_arg_of<typename ::std::underlying_type<type>::type>();
+	}
+	else if constexpr (::std::is_floating_point<type>::value)
+	{
+		return log_arg::float64;
+	}
+	else if constexpr (::std::is_integral<type>::value)
+	{
+		if constexpr (sizeof(type) <= 4)
+			return ::std::is_signed<type>::value ? log_arg::int32 : log_arg::uint32;
+		else
+			return ::std::is_signed<type>::value ? log_arg::int64 : log_arg::uint64;
+	}
+	else if constexpr (is_log_string<type>::value)
+	{
+		return log_arg::string;
+	}
+	else if constexpr (::std::is_pointer<type>::value || ::std::is_null_pointer<type>::value)
+	{
+		return log_arg::pointer;
+	}
+	else
+	{
+		static_assert(dependent_false<T>::value, "Type can not be logged");
+		return log_arg::pointer;
+	}
+}
+
+// How a string argument is read, see log_format_args.
+struct log_string_arg
+{
+	bool string;
+	size_t limit;
+};
+
+template <class T>
+inline int64_t log_precision(const T& value) noexcept
+{
+	if constexpr (::std::is_integral<T>::value)
+		return static_cast<int64_t>(value);
+	else
+		return -1;
+}
+
+// precisions[index] is the value of the argument before index, if it is an integer.
+inline log_string_arg log_string_arg_of(const log_format_args& spec, const int64_t* precisions, size_t index) noexcept
+{
+	const bool bounded = (spec.bounded >> index & 1) != 0 && precisions[index] >= 0;
+	return { (spec.strings >> index & 1) != 0, bounded ? static_cast<size_t>(precisions[index]) : ~size_t(0) };
+}
+
+inline ::std::string_view log_string(const char* str, size_t limit) noexcept
+{
+	if (str == nullptr)
+	{
+		return ::std::string_view("(null)");
+	}
+	if (limit == ~size_t(0))
+	{
+		return ::std::string_view(str);
+	}
+	const void* end = ::std::memchr(str, 0, limit);
+	return ::std::string_view(str, (end != nullptr) ? static_cast<size_t>(static_cast<const char*>(end) - str) : limit);
+}
+
+template <class Traits, class Allocator>
+inline ::std::string_view log_string(const ::std::basic_string<char, Traits, Allocator>& str, size_t limit) noexcept
+{
+	return ::std::string_view(str.data(), ::std::min(str.size(), limit));
+}
+
+// Character pointers that are not read by %s are stored as pointers.
+template <class T>
+constexpr log_arg log_arg_of(const log_string_arg& arg) noexcept
+{
+	constexpr log_arg type = log_arg_of<T>();
+	return (type == log_arg::string && !arg.string && !::std::is_class<T>::value) ? log_arg::pointer : type;
+}
+
+template <class T>
+inline size_t log_arg_size(const T& value, const log_string_arg& arg) noexcept
+{
+	const log_arg type = log_arg_of<T>(arg);
+	if constexpr (log_arg_of<T>() == log_arg::string)
+	{
+		if (type == log_arg::string)
+			return 1 + sizeof(uint32_t) + log_string(value, arg.limit).size() + 1;
+	}
+	return 1 + ((type == log_arg::int32 || type == log_arg::uint32) ? sizeof(uint32_t) : sizeof(uint64_t));
+}
+
+template <class Value>
+inline char* write_log_value(char* pos, Value value) noexcept
+{
+	::std::memcpy(pos, &value, sizeof(value));
+	return pos + sizeof(value);
+}
+
+template <class T>
+inline char* write_log_arg(char* pos, const T& value, const log_string_arg& arg) noexcept
+{
+	constexpr log_arg type = log_arg_of<T>();
+	if constexpr (type == log_arg::string && !::std::is_class<T>::value)
+	{
+		if (!arg.string)
+		{
+			*pos++ = static_cast<char>(log_arg::pointer);
+			return write_log_value(pos, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+		}
+	}
+	*pos++ = static_cast<char>(type);
+	if constexpr (type == log_arg::int32)
+		return write_log_value(pos, static_cast<int32_t>(value));
+	else if constexpr (type == log_arg::uint32)
+		return write_log_value(pos, static_cast<uint32_t>(value));
+	else if constexpr (type == log_arg::int64)
+		return write_log_value(pos, static_cast<int64_t>(value));
+	else if constexpr (type == log_arg::uint64)
+		return write_log_value(pos, static_cast<uint64_t>(value));
+	else if constexpr (type == log_arg::float64)
+		return write_log_value(pos, static_cast<double>(value));
+	else if constexpr (type == log_arg::string)
+	{
+		const ::std::string_view text = log_string(value, arg.limit);
+		pos = write_log_value(pos, static_cast<uint32_t>(text.size()));
+		::std::memcpy(pos, text.data(), text.size());
+		pos[text.size()] = 0;
+		return pos + text.size() + 1;
+	}
+	else if constexpr (::std::is_null_pointer<typename ::std::decay<T>::type>::value)
+		return write_log_value(pos, uint64_t(0));
+	else
+		return write_log_value(pos, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+}
+
+struct log_value
+{
+	log_arg type;
+	union
+	{
+		int64_t i;
+		uint64_t u;
+		double f;
+		const char* s;
+	};
+};
+
+inline bool read_log_value(const char*& pos, const char* end, log_value& value) noexcept
+{
+	if (pos == end)
+	{
+		return false;
+	}
+	value.type = static_cast<log_arg>(*pos++);
+	auto read = [&](void* out, size_t size) {
+		if (static_cast<size_t>(end - pos) < size)
+		{
+			return false;
+		}
+		::std::memcpy(out, pos, size);
+		pos += size;
+		return true;
+	};
+	int32_t i32;
+	uint32_t u32;
+	switch (value.type)
+	{
+	case log_arg::int32:
+		if (!read(&i32, sizeof(i32)))
+			return false;
+		value.i = i32;
+		return true;
+	case log_arg::uint32:
+		if (!read(&u32, sizeof(u32)))
+			return false;
+		value.u = u32;
+		return true;
+	case log_arg::int64:
+		return read(&value.i, sizeof(value.i));
+	case log_arg::uint64:
+	case log_arg::pointer:
+		return read(&value.u, sizeof(value.u));
+	case log_arg::float64:
+		return read(&value.f, sizeof(value.f));
+	case log_arg::string:
+		if (!read(&u32, sizeof(u32)) || static_cast<size_t>(end - pos) <= u32)
+			return false;
+		value.s = pos;
+		pos += u32 + 1;
+		return true;
+	}
+	return false;
+}
+
+inline int64_t log_signed(const log_value& value) noexcept
+{
+	return (value.type == log_arg::float64) ? static_cast<int64_t>(value.f) : value.i;
+}
+
+inline uint64_t log_unsigned(const log_value& value) noexcept
+{
+	return (value.type == log_arg::float64) ? static_cast<uint64_t>(value.f) : value.u;
+}
+
+inline double log_double(const log_value& value) noexcept
+{
+	switch (value.type)
+	{
+	case log_arg::float64:
+		return value.f;
+	case log_arg::int32:
+	case log_arg::int64:
+		return static_cast<double>(value.i);
+	default:
+		return static_cast<double>(value.u);
+	}
+}
+
+} // namespace internal
+
+namespace internal {
+
+template <size_t... Index, class... Args>
+inline size_t log_record_size(::std::index_sequence<Index...>, const log_format_args& spec, const Args&... args) noexcept
+{
+	const int64_t precisions[] = { -1, log_precision(args)... };
+	(void)spec, (void)precisions;
+	return (log_record_header + ... + log_arg_size(args, log_string_arg_of(spec, precisions, Index)));
+}
+
+template <size_t... Index, class... Args>
+inline void encode_log_record(::std::index_sequence<Index...>, char* pos, const log_format_args& spec, const Args&... args) noexcept
+{
+	const int64_t precisions[] = { -1, log_precision(args)... };
+	(void)spec, (void)precisions, (void)pos;
+	((pos = write_log_arg(pos, args, log_string_arg_of(spec, precisions, Index))), ...);
+}
+
+} // namespace internal
+
+// Size of the record of args for a format described by spec.
+template <class... Args>
+inline size_t log_record_size(const log_format_args& spec, const Args&... args) noexcept
+{
+	static_assert(sizeof...(Args) <= max_log_args, "Too many log arguments");
+	return internal::log_record_size(::std::index_sequence_for<Args...>(), spec, args...);
+}
+
+template <class... Args>
+inline size_t log_record_size(const Args&... args) noexcept
+{
+	return log_record_size(log_format_args(), args...);
+}
+
+// Writes log_record_size(spec, args...) bytes to out.
+template <class... Args>
+inline void encode_log_record(char* out, size_t size, uint32_t id, const log_format_args& spec, const Args&... args) noexcept
+{
+	char* pos = internal::write_log_value(out, static_cast<uint32_t>(size));
+	pos = internal::write_log_value(pos, id);
+	internal::encode_log_record(::std::index_sequence_for<Args...>(), pos, spec, args...);
+}
+
+template <class... Args>
+inline void encode_log_record(char* out, size_t size, uint32_t id, const Args&... args) noexcept
+{
+	encode_log_record(out, size, id, log_format_args(), args...);
+}
+
+// Appends the text the caller's printf would have written for the arguments.
+// Length modifiers of the format are replaced by the stored argument types,
+// missing arguments are written as <?>.
+template <class Builder>
+inline void format_log_record(Builder& out, const char* format, const char* args, size_t size)
+{
+	const char* pos = args;
+	const char* const end = args + size;
+	internal::log_value value;
+	while (*format != 0)
+	{
+		const char* percent = ::std::strchr(format, '%');
+		if (percent == nullptr)
+		{
+			out.append(format);
+			return;
+		}
+		out.append(format, static_cast<size_t>(percent - format));
+		format = percent + 1;
+		if (*format == '%')
+		{
+			out.append('%');
+			++format;
+			continue;
+		}
+
+		char spec[48] = "%";
+		size_t length = 1;
+		auto add = [&](char ch) {
+			if (length + 4 < sizeof(spec))
+			{
+				spec[length++] = ch;
+			}
+		};
+		auto add_number = [&]() {
+			if (*format == '*')
+			{
+				++format;
+				char digits[16];
+				const int count = internal::read_log_value(pos, end, value)
+					? ::std::snprintf(digits, sizeof(digits), "%d", static_cast<int>(internal::log_signed(value))) : 0;
+				for (int i = 0; i < count; ++i)
+					add(digits[i]);
+			}
+			while (*format >= '0' && *format <= '9')
+				add(*format++);
+		};
+		while (*format != 0 && ::std::strchr("-+ #0", *format) != nullptr)
+			add(*format++);
+		add_number();
+		if (*format == '.')
+		{
+			add(*format++);
+			add_number();
+		}
+		while (*format != 0 && ::std::strchr("hljztLIq0123456789", *format) != nullptr)
+			++format;
+		const char conversion = *format;
+		if (conversion == 0)
+		{
+			return;
+		}
+		++format;
+		if (!internal::read_log_value(pos, end, value))
+		{
+			out.append("<?>", 3);
+			continue;
+		}
+		switch (conversion)
+		{
+		case 'd':
+		case 'i':
+			add('l'), add('l'), add(conversion), spec[length] = 0;
+			out.append_printf(spec, static_cast<long long>(internal::log_signed(value)));
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			add('l'), add('l'), add(conversion), spec[length] = 0;
+			out.append_printf(spec, static_cast<unsigned long long>(internal::log_unsigned(value)));
+			break;
+		case 'c':
+			add('c'), spec[length] = 0;
+			out.append_printf(spec, static_cast<int>(internal::log_signed(value)));
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			add(conversion), spec[length] = 0;
+			out.append_printf(spec, internal::log_double(value));
+			break;
+		case 's':
+			add('s'), spec[length] = 0;
+			out.append_printf(spec, (value.type == log_arg::string) ? value.s : "<?>");
+			break;
+		case 'p':
+			add('p'), spec[length] = 0;
+			out.append_printf(spec, reinterpret_cast<void*>(static_cast<uintptr_t>(value.u)));
+			break;
+		case 'n':
+			break;
+		default:
+			out.append(percent, static_cast<size_t>(format - percent));
+			break;
+		}
+	}
+}
+
+// Appends the text of one record payload and its line break.
+template <class Builder>
+inline void append_log_record(Builder& out, uint32_t id, const char* payload, size_t size)
+{
+	if (id == log_text_record)
+	{
+		out.append(payload, size);
+	}
+	else if (const char* format = log_site_registry::instance().format(id))
+	{
+		format_log_record(out, format, payload, size);
+		out.append('\n');
+	}
+	else
+	{
+		out.append_printf("[unknown log format %u]\n", static_cast<unsigned>(id));
+	}
+}
+
+// Converts a file written with log_encoding::binary to text.
+inline bool decode_binary_log(::std::FILE* in, ::std::FILE* out)
+{
+	::std::vector<::std::string> formats;
+	::std::vector<char> payload;
+	::stl::string_builder line;
+	char magic[sizeof(log_file_magic)];
+	if (::std::fread(magic, 1, sizeof(magic), in) != sizeof(magic) || ::std::memcmp(magic, log_file_magic, sizeof(magic)) != 0)
+	{
+		return false;
+	}
+	for (;;)
+	{
+		uint32_t header[2];
+		const size_t read = ::std::fread(header, 1, sizeof(header), in);
+		if (read == 0)
+		{
+			return true;
+		}
+		if (read != sizeof(header))
+		{
+			return false;
+		}
+		// A logger restarted on the same file writes the magic again.
+		if (::std::memcmp(header, log_file_magic, sizeof(log_file_magic)) == 0)
+		{
+			continue;
+		}
+		if (header[0] < log_record_header)
+		{
+			return false;
+		}
+		payload.resize(header[0] - log_record_header + 1);
+		if (::std::fread(payload.data(), 1, payload.size() - 1, in) != payload.size() - 1)
+		{
+			return false;
+		}
+		payload.back() = 0;
+		line.reset();
+		if (header[1] == log_site_record)
+		{
+			uint32_t id = 0;
+			if (payload.size() > sizeof(id))
+			{
+				::std::memcpy(&id, payload.data(), sizeof(id));
+				if (formats.size() <= id)
+					formats.resize(id + 1);
+				formats[id].assign(payload.data() + sizeof(id));
+			}
+			continue;
+		}
+		if (header[1] == log_text_record)
+			line.append(payload.data(), payload.size() - 1);
+		else if (header[1] < formats.size() && !formats[header[1]].empty())
+			format_log_record(line, formats[header[1]].c_str(), payload.data(), payload.size() - 1), line.append('\n');
+		else
+			line.append_printf("[unknown log format %u]\n", static_cast<unsigned>(header[1]));
+		if (!line.write_to(out))
+		{
+			return false;
+		}
+	}
+}
+
+} // namespace util
+
+#define BINARY_LOG_DECODER_MAIN() \
+	int main(int argc, char** argv) \
+	{ \
+		if (argc < 2) \
+		{ \
+			::std::fprintf(stderr, "usage: %s <binary log> [text log]\n", argv[0]); \
+			return 2; \
+		} \
+		::std::FILE* in = ::std::fopen(argv[1], "rb"); \
+		::std::FILE* out = (argc > 2) ? ::std::fopen(argv[2], "w") : stdout; \
+		if (in == nullptr || out == nullptr) \
+		{ \
+			::std::fprintf(stderr, "can not open %s\n", (in == nullptr) ? argv[1] : argv[2]); \
+			return 2; \
+		} \
+		const bool ok = ::util::decode_binary_log(in, out); \
+		::std::fclose(in); \
+		if (out != stdout) \
+			::std::fclose(out); \
+		return ok ? 0 : 1; \
+	}
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <new>
+#include <atomic>
+#include <cstddef>
+#include <common/mem.h>
+#include <common/free_list.h>
+
+namespace mem {
+
+// Lock-free allocator for blocks of up to BlockSize bytes. Every thread keeps
+// a small cache of free blocks. Frees go to the cache of the freeing thread,
+// so blocks may be freed from any thread. Full caches hand over BatchSize
+// blocks at once to a shared lock-free stack of batches, and empty caches
+// take a whole batch back, which keeps the shared stack off the fast path.
+// There is one allocator per template instantiation, reachable through
+// instance() or block_alloc() / block_free(). Its memory is never returned,
+// which keeps it valid for threads that exit after static destruction.
+
+template <size_t BlockSize, size_t BatchSize = 64, size_t BatchesPerChunk = 16>
+class block_allocator
+{
+	static_assert(BatchSize > 0 && BatchesPerChunk > 0, "Batch and chunk sizes must not be zero.");
+
+	// A batch is a chain of blocks. The first pointer of its head block links
+	// batches in the shared stack, the second pointer links the blocks of a batch.
+	static constexpr size_t block_align = alignof(::std::max_align_t);
+	static constexpr size_t block_size = ((BlockSize > 2 * sizeof(void*) ? BlockSize : 2 * sizeof(void*)) + block_align - 1) / block_align * block_align;
+	static constexpr size_t chunk_blocks = BatchSize * BatchesPerChunk;
+	static constexpr size_t cache_capacity = 2 * BatchSize;
+
+	static void*& batch_link(void* block) noexcept
+	{
+		return static_cast<void**>(block)[1];
+	}
+
+	class cache
+	{
+	public:
+		cache() = default;
+		cache(const cache&) = delete;
+		cache& operator=(const cache&) = delete;
+
+		~cache()
+		{
+			block_allocator& allocator = instance();
+			while (m_count >= BatchSize)
+			{
+				allocator.push_batch(&m_blocks[m_count - BatchSize]);
+				m_count -= BatchSize;
+			}
+			if (m_count != 0)
+			{
+				allocator.push_batch(&m_blocks[0], m_count);
+				m_count = 0;
+			}
+		}
+
+		void* pop()
+		{
+			if (m_count == 0)
+			{
+				m_count = instance().pop_batch(m_blocks);
+			}
+			return m_blocks[--m_count];
+		}
+
+		void push(void* block)
+		{
+			if (m_count == cache_capacity)
+			{
+				m_count -= BatchSize;
+				instance().push_batch(&m_blocks[m_count]);
+			}
+			m_blocks[m_count++] = block;
+		}
+
+	private:
+		size_t m_count = 0;
+		void* m_blocks[cache_capacity];
+	};
+
+	static cache& local_cache()
+	{
+		static thread_local cache s_cache;
+		return s_cache;
+	}
+
+	block_allocator() = default;
+
+public:
+	static constexpr size_t max_size = BlockSize;
+
+	block_allocator(const block_allocator&) = delete;
+	block_allocator& operator=(const block_allocator&) = delete;
+
+	static block_allocator& instance()
+	{
+		static block_allocator* s_instance = new block_allocator();
+		return *s_instance;
+	}
+
+	void* allocate()
+	{
+		return local_cache().pop();
+	}
+
+	void deallocate(void* block)
+	{
+		local_cache().push(block);
+	}
+
+	size_t chunk_count() const noexcept
+	{
+		return m_chunkCount.load(::std::memory_order_relaxed);
+	}
+
+private:
+	void push_batch(void** blocks, size_t count = BatchSize) noexcept
+	{
+		for (size_t i = 1; i < count; ++i)
+		{
+			batch_link(blocks[i - 1]) = blocks[i];
+		}
+		batch_link(blocks[count - 1]) = nullptr;
+		m_batches.push(blocks[0]);
+	}
+
+	// Fills blocks with one batch and returns the number of blocks.
+	size_t pop_batch(void** blocks)
+	{
+		void* block = m_batches.pop();
+		if (block == nullptr)
+		{
+			return allocate_chunk(blocks);
+		}
+		size_t count = 0;
+		for (; block != nullptr; block = batch_link(block))
+		{
+			blocks[count++] = block;
+		}
+		return count;
+	}
+
+	size_t allocate_chunk(void** blocks)
+	{
+		char* chunk = static_cast<char*>(internal::alloc(chunk_blocks, block_size));
+		m_chunkCount.fetch_add(1, ::std::memory_order_relaxed);
+		for (size_t batch = 1; batch < BatchesPerChunk; ++batch)
+		{
+			for (size_t i = 0; i < BatchSize; ++i)
+			{
+				blocks[i] = chunk + (batch * BatchSize + i) * block_size;
+			}
+			push_batch(blocks);
+		}
+		for (size_t i = 0; i < BatchSize; ++i)
+		{
+			blocks[i] = chunk + i * block_size;
+		}
+		return BatchSize;
+	}
+
+	atomic_free_list m_batches;
+	::std::atomic<size_t> m_chunkCount{ 0 };
+};
+
+template <size_t BlockSize>
+inline bool is_block_allocation(size_t count, size_t size) noexcept
+{
+	return (count != 0) && (size <= BlockSize) && (count <= BlockSize / (size != 0 ? size : 1));
+}
+
+template <size_t BlockSize>
+inline void* __cdecl block_alloc(size_t count, size_t size)
+{
+	if (is_block_allocation<BlockSize>(count, size))
+	{
+		return block_allocator<BlockSize>::instance().allocate();
+	}
+	return internal::alloc(count, size);
+}
+
+template <size_t BlockSize>
+inline void __cdecl block_free(void* ptr, size_t count, size_t size)
+{
+	if (is_block_allocation<BlockSize>(count, size))
+	{
+		return block_allocator<BlockSize>::instance().deallocate(ptr);
+	}
+	return internal::free(ptr, count, size);
+}
+
+template <size_t BlockSize>
+class block_allocator_functions
+{
+public:
+	bool operator==(const block_allocator_functions&) const noexcept {
+		return true;
+	}
+	bool operator!=(const block_allocator_functions&) const noexcept {
+		return false;
+	}
+	alloc_func_not_null alloc() const noexcept {
+		return block_alloc<BlockSize>;
+	}
+	free_func_not_null free()  const noexcept {
+		return block_free<BlockSize>;
+	}
+	realloc_func realloc() const noexcept {
+		return nullptr;
+	}
+};
+
+} // namespace mem
+
+
+#ifdef BLOCK_ALLOCATOR_BENCHMARK
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+
+// Contention benchmark comparing block_alloc with internal::alloc.
+// Every thread allocates a set of blocks and frees the set of its neighbour,
+// so most blocks travel between threads like in a producer/consumer pipeline.
+
+template <alloc_func Alloc, free_func Free>
+inline double BlockAllocatorBenchmarkRun(size_t threadCount, size_t rounds, size_t blocksPerRound)
+{
+	::std::vector<::std::vector<void*>> sets(threadCount, ::std::vector<void*>(blocksPerRound));
+	::std::atomic<size_t> arrived(0);
+	auto barrier = [&](size_t generation) {
+		arrived.fetch_add(1);
+		while (arrived.load() < generation * threadCount)
+			::std::this_thread::yield();
+	};
+	auto worker = [&](size_t index) {
+		size_t generation = 0;
+		for (size_t round = 0; round < rounds; ++round)
+		{
+			for (void*& ptr : sets[index])
+				ptr = Alloc(1, 48);
+			barrier(++generation);
+			for (void* ptr : sets[(index + 1) % threadCount])
+				Free(ptr, 1, 48);
+			barrier(++generation);
+		}
+	};
+	const auto start = ::std::chrono::steady_clock::now();
+	::std::vector<::std::thread> threads;
+	for (size_t i = 0; i < threadCount; ++i)
+		threads.emplace_back(worker, i);
+	for (::std::thread& thread : threads)
+		thread.join();
+	const ::std::chrono::duration<double, ::std::nano> elapsed = ::std::chrono::steady_clock::now() - start;
+	return elapsed.count() / static_cast<double>(threadCount * rounds * blocksPerRound);
+}
+
+inline void BlockAllocatorBenchmark()
+{
+	::std::printf("%8s %18s %18s\n", "threads", "internal [ns/op]", "block [ns/op]");
+	for (size_t threads = 1; threads <= 64; threads *= 2)
+	{
+		const double regular = BlockAllocatorBenchmarkRun<::mem::internal::alloc, ::mem::internal::free>(threads, 200, 1000);
+		const double block = BlockAllocatorBenchmarkRun<::mem::block_alloc<64>, ::mem::block_free<64>>(threads, 200, 1000);
+		::std::printf("%8zu %18.2f %18.2f\n", threads, regular, block);
+	}
+}
+#endif
@@ -0,0 +1,1552 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+#include <type_traits>
+
+// Allocation free, locale independent conversion between numbers and text
+// with the interface of <charconv>.
+//
+// Integers are written two digits at a time. Floating point values are
+// written with a digit sequence that reads back to the same value (Grisu2,
+// Loitsch 2010). It is the shortest one for all but about 0.1% of doubles and
+// 0.2% of floats. Values use fixed notation for decimal exponents in
+// [-4, digits10] and scientific notation otherwise, like "%g" but without
+// losing precision. With a chars_format and precision the exact decimal
+// expansion of the value is rounded like printf does, using a small big
+// integer for the digits, 9 at a time. Parsing is exact for up to 19
+// significant digits and decimal exponents the type represents exactly
+// (Clinger's fast path) and falls back to strtod otherwise. strtod gets a
+// copy on the stack written as digits and exponent without a decimal point,
+// so the LC_NUMERIC locale does not matter.
+
+namespace stl {
+
+struct to_chars_result
+{
+	char* ptr;
+	::std::errc ec;
+};
+
+struct from_chars_result
+{
+	const char* ptr;
+	::std::errc ec;
+};
+
+enum class chars_format
+{
+	scientific = 1,
+	fixed = 2,
+	general = fixed | scientific
+};
+
+namespace internal {
+
+constexpr char digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+inline unsigned int count_digits(uint64_t value) noexcept
+{
+	unsigned int digits = 1;
+	for (;;)
+	{
+		if (value < 10) return digits;
+		if (value < 100) return digits + 1;
+		if (value < 1000) return digits + 2;
+		if (value < 10000) return digits + 3;
+		value /= 10000;
+		digits += 4;
+	}
+}
+
+// Writes the decimal digits two at a time and returns the end.
+inline char* write_decimal(char* out, uint64_t value) noexcept
+{
+	char* const end = out + count_digits(value);
+	char* pos = end;
+	while (value >= 100)
+	{
+		const size_t pair = static_cast<size_t>(value % 100) * 2;
+		value /= 100;
+		pos -= 2;
+		::std::memcpy(pos, digit_pairs + pair, 2);
+	}
+	if (value >= 10)
+	{
+		::std::memcpy(pos - 2, digit_pairs + value * 2, 2);
+	}
+	else
+	{
+		pos[-1] = static_cast<char>('0' + value);
+	}
+	return end;
+}
+
+inline char* write_based(char* out, uint64_t value, unsigned int base) noexcept
+{
+	char digits[64];
+	char* pos = digits + sizeof(digits);
+	do {
+		*--pos = "0123456789abcdefghijklmnopqrstuvwxyz"[value % base];
+		value /= base;
+	} while (value != 0);
+	const size_t length = static_cast<size_t>(digits + sizeof(digits) - pos);
+	::std::memcpy(out, pos, length);
+	return out + length;
+}
+
+inline unsigned int digit_value(char ch) noexcept
+{
+	if (ch >= '0' && ch <= '9') return static_cast<unsigned int>(ch - '0');
+	if (ch >= 'a' && ch <= 'z') return static_cast<unsigned int>(ch - 'a' + 10);
+	if (ch >= 'A' && ch <= 'Z') return static_cast<unsigned int>(ch - 'A' + 10);
+	return 36;
+}
+
+namespace grisu {
+
+struct diy_fp
+{
+	uint64_t f;
+	int e;
+};
+
+inline diy_fp sub(const diy_fp& x, const diy_fp& y) noexcept
+{
+	return { x.f - y.f, x.e };
+}
+
+// Upper 64 bits of the 128 bit product, rounded.
+inline diy_fp mul(const diy_fp& x, const diy_fp& y) noexcept
+{
+	const uint64_t xLo = x.f & 0xFFFFFFFFu;
+	const uint64_t xHi = x.f >> 32;
+	const uint64_t yLo = y.f & 0xFFFFFFFFu;
+	const uint64_t yHi = y.f >> 32;
+	const uint64_t p0 = xLo * yLo;
+	const uint64_t p1 = xLo * yHi;
+	const uint64_t p2 = xHi * yLo;
+	const uint64_t p3 = xHi * yHi;
+	uint64_t q = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu);
+	q += uint64_t(1) << 31;
+	return { p3 + (p1 >> 32) + (p2 >> 32) + (q >> 32), x.e + y.e + 64 };
+}
+
+inline diy_fp normalize(diy_fp x) noexcept
+{
+	while ((x.f >> 63) == 0)
+	{
+		x.f <<= 1;
+		--x.e;
+	}
+	return x;
+}
+
+inline diy_fp normalize_to(const diy_fp& x, int e) noexcept
+{
+	return { x.f << (x.e - e), e };
+}
+
+struct boundaries
+{
+	diy_fp w;
+	diy_fp minus;
+	diy_fp plus;
+};
+
+// Value and the boundaries of its rounding interval, normalized.
+template <class Float>
+inline boundaries compute_boundaries(Float value) noexcept
+{
+	using bits_type = typename ::std::conditional<sizeof(Float) == 8, uint64_t, uint32_t>::type;
+	constexpr int precision = ::std::numeric_limits<Float>::digits;
+	constexpr int bias = ::std::numeric_limits<Float>::max_exponent - 1 + (precision - 1);
+	constexpr uint64_t hiddenBit = uint64_t(1) << (precision - 1);
+
+	bits_type bits;
+	::std::memcpy(&bits, &value, sizeof(bits));
+	const uint64_t exponent = static_cast<uint64_t>(bits) >> (precision - 1);
+	const uint64_t fraction = static_cast<uint64_t>(bits) & (hiddenBit - 1);
+
+	const diy_fp v = (exponent == 0)
+		? diy_fp{ fraction, 1 - bias }
+		: diy_fp{ fraction + hiddenBit, static_cast<int>(exponent) - bias };
+	const bool lowerIsCloser = (fraction == 0 && exponent > 1);
+	const diy_fp plus = { 2 * v.f + 1, v.e - 1 };
+	const diy_fp minus = lowerIsCloser ? diy_fp{ 4 * v.f - 1, v.e - 2 } : diy_fp{ 2 * v.f - 1, v.e - 1 };
+	const diy_fp normalizedPlus = normalize(plus);
+	return { normalize(v), normalize_to(minus, normalizedPlus.e), normalizedPlus };
+}
+
+constexpr int alpha = -60;
+constexpr int gamma = -32;
+
+struct cached_power
+{
+	uint64_t f;
+	int e;
+	int k;
+};
+
+// 10^k for k = -300, -292, ..., 324 as normalized 64 bit fractions.
+inline cached_power get_cached_power(int e) noexcept
+{
+	static constexpr cached_power s_powers[] = {
+		{ 0xAB70FE17C79AC6CA, -1060, -300 },
+		{ 0xFF77B1FCBEBCDC4F, -1034, -292 },
+		{ 0xBE5691EF416BD60C, -1007, -284 },
+		{ 0x8DD01FAD907FFC3C,  -980, -276 },
+		{ 0xD3515C2831559A83,  -954, -268 },
+		{ 0x9D71AC8FADA6C9B5,  -927, -260 },
+		{ 0xEA9C227723EE8BCB,  -901, -252 },
+		{ 0xAECC49914078536D,  -874, -244 },
+		{ 0x823C12795DB6CE57,  -847, -236 },
+		{ 0xC21094364DFB5637,  -821, -228 },
+		{ 0x9096EA6F3848984F,  -794, -220 },
+		{ 0xD77485CB25823AC7,  -768, -212 },
+		{ 0xA086CFCD97BF97F4,  -741, -204 },
+		{ 0xEF340A98172AACE5,  -715, -196 },
+		{ 0xB23867FB2A35B28E,  -688, -188 },
+		{ 0x84C8D4DFD2C63F3B,  -661, -180 },
+		{ 0xC5DD44271AD3CDBA,  -635, -172 },
+		{ 0x936B9FCEBB25C996,  -608, -164 },
+		{ 0xDBAC6C247D62A584,  -582, -156 },
+		{ 0xA3AB66580D5FDAF6,  -555, -148 },
+		{ 0xF3E2F893DEC3F126,  -529, -140 },
+		{ 0xB5B5ADA8AAFF80B8,  -502, -132 },
+		{ 0x87625F056C7C4A8B,  -475, -124 },
+		{ 0xC9BCFF6034C13053,  -449, -116 },
+		{ 0x964E858C91BA2655,  -422, -108 },
+		{ 0xDFF9772470297EBD,  -396, -100 },
+		{ 0xA6DFBD9FB8E5B88F,  -369,  -92 },
+		{ 0xF8A95FCF88747D94,  -343,  -84 },
+		{ 0xB94470938FA89BCF,  -316,  -76 },
+		{ 0x8A08F0F8BF0F156B,  -289,  -68 },
+		{ 0xCDB02555653131B6,  -263,  -60 },
+		{ 0x993FE2C6D07B7FAC,  -236,  -52 },
+		{ 0xE45C10C42A2B3B06,  -210,  -44 },
+		{ 0xAA242499697392D3,  -183,  -36 },
+		{ 0xFD87B5F28300CA0E,  -157,  -28 },
+		{ 0xBCE5086492111AEB,  -130,  -20 },
+		{ 0x8CBCCC096F5088CC,  -103,  -12 },
+		{ 0xD1B71758E219652C,   -77,   -4 },
+		{ 0x9C40000000000000,   -50,    4 },
+		{ 0xE8D4A51000000000,   -24,   12 },
+		{ 0xAD78EBC5AC620000,     3,   20 },
+		{ 0x813F3978F8940984,    30,   28 },
+		{ 0xC097CE7BC90715B3,    56,   36 },
+		{ 0x8F7E32CE7BEA5C70,    83,   44 },
+		{ 0xD5D238A4ABE98068,   109,   52 },
+		{ 0x9F4F2726179A2245,   136,   60 },
+		{ 0xED63A231D4C4FB27,   162,   68 },
+		{ 0xB0DE65388CC8ADA8,   189,   76 },
+		{ 0x83C7088E1AAB65DB,   216,   84 },
+		{ 0xC45D1DF942711D9A,   242,   92 },
+		{ 0x924D692CA61BE758,   269,  100 },
+		{ 0xDA01EE641A708DEA,   295,  108 },
+		{ 0xA26DA3999AEF774A,   322,  116 },
+		{ 0xF209787BB47D6B85,   348,  124 },
+		{ 0xB454E4A179DD1877,   375,  132 },
+		{ 0x865B86925B9BC5C2,   402,  140 },
+		{ 0xC83553C5C8965D3D,   428,  148 },
+		{ 0x952AB45CFA97A0B3,   455,  156 },
+		{ 0xDE469FBD99A05FE3,   481,  164 },
+		{ 0xA59BC234DB398C25,   508,  172 },
+		{ 0xF6C69A72A3989F5C,   534,  180 },
+		{ 0xB7DCBF5354E9BECE,   561,  188 },
+		{ 0x88FCF317F22241E2,   588,  196 },
+		{ 0xCC20CE9BD35C78A5,   614,  204 },
+		{ 0x98165AF37B2153DF,   641,  212 },
+		{ 0xE2A0B5DC971F303A,   667,  220 },
+		{ 0xA8D9D1535CE3B396,   694,  228 },
+		{ 0xFB9B7CD9A4A7443C,   720,  236 },
+		{ 0xBB764C4CA7A44410,   747,  244 },
+		{ 0x8BAB8EEFB6409C1A,   774,  252 },
+		{ 0xD01FEF10A657842C,   800,  260 },
+		{ 0x9B10A4E5E9913129,   827,  268 },
+		{ 0xE7109BFBA19C0C9D,   853,  276 },
+		{ 0xAC2820D9623BF429,   880,  284 },
+		{ 0x80444B5E7AA7CF85,   907,  292 },
+		{ 0xBF21E44003ACDD2D,   933,  300 },
+		{ 0x8E679C2F5E44FF8F,   960,  308 },
+		{ 0xD433179D9C8CB841,   986,  316 },
+		{ 0x9E19DB92B4E31BA9,  1013,  324 },
+	};
+	const int f = alpha - e - 1;
+	const int k = (f * 78913) / (1 << 18) + (f > 0);
+	const int index = (300 + k + 7) / 8;
+	return s_powers[index];
+}
+
+// Returns the number of decimal digits of n and the power of ten of the first digit.
+inline int find_largest_pow10(uint32_t n, uint32_t& pow10) noexcept
+{
+	static constexpr uint32_t s_pow10[] = {
+		1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+	};
+	int digits = 10;
+	while (digits > 1 && n < s_pow10[digits - 1])
+	{
+		--digits;
+	}
+	pow10 = s_pow10[digits - 1];
+	return digits;
+}
+
+inline void round_weed(char* buf, int length, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t tenK) noexcept
+{
+	while (rest < dist && delta - rest >= tenK && (rest + tenK < dist || dist - rest > rest + tenK - dist))
+	{
+		--buf[length - 1];
+		rest += tenK;
+	}
+}
+
+inline void generate_digits(char* buf, int& length, int& exponent, diy_fp minus, diy_fp w, diy_fp plus) noexcept
+{
+	diy_fp delta = sub(plus, minus);
+	diy_fp dist = sub(plus, w);
+	const diy_fp one = { uint64_t(1) << -plus.e, plus.e };
+
+	uint32_t p1 = static_cast<uint32_t>(plus.f >> -one.e);
+	uint64_t p2 = plus.f & (one.f - 1);
+
+	uint32_t pow10 = 0;
+	int n = find_largest_pow10(p1, pow10);
+	while (n > 0)
+	{
+		const uint32_t digit = p1 / pow10;
+		p1 %= pow10;
+		buf[length++] = static_cast<char>('0' + digit);
+		--n;
+		const uint64_t rest = (static_cast<uint64_t>(p1) << -one.e) + p2;
+		if (rest <= delta.f)
+		{
+			exponent += n;
+			round_weed(buf, length, dist.f, delta.f, rest, static_cast<uint64_t>(pow10) << -one.e);
+			return;
+		}
+		pow10 /= 10;
+	}
+
+	int m = 0;
+	for (;;)
+	{
+		p2 *= 10;
+		buf[length++] = static_cast<char>('0' + (p2 >> -one.e));
+		p2 &= one.f - 1;
+		++m;
+		delta.f *= 10;
+		dist.f *= 10;
+		if (p2 <= delta.f)
+		{
+			break;
+		}
+	}
+	exponent -= m;
+	round_weed(buf, length, dist.f, delta.f, p2, one.f);
+}
+
+// Shortest digits of a positive finite value: value = digits * 10^exponent.
+template <class Float>
+inline void grisu2(char* buf, int& length, int& exponent, Float value) noexcept
+{
+	const boundaries b = compute_boundaries(value);
+	const cached_power cached = get_cached_power(b.plus.e);
+	const diy_fp c = { cached.f, cached.e };
+	const diy_fp w = mul(b.w, c);
+	const diy_fp minus = mul(b.minus, c);
+	const diy_fp plus = mul(b.plus, c);
+	length = 0;
+	exponent = -cached.k;
+	generate_digits(buf, length, exponent, { minus.f + 1, minus.e }, w, { plus.f - 1, plus.e });
+}
+
+// Places the decimal point or appends an exponent. buf needs room for
+// max(length, digits10 + 1) + 7 characters.
+inline char* format_digits(char* buf, int length, int exponent, int maxExponent) noexcept
+{
+	const int point = length + exponent;
+	if (length <= point && point <= maxExponent)
+	{
+		::std::memset(buf + length, '0', static_cast<size_t>(point - length));
+		return buf + point;
+	}
+	if (0 < point && point <= maxExponent)
+	{
+		::std::memmove(buf + point + 1, buf + point, static_cast<size_t>(length - point));
+		buf[point] = '.';
+		return buf + length + 1;
+	}
+	if (-4 < point && point <= 0)
+	{
+		::std::memmove(buf + 2 - point, buf, static_cast<size_t>(length));
+		buf[0] = '0';
+		buf[1] = '.';
+		::std::memset(buf + 2, '0', static_cast<size_t>(-point));
+		return buf + 2 - point + length;
+	}
+	if (length > 1)
+	{
+		::std::memmove(buf + 2, buf + 1, static_cast<size_t>(length - 1));
+		buf[1] = '.';
+		buf += length + 1;
+	}
+	else
+	{
+		buf += 1;
+	}
+	*buf++ = 'e';
+	int e = point - 1;
+	*buf++ = (e < 0) ? '-' : '+';
+	e = (e < 0) ? -e : e;
+	if (e < 10)
+	{
+		*buf++ = '0';
+	}
+	return write_decimal(buf, static_cast<uint64_t>(e));
+}
+
+} // namespace grisu
+
+template <class Float>
+struct float_traits;
+
+template <>
+struct float_traits<double>
+{
+	static constexpr int max_exact_pow10 = 22;
+	static constexpr uint64_t max_mantissa = uint64_t(1) << 53;
+
+	static double parse(const char* str, char** end) { return ::std::strtod(str, end); }
+};
+
+template <>
+struct float_traits<float>
+{
+	static constexpr int max_exact_pow10 = 10;
+	static constexpr uint64_t max_mantissa = uint64_t(1) << 24;
+
+	static float parse(const char* str, char** end) { return ::std::strtof(str, end); }
+};
+
+template <class Float>
+inline Float exact_pow10(int exponent) noexcept
+{
+	static constexpr double s_pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	return static_cast<Float>(s_pow10[exponent]);
+}
+
+// Halfway points between adjacent doubles have at most 767 significant
+// digits, later digits only matter as a nonzero tail.
+constexpr size_t max_parse_digits = 768;
+
+// Rewrites a number validated by from_chars as [-]digits e[-]exponent into
+// buf, keeping max_parse_digits digits and a 1 for a nonzero tail.
+inline void canonical_number(const char* first, const char* last, char* buf) noexcept
+{
+	char* out = buf;
+	const char* pos = first;
+	if (*pos == '-')
+	{
+		*out++ = *pos++;
+	}
+	int64_t exponent = 0;
+	size_t digits = 0;
+	bool point = false;
+	bool tail = false;
+	for (; pos != last; ++pos)
+	{
+		const char ch = *pos;
+		if (ch == '.')
+		{
+			point = true;
+			continue;
+		}
+		if (ch < '0' || ch > '9')
+		{
+			break;
+		}
+		if (digits == 0 && ch == '0')
+		{
+			exponent -= point;
+		}
+		else if (digits < max_parse_digits)
+		{
+			*out++ = ch;
+			++digits;
+			exponent -= point;
+		}
+		else
+		{
+			tail |= (ch != '0');
+			exponent += !point;
+		}
+	}
+	if (tail)
+	{
+		*out++ = '1';
+		--exponent;
+	}
+	if (digits == 0)
+	{
+		*out++ = '0';
+	}
+	if (pos != last && (*pos == 'e' || *pos == 'E'))
+	{
+		++pos;
+		const bool negative = (pos != last && *pos == '-');
+		if (pos != last && (*pos == '-' || *pos == '+'))
+		{
+			++pos;
+		}
+		int64_t e = 0;
+		for (; pos != last && *pos >= '0' && *pos <= '9'; ++pos)
+		{
+			e = (e < 100000) ? e * 10 + (*pos - '0') : e;
+		}
+		exponent += negative ? -e : e;
+	}
+	*out++ = 'e';
+	if (exponent < 0)
+	{
+		*out++ = '-';
+		exponent = -exponent;
+	}
+	*write_decimal(out, static_cast<uint64_t>(exponent)) = 0;
+}
+
+inline bool match_word(const char*& pos, const char* last, const char* word) noexcept
+{
+	const char* p = pos;
+	for (; *word != 0; ++word, ++p)
+	{
+		if (p == last || (*p | 0x20) != *word)
+		{
+			return false;
+		}
+	}
+	pos = p;
+	return true;
+}
+
+// Exact decimal expansion of doubles for the precision overload of to_chars.
+// The integer part of a double has at most 309 digits and the fraction at
+// most 1074, produced 9 at a time.
+constexpr int max_integer_digits = 309;
+constexpr int max_fraction_digits = 1080;
+
+// Unsigned integer of 32 bit limbs, least significant first. Limbs past size
+// are zero.
+struct big_integer
+{
+	uint32_t limbs[36];
+	size_t size;
+};
+
+inline void trim(big_integer& x) noexcept
+{
+	while (x.size != 0 && x.limbs[x.size - 1] == 0)
+	{
+		--x.size;
+	}
+}
+
+inline void assign_shifted(big_integer& x, uint64_t value, unsigned int shift) noexcept
+{
+	::std::memset(x.limbs, 0, sizeof(x.limbs));
+	const size_t word = shift / 32;
+	const unsigned int bits = shift % 32;
+	const uint64_t low = value << bits;
+	const uint64_t high = (bits != 0) ? value >> (64 - bits) : 0;
+	x.limbs[word] = static_cast<uint32_t>(low);
+	x.limbs[word + 1] = static_cast<uint32_t>(low >> 32);
+	x.limbs[word + 2] = static_cast<uint32_t>(high);
+	x.size = word + 3;
+	trim(x);
+}
+
+// Divides by 1e9 and returns the remainder.
+inline uint32_t divide_1e9(big_integer& x) noexcept
+{
+	uint64_t remainder = 0;
+	for (size_t i = x.size; i-- != 0;)
+	{
+		const uint64_t current = (remainder << 32) | x.limbs[i];
+		x.limbs[i] = static_cast<uint32_t>(current / 1000000000);
+		remainder = current % 1000000000;
+	}
+	trim(x);
+	return static_cast<uint32_t>(remainder);
+}
+
+// Multiplies a fraction of bits binary digits by 1e9 and removes and returns
+// the integer part, the next 9 decimal digits.
+inline uint32_t next_fraction_digits(big_integer& x, unsigned int bits) noexcept
+{
+	uint64_t carry = 0;
+	for (size_t i = 0; i < x.size; ++i)
+	{
+		const uint64_t product = uint64_t(x.limbs[i]) * 1000000000 + carry;
+		x.limbs[i] = static_cast<uint32_t>(product);
+		carry = product >> 32;
+	}
+	if (carry != 0)
+	{
+		x.limbs[x.size++] = static_cast<uint32_t>(carry);
+	}
+	const size_t word = bits / 32;
+	const unsigned int shift = bits % 32;
+	if (x.size <= word)
+	{
+		return 0;
+	}
+	const uint64_t digits = ((uint64_t(x.limbs[word + 1]) << 32) | x.limbs[word]) >> shift;
+	x.limbs[word] &= (uint32_t(1) << shift) - 1;
+	for (size_t i = word + 1; i < x.size; ++i)
+	{
+		x.limbs[i] = 0;
+	}
+	x.size = word + 1;
+	trim(x);
+	return static_cast<uint32_t>(digits);
+}
+
+inline char* write_9_digits(char* out, uint32_t value) noexcept
+{
+	for (int i = 8; i >= 0; --i)
+	{
+		out[i] = static_cast<char>('0' + value % 10);
+		value /= 10;
+	}
+	return out + 9;
+}
+
+struct exact_decimal
+{
+	char digits[max_integer_digits + max_fraction_digits + 1];
+	int integer; // digits before the decimal point, none below 1
+	int count;   // digits known, later ones are 0 unless tail is set
+	int first;   // the first nonzero digit, count if there is none
+	bool tail;   // nonzero digits follow the known ones
+
+	char digit(int index) const noexcept
+	{
+		return (index < count) ? digits[index] : '0';
+	}
+};
+
+// Expands a finite value >= 0 until fractionDigits digits after the decimal
+// point or significantDigits digits from the first nonzero one are known.
+inline void expand_decimal(double value, exact_decimal& d, int fractionDigits, int significantDigits) noexcept
+{
+	uint64_t bits;
+	::std::memcpy(&bits, &value, sizeof(bits));
+	const int biased = static_cast<int>(bits >> 52);
+	uint64_t mantissa = bits & ((uint64_t(1) << 52) - 1);
+	int exponent = -1074;
+	if (biased != 0)
+	{
+		mantissa |= uint64_t(1) << 52;
+		exponent = biased - 1075;
+	}
+	char* out = d.digits;
+	big_integer x;
+	unsigned int fractionBits = 0;
+	uint64_t fraction = 0;
+	if (exponent > 11)
+	{
+		assign_shifted(x, mantissa, static_cast<unsigned int>(exponent));
+		uint32_t chunks[36];
+		size_t chunkCount = 0;
+		while (x.size != 0)
+		{
+			chunks[chunkCount++] = divide_1e9(x);
+		}
+		out = write_decimal(out, chunks[--chunkCount]);
+		while (chunkCount != 0)
+		{
+			out = write_9_digits(out, chunks[--chunkCount]);
+		}
+	}
+	else
+	{
+		fractionBits = (exponent < 0) ? static_cast<unsigned int>(-exponent) : 0;
+		const uint64_t integer = (exponent >= 0) ? mantissa << exponent : (fractionBits < 64) ? mantissa >> fractionBits : 0;
+		fraction = (fractionBits == 0) ? 0 : (fractionBits < 64) ? mantissa & ((uint64_t(1) << fractionBits) - 1) : mantissa;
+		if (integer != 0)
+		{
+			out = write_decimal(out, integer);
+		}
+	}
+	d.integer = static_cast<int>(out - d.digits);
+	int first = (d.integer != 0) ? 0 : -1;
+	assign_shifted(x, fraction, 0);
+	while (x.size != 0)
+	{
+		const int count = static_cast<int>(out - d.digits);
+		if (count - d.integer >= fractionDigits || (first >= 0 && count - first >= significantDigits))
+		{
+			break;
+		}
+		out = write_9_digits(out, next_fraction_digits(x, fractionBits));
+		for (int i = count; first < 0 && i < count + 9; ++i)
+		{
+			first = (d.digits[i] != '0') ? i : -1;
+		}
+	}
+	d.count = static_cast<int>(out - d.digits);
+	d.first = (first >= 0) ? first : d.count;
+	d.tail = (x.size != 0);
+}
+
+// Rounds to the digits before keep, to nearest with ties to even, and drops
+// the rest. A carry out of the first digit becomes a new leading 1.
+inline void round_decimal(exact_decimal& d, int keep) noexcept
+{
+	if (keep >= d.count)
+	{
+		return;
+	}
+	const char next = d.digits[keep];
+	bool above = d.tail;
+	for (int i = keep + 1; i < d.count && !above; ++i)
+	{
+		above = (d.digits[i] != '0');
+	}
+	const bool odd = keep > 0 && ((d.digits[keep - 1] - '0') & 1) != 0;
+	d.count = keep;
+	d.tail = false;
+	if (next > '5' || (next == '5' && (above || odd)))
+	{
+		int i = keep - 1;
+		for (; i >= 0 && d.digits[i] == '9'; --i)
+		{
+			d.digits[i] = '0';
+		}
+		if (i >= 0)
+		{
+			++d.digits[i];
+		}
+		else
+		{
+			::std::memmove(d.digits + 1, d.digits, static_cast<size_t>(d.count));
+			d.digits[0] = '1';
+			++d.integer;
+			++d.count;
+		}
+	}
+	d.first = 0;
+	while (d.first < d.count && d.digits[d.first] == '0')
+	{
+		++d.first;
+	}
+}
+
+inline char* write_exponent(char* out, int exponent) noexcept
+{
+	*out++ = 'e';
+	*out++ = (exponent < 0) ? '-' : '+';
+	const unsigned int magnitude = static_cast<unsigned int>((exponent < 0) ? -exponent : exponent);
+	if (magnitude < 10)
+	{
+		*out++ = '0';
+	}
+	return write_decimal(out, magnitude);
+}
+
+// The digits of d from the first nonzero one as d.d...e+XX, with trailing
+// zeros of the fraction removed if trim is set.
+inline to_chars_result write_scientific(char* first, char* last, bool negative, const exact_decimal& d, int precision, bool trim) noexcept
+{
+	const int exponent = (d.first < d.count) ? d.integer - 1 - d.first : 0;
+	if (trim)
+	{
+		while (precision > 0 && d.digit(d.first + precision) == '0')
+		{
+			--precision;
+		}
+	}
+	const size_t exponentLength = (exponent <= -100 || exponent >= 100) ? 5 : 4;
+	const size_t length = (negative ? 1 : 0) + 1 + (precision > 0 ? 1 + static_cast<size_t>(precision) : 0) + exponentLength;
+	if (length > static_cast<size_t>(last - first))
+	{
+		return { last, ::std::errc::value_too_large };
+	}
+	char* out = first;
+	if (negative)
+	{
+		*out++ = '-';
+	}
+	*out++ = d.digit(d.first);
+	if (precision > 0)
+	{
+		*out++ = '.';
+		for (int i = 1; i <= precision; ++i)
+		{
+			*out++ = d.digit(d.first + i);
+		}
+	}
+	return { write_exponent(out, exponent), ::std::errc() };
+}
+
+// The digits of d with precision digits after the decimal point, with
+// trailing zeros of the fraction removed if trim is set.
+inline to_chars_result write_fixed(char* first, char* last, bool negative, const exact_decimal& d, int precision, bool trim) noexcept
+{
+	if (trim)
+	{
+		while (precision > 0 && d.digit(d.integer + precision - 1) == '0')
+		{
+			--precision;
+		}
+	}
+	const size_t integer = (d.integer != 0) ? static_cast<size_t>(d.integer) : 1;
+	const size_t length = (negative ? 1 : 0) + integer + (precision > 0 ? 1 + static_cast<size_t>(precision) : 0);
+	if (length > static_cast<size_t>(last - first))
+	{
+		return { last, ::std::errc::value_too_large };
+	}
+	char* out = first;
+	if (negative)
+	{
+		*out++ = '-';
+	}
+	if (d.integer == 0)
+	{
+		*out++ = '0';
+	}
+	for (int i = 0; i < d.integer; ++i)
+	{
+		*out++ = d.digit(i);
+	}
+	if (precision > 0)
+	{
+		*out++ = '.';
+		for (int i = 0; i < precision; ++i)
+		{
+			*out++ = d.digit(d.integer + i);
+		}
+	}
+	return { out, ::std::errc() };
+}
+
+// Writes inf and nan like the shortest form, returns false for finite values.
+inline bool write_special(to_chars_result& result, char* first, char* last, double value) noexcept
+{
+	if (::std::isfinite(value))
+	{
+		return false;
+	}
+	const bool sign = ::std::isinf(value) && ::std::signbit(value);
+	const size_t length = sign ? 4 : 3;
+	if (length > static_cast<size_t>(last - first))
+	{
+		result = { last, ::std::errc::value_too_large };
+		return true;
+	}
+	::std::memcpy(first, sign ? "-inf" : ::std::isinf(value) ? "inf" : "nan", length);
+	result = { first + length, ::std::errc() };
+	return true;
+}
+
+inline to_chars_result to_chars_precision(char* first, char* last, double value, chars_format format, int precision) noexcept
+{
+	to_chars_result result;
+	if (write_special(result, first, last, value))
+	{
+		return result;
+	}
+	const bool negative = ::std::signbit(value);
+	const double magnitude = ::std::fabs(value);
+	precision = (precision < 0) ? 6 : precision;
+	if (format != chars_format::general && static_cast<size_t>(precision) > static_cast<size_t>(last - first))
+	{
+		return { last, ::std::errc::value_too_large };
+	}
+	// Past these the digits of a double are all 0.
+	const int fraction = ::std::min(precision, max_fraction_digits);
+	const int significant = ::std::min(precision, 800);
+	exact_decimal d;
+	if (format == chars_format::fixed)
+	{
+		expand_decimal(magnitude, d, fraction + 1, ::std::numeric_limits<int>::max());
+		round_decimal(d, d.integer + fraction);
+		return write_fixed(first, last, negative, d, precision, false);
+	}
+	if (format == chars_format::scientific)
+	{
+		expand_decimal(magnitude, d, ::std::numeric_limits<int>::max(), significant + 2);
+		round_decimal(d, d.first + significant + 1);
+		return write_scientific(first, last, negative, d, precision, false);
+	}
+	// Like %g: precision significant digits, scientific for exponents below
+	// -4 or from precision on, without trailing zeros.
+	precision = (significant == 0) ? 1 : significant;
+	expand_decimal(magnitude, d, ::std::numeric_limits<int>::max(), precision + 1);
+	round_decimal(d, d.first + precision);
+	const int exponent = (d.first < d.count) ? d.integer - 1 - d.first : 0;
+	if (exponent >= -4 && exponent < precision)
+	{
+		return write_fixed(first, last, negative, d, precision - 1 - exponent, true);
+	}
+	return write_scientific(first, last, negative, d, precision - 1, true);
+}
+
+} // namespace internal
+
+template <class Integer, class = typename ::std::enable_if<::std::is_integral<Integer>::value && !::std::is_same<Integer, bool>::value>::type>
+inline to_chars_result to_chars(char* first, char* last, Integer value, int base = 10) noexcept
+{
+	using unsigned_type = typename ::std::make_unsigned<Integer>::type;
+	const bool negative = value < 0;
+	const uint64_t magnitude = negative
+		? uint64_t(0) - static_cast<uint64_t>(value)
+		: static_cast<uint64_t>(static_cast<unsigned_type>(value));
+	char buf[66];
+	char* pos = buf;
+	if (negative)
+	{
+		*pos++ = '-';
+	}
+	pos = (base == 10) ? internal::write_decimal(pos, magnitude) : internal::write_based(pos, magnitude, static_cast<unsigned int>(base));
+	const size_t length = static_cast<size_t>(pos - buf);
+	if (length > static_cast<size_t>(last - first))
+	{
+		return { last, ::std::errc::value_too_large };
+	}
+	::std::memcpy(first, buf, length);
+	return { first + length, ::std::errc() };
+}
+
+// Writes the shortest text that reads back to value, see above.
+template <class Float, class = typename ::std::enable_if<::std::is_floating_point<Float>::value>::type, class = void>
+inline to_chars_result to_chars(char* first, char* last, Float value) noexcept
+{
+	static_assert(::std::numeric_limits<Float>::is_iec559 && sizeof(Float) <= 8, "IEEE single or double precision expected");
+	char buf[40];
+	char* pos = buf;
+	if (::std::signbit(value))
+	{
+		*pos++ = '-';
+		value = -value;
+	}
+	if (::std::isnan(value))
+	{
+		pos = buf;
+		::std::memcpy(pos, "nan", 3);
+		pos += 3;
+	}
+	else if (::std::isinf(value))
+	{
+		::std::memcpy(pos, "inf", 3);
+		pos += 3;
+	}
+	else if (value == 0)
+	{
+		*pos++ = '0';
+	}
+	else
+	{
+		int length = 0;
+		int exponent = 0;
+		internal::grisu::grisu2(pos, length, exponent, value);
+		pos = internal::grisu::format_digits(pos, length, exponent, ::std::numeric_limits<Float>::digits10);
+	}
+	const size_t length = static_cast<size_t>(pos - buf);
+	if (length > static_cast<size_t>(last - first))
+	{
+		return { last, ::std::errc::value_too_large };
+	}
+	::std::memcpy(first, buf, length);
+	return { first + length, ::std::errc() };
+}
+
+// Writes value rounded to precision digits after the decimal point for fixed
+// and scientific and to precision significant digits for general, like %f,
+// %e and %g of printf in the "C" locale. Rounding is exact, ties go to the
+// even digit. A negative precision means 6.
+template <class Float, class = typename ::std::enable_if<::std::is_floating_point<Float>::value>::type, class = void>
+inline to_chars_result to_chars(char* first, char* last, Float value, chars_format format, int precision) noexcept
+{
+	static_assert(::std::numeric_limits<Float>::is_iec559 && sizeof(Float) <= 8, "IEEE single or double precision expected");
+	return internal::to_chars_precision(first, last, static_cast<double>(value), format, precision);
+}
+
+// Parses an optional '-' followed by digits of the base. On overflow ptr
+// points past the digits, ec is result_out_of_range and value is unchanged.
+template <class Integer, class = typename ::std::enable_if<::std::is_integral<Integer>::value && !::std::is_same<Integer, bool>::value>::type>
+inline from_chars_result from_chars(const char* first, const char* last, Integer& value, int base = 10) noexcept
+{
+	using unsigned_type = typename ::std::make_unsigned<Integer>::type;
+	const char* pos = first;
+	const bool negative = ::std::is_signed<Integer>::value && pos != last && *pos == '-';
+	if (negative)
+	{
+		++pos;
+	}
+	const unsigned_type limit = negative
+		? static_cast<unsigned_type>(static_cast<unsigned_type>(::std::numeric_limits<Integer>::max()) + 1)
+		: static_cast<unsigned_type>(::std::numeric_limits<Integer>::max());
+	const unsigned int radix = static_cast<unsigned int>(base);
+	const char* const digits = pos;
+	unsigned_type result = 0;
+	bool overflow = false;
+	for (; pos != last; ++pos)
+	{
+		const unsigned int digit = (base == 10)
+			? static_cast<unsigned int>(static_cast<unsigned char>(*pos) - '0')
+			: internal::digit_value(*pos);
+		if (digit >= radix)
+		{
+			break;
+		}
+		if (result > (limit - digit) / radix)
+		{
+			overflow = true;
+		}
+		result = static_cast<unsigned_type>(result * radix + digit);
+	}
+	if (pos == digits)
+	{
+		return { first, ::std::errc::invalid_argument };
+	}
+	if (overflow)
+	{
+		return { pos, ::std::errc::result_out_of_range };
+	}
+	value = negative ? static_cast<Integer>(unsigned_type(0) - result) : static_cast<Integer>(result);
+	return { pos, ::std::errc() };
+}
+
+// Parses [-]digits[.digits][(e|E)[+|-]digits], inf, infinity and nan.
+template <class Float, class = typename ::std::enable_if<::std::is_floating_point<Float>::value>::type, class = void>
+inline from_chars_result from_chars(const char* first, const char* last, Float& value) noexcept
+{
+	using traits = internal::float_traits<Float>;
+	const char* pos = first;
+	const bool negative = (pos != last && *pos == '-');
+	if (negative)
+	{
+		++pos;
+	}
+	if (pos != last && (*pos == 'i' || *pos == 'I' || *pos == 'n' || *pos == 'N'))
+	{
+		if (internal::match_word(pos, last, "inf"))
+		{
+			internal::match_word(pos, last, "inity");
+			value = negative ? -::std::numeric_limits<Float>::infinity() : ::std::numeric_limits<Float>::infinity();
+			return { pos, ::std::errc() };
+		}
+		if (internal::match_word(pos, last, "nan"))
+		{
+			value = negative ? -::std::numeric_limits<Float>::quiet_NaN() : ::std::numeric_limits<Float>::quiet_NaN();
+			return { pos, ::std::errc() };
+		}
+		return { first, ::std::errc::invalid_argument };
+	}
+
+	uint64_t mantissa = 0;
+	int significant = 0;
+	int exponent = 0;
+	bool hasDigits = false;
+	for (; pos != last && *pos >= '0' && *pos <= '9'; ++pos)
+	{
+		hasDigits = true;
+		if (significant < 19)
+		{
+			mantissa = mantissa * 10 + static_cast<uint64_t>(*pos - '0');
+			significant += (mantissa != 0);
+		}
+		else
+		{
+			++exponent;
+			++significant;
+		}
+	}
+	if (pos != last && *pos == '.')
+	{
+		++pos;
+		for (; pos != last && *pos >= '0' && *pos <= '9'; ++pos)
+		{
+			hasDigits = true;
+			if (significant < 19)
+			{
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*pos - '0');
+				significant += (mantissa != 0);
+				--exponent;
+			}
+			else
+			{
+				++significant;
+			}
+		}
+	}
+	if (!hasDigits)
+	{
+		return { first, ::std::errc::invalid_argument };
+	}
+	if (pos != last && (*pos == 'e' || *pos == 'E'))
+	{
+		const char* exp = pos + 1;
+		const bool negativeExp = (exp != last && *exp == '-');
+		if (exp != last && (*exp == '-' || *exp == '+'))
+		{
+			++exp;
+		}
+		if (exp != last && *exp >= '0' && *exp <= '9')
+		{
+			int e = 0;
+			for (; exp != last && *exp >= '0' && *exp <= '9'; ++exp)
+			{
+				e = (e < 100000) ? e * 10 + (*exp - '0') : e;
+			}
+			exponent += negativeExp ? -e : e;
+			pos = exp;
+		}
+	}
+
+	if (significant <= 19 && mantissa <= traits::max_mantissa
+		&& exponent >= -traits::max_exact_pow10 && exponent <= traits::max_exact_pow10)
+	{
+		Float result = static_cast<Float>(mantissa);
+		result = (exponent < 0) ? result / internal::exact_pow10<Float>(-exponent) : result * internal::exact_pow10<Float>(exponent);
+		value = negative ? -result : result;
+		return { pos, ::std::errc() };
+	}
+
+	// strtod needs a terminated copy and accepts more syntax, so it only
+	// parses the range validated above.
+	char text[internal::max_parse_digits + 16];
+	internal::canonical_number(first, pos, text);
+	const int savedErrno = errno;
+	errno = 0;
+	const Float result = traits::parse(text, nullptr);
+	const bool range = (errno == ERANGE) && (result == 0 || ::std::isinf(result));
+	errno = savedErrno;
+	if (range)
+	{
+		return { pos, ::std::errc::result_out_of_range };
+	}
+	value = result;
+	return { pos, ::std::errc() };
+}
+
+} // namespace stl
+
+#ifdef CHARCONV_BENCHMARK
+#include <string>
+#include <vector>
+#include <random>
+#include <common/benchmark.h>
+
+// Compares the conversions with snprintf, strtoll and strtod on random values.
+
+namespace internal_charconv_benchmark {
+
+inline const ::std::vector<double>& doubles()
+{
+	static const ::std::vector<double> s_values = [] {
+		::std::mt19937_64 rng(42);
+		::std::uniform_real_distribution<double> mantissa(-1.0, 1.0);
+		::std::uniform_int_distribution<int> exponent(-20, 20);
+		::std::vector<double> values(1024);
+		for (double& value : values)
+			value = ::std::ldexp(mantissa(rng), exponent(rng) * 3);
+		return values;
+	}();
+	return s_values;
+}
+
+inline const ::std::vector<int64_t>& integers()
+{
+	static const ::std::vector<int64_t> s_values = [] {
+		::std::mt19937_64 rng(42);
+		::std::vector<int64_t> values(1024);
+		for (int64_t& value : values)
+			value = static_cast<int64_t>(rng()) >> (rng() % 64);
+		return values;
+	}();
+	return s_values;
+}
+
+inline ::std::vector<::std::string> texts(bool floating)
+{
+	::std::vector<::std::string> values;
+	char buf[64];
+	if (floating)
+		for (double value : doubles())
+			values.emplace_back(buf, ::stl::to_chars(buf, buf + sizeof(buf), value).ptr);
+	else
+		for (int64_t value : integers())
+			values.emplace_back(buf, ::stl::to_chars(buf, buf + sizeof(buf), value).ptr);
+	return values;
+}
+
+} // namespace internal_charconv_benchmark
+
+BENCHMARK(to_chars_int64)
+{
+	const auto& values = internal_charconv_benchmark::integers();
+	char buf[32];
+	size_t i = 0;
+	while (state.keep_running())
+		::bench::do_not_optimize(::stl::to_chars(buf, buf + sizeof(buf), values[i++ & 1023]).ptr);
+}
+
+BENCHMARK(snprintf_int64)
+{
+	const auto& values = internal_charconv_benchmark::integers();
+	char buf[32];
+	size_t i = 0;
+	while (state.keep_running())
+		::bench::do_not_optimize(::std::snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(values[i++ & 1023])));
+}
+
+BENCHMARK(to_chars_double)
+{
+	const auto& values = internal_charconv_benchmark::doubles();
+	char buf[40];
+	size_t i = 0;
+	while (state.keep_running())
+		::bench::do_not_optimize(::stl::to_chars(buf, buf + sizeof(buf), values[i++ & 1023]).ptr);
+}
+
+BENCHMARK(snprintf_double)
+{
+	const auto& values = internal_charconv_benchmark::doubles();
+	char buf[40];
+	size_t i = 0;
+	while (state.keep_running())
+		::bench::do_not_optimize(::std::snprintf(buf, sizeof(buf), "%.17g", values[i++ & 1023]));
+}
+
+BENCHMARK(from_chars_int64)
+{
+	const auto values = internal_charconv_benchmark::texts(false);
+	size_t i = 0;
+	int64_t value = 0;
+	while (state.keep_running())
+	{
+		const ::std::string& text = values[i++ & 1023];
+		::stl::from_chars(text.data(), text.data() + text.size(), value);
+		::bench::do_not_optimize(value);
+	}
+}
+
+BENCHMARK(strtoll_int64)
+{
+	const auto values = internal_charconv_benchmark::texts(false);
+	size_t i = 0;
+	while (state.keep_running())
+		::bench::do_not_optimize(::std::strtoll(values[i++ & 1023].c_str(), nullptr, 10));
+}
+
+BENCHMARK(from_chars_double)
+{
+	const auto values = internal_charconv_benchmark::texts(true);
+	size_t i = 0;
+	double value = 0;
+	while (state.keep_running())
+	{
+		const ::std::string& text = values[i++ & 1023];
+		::stl::from_chars(text.data(), text.data() + text.size(), value);
+		::bench::do_not_optimize(value);
+	}
+}
+
+BENCHMARK(strtod_double)
+{
+	const auto values = internal_charconv_benchmark::texts(true);
+	size_t i = 0;
+	while (state.keep_running())
+		::bench::do_not_optimize(::std::strtod(values[i++ & 1023].c_str(), nullptr));
+}
+
+#endif
+
+#ifdef CHARCONV_TEST
+#include <clocale>
+#include <cstdio>
+#include <random>
+#include <string>
+
+// Round trips of random values through to_chars and from_chars, long inputs
+// compared with strtod, halfway cases past max_parse_digits and output with a
+// precision. The values depend only on the seed and sample count.
+
+#ifndef CHARCONV_TEST_SEED
+#define CHARCONV_TEST_SEED 42
+#endif
+
+#ifndef CHARCONV_TEST_SAMPLES
+#define CHARCONV_TEST_SAMPLES 100000
+#endif
+
+namespace internal_charconv_test {
+
+template <class Float, class Bits>
+inline int round_trip(::std::mt19937_64& rng)
+{
+	int failures = 0;
+	for (int i = 0; i < CHARCONV_TEST_SAMPLES; ++i)
+	{
+		const Bits bits = static_cast<Bits>(rng());
+		Float value;
+		::std::memcpy(&value, &bits, sizeof(value));
+		if (!::std::isfinite(value))
+		{
+			continue;
+		}
+		char buf[64];
+		const ::stl::to_chars_result written = ::stl::to_chars(buf, buf + sizeof(buf), value);
+		Float result = 0;
+		const ::stl::from_chars_result read = ::stl::from_chars(buf, written.ptr, result);
+		Bits resultBits;
+		::std::memcpy(&resultBits, &result, sizeof(result));
+		if (read.ec != ::std::errc() || read.ptr != written.ptr || resultBits != bits)
+		{
+			::std::printf("charconv: %.*s does not read back\n", static_cast<int>(written.ptr - buf), buf);
+			++failures;
+		}
+	}
+	return failures;
+}
+
+template <class Integer>
+inline int integer_round_trip(::std::mt19937_64& rng)
+{
+	int failures = 0;
+	for (int i = 0; i < CHARCONV_TEST_SAMPLES; ++i)
+	{
+		const Integer value = static_cast<Integer>(rng() >> (rng() % 64));
+		const int base = static_cast<int>(2 + rng() % 35);
+		char buf[80];
+		const ::stl::to_chars_result written = ::stl::to_chars(buf, buf + sizeof(buf), value, base);
+		Integer result = 0;
+		const ::stl::from_chars_result read = ::stl::from_chars(buf, written.ptr, result, base);
+		if (read.ec != ::std::errc() || read.ptr != written.ptr || result != value)
+		{
+			::std::printf("charconv: %.*s in base %d does not read back\n", static_cast<int>(written.ptr - buf), buf, base);
+			++failures;
+		}
+	}
+	return failures;
+}
+
+inline ::std::string long_number(::std::mt19937_64& rng)
+{
+	::std::string text;
+	if (rng() & 1)
+	{
+		text += '-';
+	}
+	const size_t digits = 20 + rng() % 1000;
+	const size_t point = rng() % (digits + 1);
+	const size_t zeros = rng() % 4 == 0 ? rng() % digits : 0;
+	for (size_t i = 0; i < digits; ++i)
+	{
+		if (i == point)
+		{
+			text += '.';
+		}
+		text += (i < zeros) ? '0' : static_cast<char>('0' + rng() % 10);
+	}
+	text += 'e';
+	text += ::std::to_string(static_cast<int>(rng() % 700) - 350 - static_cast<int>(point));
+	return text;
+}
+
+template <class Float>
+inline int check(const ::std::string& text, Float expected, ::std::errc ec = ::std::errc())
+{
+	Float result = 0;
+	const ::stl::from_chars_result read = ::stl::from_chars(text.data(), text.data() + text.size(), result);
+	if (read.ec == ec && read.ptr == text.data() + text.size() && (ec != ::std::errc() || result == expected))
+	{
+		return 0;
+	}
+	::std::printf("charconv: %.60s... (%zu chars) read as %.17g\n", text.c_str(), text.size(), static_cast<double>(result));
+	return 1;
+}
+
+inline int long_numbers(::std::mt19937_64& rng)
+{
+	int failures = 0;
+	for (int i = 0; i < CHARCONV_TEST_SAMPLES / 100; ++i)
+	{
+		const ::std::string text = long_number(rng);
+		const double value = ::std::strtod(text.c_str(), nullptr);
+		failures += check(text, value, ::std::isinf(value) || value == 0 ? ::std::errc::result_out_of_range : ::std::errc());
+		const float single = ::std::strtof(text.c_str(), nullptr);
+		failures += check(text, single, ::std::isinf(single) || single == 0 ? ::std::errc::result_out_of_range : ::std::errc());
+	}
+	return failures;
+}
+
+// 2^-1075, halfway between zero and the smallest double, has 752 significant
+// digits, the digits of 5^1075.
+inline ::std::string smallest_halfway()
+{
+	::std::string digits = "1";
+	for (int i = 0; i < 1075; ++i)
+	{
+		int carry = 0;
+		for (size_t j = digits.size(); j-- > 0;)
+		{
+			const int product = (digits[j] - '0') * 5 + carry;
+			digits[j] = static_cast<char>('0' + product % 10);
+			carry = product / 10;
+		}
+		if (carry != 0)
+		{
+			digits.insert(digits.begin(), static_cast<char>('0' + carry));
+		}
+	}
+	return "0." + ::std::string(1075 - digits.size(), '0') + digits;
+}
+
+inline int halfway_numbers()
+{
+	int failures = 0;
+	const ::std::string one = "1.00000000000000011102230246251565404236316680908203125";
+	failures += check(one, 1.0);
+	failures += check(one + "0001", ::std::nextafter(1.0, 2.0));
+	failures += check(one + ::std::string(1000, '0') + "1", ::std::nextafter(1.0, 2.0));
+	const ::std::string smallest = smallest_halfway();
+	failures += check(smallest, 0.0, ::std::errc::result_out_of_range);
+	failures += check(smallest + "e0", 0.0, ::std::errc::result_out_of_range);
+	failures += check(smallest + ::std::string(1000, '0') + "1", ::std::numeric_limits<double>::denorm_min());
+	failures += check("0." + ::std::string(2000, '0') + "1e2000", 0.1);
+	return failures;
+}
+
+// to_chars with a precision, checked against the text printf writes.
+inline int check_precision(double value, ::stl::chars_format format, int precision, const char* expected)
+{
+	char buf[1500];
+	const ::stl::to_chars_result written = ::stl::to_chars(buf, buf + sizeof(buf), value, format, precision);
+	if (written.ec == ::std::errc() && ::std::string(buf, written.ptr) == expected)
+	{
+		return 0;
+	}
+	::std::printf("charconv: %.17g with precision %d written as %.*s instead of %.60s\n", value, precision,
+		static_cast<int>(written.ptr - buf), buf, expected);
+	return 1;
+}
+
+// Ties to even, carries into a new digit, the limits of double and random
+// values compared with snprintf where it rounds exactly (glibc).
+inline int precision_numbers(::std::mt19937_64& rng)
+{
+	using ::stl::chars_format;
+	int failures = 0;
+	failures += check_precision(0.5, chars_format::fixed, 0, "0");
+	failures += check_precision(1.5, chars_format::fixed, 0, "2");
+	failures += check_precision(2.5, chars_format::fixed, 0, "2");
+	failures += check_precision(0.125, chars_format::fixed, 2, "0.12");
+	failures += check_precision(0.375, chars_format::fixed, 2, "0.38");
+	failures += check_precision(9.995, chars_format::fixed, 2, "9.99");
+	failures += check_precision(99.96, chars_format::fixed, 1, "100.0");
+	failures += check_precision(5e-324, chars_format::fixed, 3, "0.000");
+	failures += check_precision(-0.0, chars_format::fixed, 1, "-0.0");
+	failures += check_precision(9.5, chars_format::scientific, 0, "1e+01");
+	failures += check_precision(5e-324, chars_format::scientific, 3, "4.941e-324");
+	failures += check_precision(1e23, chars_format::scientific, 2, "1.00e+23");
+	failures += check_precision(0.0, chars_format::scientific, 2, "0.00e+00");
+	failures += check_precision(-1.7976931348623157e308, chars_format::scientific, 5, "-1.79769e+308");
+	failures += check_precision(100000.0, chars_format::general, 6, "100000");
+	failures += check_precision(999999.5, chars_format::general, 6, "1e+06");
+	failures += check_precision(0.0001, chars_format::general, 6, "0.0001");
+	failures += check_precision(0.00001, chars_format::general, 6, "1e-05");
+	failures += check_precision(0.1, chars_format::general, 20, "0.10000000000000000555");
+	failures += check_precision(0.0, chars_format::general, 6, "0");
+	failures += check_precision(2.2250738585072014e-308, chars_format::general, 17, "2.2250738585072014e-308");
+#ifdef __GLIBC__
+	const chars_format formats[] = { chars_format::fixed, chars_format::scientific, chars_format::general };
+	const char* const printfFormats[] = { "%.*f", "%.*e", "%.*g" };
+	for (int i = 0; i < CHARCONV_TEST_SAMPLES / 10; ++i)
+	{
+		const uint64_t bits = rng();
+		double value;
+		::std::memcpy(&value, &bits, sizeof(value));
+		if (!::std::isfinite(value))
+		{
+			continue;
+		}
+		const size_t format = static_cast<size_t>(rng() % 3);
+		const int precision = static_cast<int>(rng() % 30);
+		char expected[400];
+		::std::snprintf(expected, sizeof(expected), printfFormats[format], precision, value);
+		failures += check_precision(value, formats[format], precision, expected);
+	}
+#else
+	(void)rng;
+#endif
+	return failures;
+}
+
+// The decimal point stays '.' when the locale uses a comma, skipped without
+// such a locale.
+inline int comma_locale()
+{
+	const ::std::string saved = ::std::setlocale(LC_NUMERIC, nullptr);
+	const char* const locales[] = { "de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "German_Germany.1252" };
+	bool found = false;
+	for (const char* locale : locales)
+	{
+		if (::std::setlocale(LC_NUMERIC, locale) != nullptr)
+		{
+			found = true;
+			break;
+		}
+	}
+	int failures = 0;
+	if (found)
+	{
+		failures += check(::std::string("0.1000000000000000000000001"), 0.1);
+		failures += check(::std::string("12345678901234567890.5e-5"), 123456789012345.67890);
+		failures += check_precision(1.5, ::stl::chars_format::fixed, 2, "1.50");
+		::std::setlocale(LC_NUMERIC, saved.c_str());
+	}
+	return failures;
+}
+
+// Returns the number of failures.
+inline int run()
+{
+	::std::mt19937_64 rng(CHARCONV_TEST_SEED);
+	int failures = 0;
+	failures += round_trip<double, uint64_t>(rng);
+	failures += round_trip<float, uint32_t>(rng);
+	failures += integer_round_trip<int64_t>(rng);
+	failures += integer_round_trip<uint64_t>(rng);
+	failures += long_numbers(rng);
+	failures += halfway_numbers();
+	failures += precision_numbers(rng);
+	failures += comma_locale();
+	return failures;
+}
+
+} // namespace internal_charconv_test
+
+#endif
@@ -0,0 +1,875 @@
+#pragma once
+
+#include <tuple>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+#include <string_view>
+#include <common/stl.h>
+#include <common/charconv.h>
+
+// Type safe {} formatting. The format string is parsed at compile time into
+// a sequence of literal and argument operations, so formatting only appends
+// text and converts the arguments:
+//
+//   ::std::string line = ::stl::format(STL_FMT("{} took {:.3f} ms"), name, ms);
+//
+// Replacement fields are {} or {:spec} with spec = [<|>][0][width][.precision][type].
+// Types are d, x, X, b, o for integers, e, E, f, F, g, G, a, A for floating
+// point, c for characters, s for strings and p for pointers. Floating point
+// values without type and precision are written in the shortest form that
+// reads back exactly, with a precision or type they are rounded exactly and
+// do not depend on the locale, except for a and A, which use snprintf. long
+// double is narrowed to double. {{ and }} are literal braces. Fields are used in order,
+// explicit argument indices are not supported. Malformed format strings, a
+// wrong number of arguments and a type the argument does not accept do not
+// compile.
+//
+// Other types are formatted by specializing stl::formatter. An optional
+// accepts() restricts the types of their fields at compile time:
+//
+//   template <>
+//   struct stl::formatter<point>
+//   {
+//       static constexpr bool accepts(char type) { return type == 0 || type == 's'; }
+//       static void format(format_buffer& out, const point& value, const format_spec& spec);
+//   };
+
+#define STL_FMT(str) \
+	[] { \
+		struct format_string_literal : ::stl::format_string \
+		{ \
+			static constexpr const char* data() { return str; } \
+		}; \
+		return format_string_literal{}; \
+	}()
+
+namespace util {
+
+template <class EnumDefinition>
+class DataEnum;
+
+} // namespace util
+
+namespace stl {
+
+struct format_string {};
+
+class format_error : public ::std::logic_error
+{
+public:
+	using ::std::logic_error::logic_error;
+};
+
+struct format_spec
+{
+	char type = 0;
+	char align = 0;
+	bool zero = false;
+	unsigned int width = 0;
+	int precision = -1;
+};
+
+// Output of the formatter. The storage is grown by the owner through the grow
+// function, which has to provide at least the required number of characters
+// after the current size and call reset().
+class format_buffer
+{
+public:
+	using grow_func = void (*)(format_buffer& buffer, size_t required);
+
+	format_buffer(char* data, size_t size, size_t capacity, grow_func grow, void* context) noexcept
+		: m_begin(data)
+		, m_pos(data + size)
+		, m_end(data + capacity)
+		, m_grow(grow)
+		, m_context(context)
+	{
+	}
+
+	format_buffer(const format_buffer&) = delete;
+	format_buffer& operator=(const format_buffer&) = delete;
+
+	char* reserve(size_t count)
+	{
+		if (count > static_cast<size_t>(m_end - m_pos))
+		{
+			m_grow(*this, count);
+		}
+		return m_pos;
+	}
+
+	void commit(size_t count) noexcept
+	{
+		m_pos += count;
+	}
+
+	void append(const char* str, size_t count)
+	{
+		::std::memcpy(reserve(count), str, count);
+		m_pos += count;
+	}
+
+	void push_back(char ch)
+	{
+		*reserve(1) = ch;
+		++m_pos;
+	}
+
+	void fill(char ch, size_t count)
+	{
+		::std::memset(reserve(count), ch, count);
+		m_pos += count;
+	}
+
+	void reset(char* data, size_t capacity) noexcept
+	{
+		const size_t size = this->size();
+		m_begin = data;
+		m_pos = data + size;
+		m_end = data + capacity;
+	}
+
+	char* data() const noexcept { return m_begin; }
+	size_t size() const noexcept { return static_cast<size_t>(m_pos - m_begin); }
+	size_t capacity() const noexcept { return static_cast<size_t>(m_end - m_begin); }
+	void* context() const noexcept { return m_context; }
+
+private:
+	char* m_begin;
+	char* m_pos;
+	char* m_end;
+	grow_func m_grow;
+	void* m_context;
+};
+
+namespace internal {
+
+struct format_op
+{
+	unsigned int begin = 0;
+	unsigned int length = 0;
+	int arg = -1; // literal text if negative
+	format_spec spec;
+};
+
+template <size_t Count>
+struct format_ops
+{
+	format_op ops[Count > 0 ? Count : 1];
+	size_t args;
+	size_t literals;
+};
+
+constexpr bool is_one_of(char ch, const char* types)
+{
+	for (; *types; ++types)
+	{
+		if (*types == ch)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+constexpr bool is_format_type(char ch)
+{
+	return is_one_of(ch, "dxXbocsfFeEgGaAp");
+}
+
+constexpr bool is_integer_type(char ch)
+{
+	return ch == 0 || is_one_of(ch, "dxXbo");
+}
+
+constexpr bool is_floating_type(char ch)
+{
+	return ch == 0 || is_one_of(ch, "eEfFgGaA");
+}
+
+constexpr void add_format_op(format_op* ops, size_t& count, size_t begin, size_t length, int arg, const format_spec& spec)
+{
+	if (arg < 0 && length == 0)
+	{
+		return;
+	}
+	if (ops != nullptr)
+	{
+		ops[count].begin = static_cast<unsigned int>(begin);
+		ops[count].length = static_cast<unsigned int>(length);
+		ops[count].arg = arg;
+		ops[count].spec = spec;
+	}
+	++count;
+}
+
+// Returns the number of operations and writes them to ops unless it is null.
+constexpr size_t parse_format(const char* str, format_op* ops)
+{
+	size_t count = 0;
+	size_t literal = 0;
+	size_t i = 0;
+	int arg = 0;
+	while (str[i] != 0)
+	{
+		if (str[i] == '{')
+		{
+			if (str[i + 1] == '{')
+			{
+				add_format_op(ops, count, literal, i + 1 - literal, -1, format_spec());
+				i += 2;
+				literal = i;
+				continue;
+			}
+			add_format_op(ops, count, literal, i - literal, -1, format_spec());
+			++i;
+			format_spec spec;
+			if (str[i] == ':')
+			{
+				++i;
+				if (str[i] == '<' || str[i] == '>')
+				{
+					spec.align = str[i++];
+				}
+				if (str[i] == '0')
+				{
+					spec.zero = true;
+					++i;
+				}
+				for (; str[i] >= '0' && str[i] <= '9'; ++i)
+				{
+					spec.width = spec.width * 10 + static_cast<unsigned int>(str[i] - '0');
+				}
+				if (str[i] == '.')
+				{
+					spec.precision = 0;
+					for (++i; str[i] >= '0' && str[i] <= '9'; ++i)
+					{
+						spec.precision = spec.precision * 10 + (str[i] - '0');
+					}
+				}
+				if (str[i] != '}' && str[i] != 0)
+				{
+					if (!is_format_type(str[i]))
+					{
+						throw format_error("unknown format type");
+					}
+					spec.type = str[i++];
+				}
+			}
+			if (str[i] != '}')
+			{
+				throw format_error("invalid replacement field");
+			}
+			add_format_op(ops, count, 0, 0, arg++, spec);
+			++i;
+			literal = i;
+		}
+		else if (str[i] == '}')
+		{
+			if (str[i + 1] != '}')
+			{
+				throw format_error("unmatched '}' in format string");
+			}
+			add_format_op(ops, count, literal, i + 1 - literal, -1, format_spec());
+			i += 2;
+			literal = i;
+		}
+		else
+		{
+			++i;
+		}
+	}
+	add_format_op(ops, count, literal, i - literal, -1, format_spec());
+	return count;
+}
+
+template <size_t Count>
+constexpr format_ops<Count> compile_format(const char* str)
+{
+	format_ops<Count> result{};
+	parse_format(str, result.ops);
+	for (size_t i = 0; i < Count; ++i)
+	{
+		if (result.ops[i].arg >= 0)
+		{
+			++result.args;
+		}
+		else
+		{
+			result.literals += result.ops[i].length;
+		}
+	}
+	return result;
+}
+
+template <class Format>
+struct compiled_format
+{
+	static constexpr size_t count = parse_format(Format::data(), nullptr);
+	static constexpr format_ops<count> value = compile_format<count>(Format::data());
+};
+
+template <class Format>
+using enable_if_format = typename ::std::enable_if<::std::is_base_of<format_string, Format>::value>::type;
+
+// Writes sign and text padded to the width of the spec.
+inline void write_padded(format_buffer& out, const char* sign, size_t signLength,
+                         const char* str, size_t length, const format_spec& spec, char defaultAlign)
+{
+	const size_t total = signLength + length;
+	const size_t padding = (spec.width > total) ? spec.width - total : 0;
+	if (padding == 0)
+	{
+		char* pos = out.reserve(total);
+		::std::memcpy(pos, sign, signLength);
+		::std::memcpy(pos + signLength, str, length);
+		out.commit(total);
+		return;
+	}
+	if (spec.zero && defaultAlign == '>')
+	{
+		out.append(sign, signLength);
+		out.fill('0', padding);
+		out.append(str, length);
+		return;
+	}
+	const char align = (spec.align != 0) ? spec.align : defaultAlign;
+	if (align == '>')
+	{
+		out.fill(' ', padding);
+	}
+	out.append(sign, signLength);
+	out.append(str, length);
+	if (align != '>')
+	{
+		out.fill(' ', padding);
+	}
+}
+
+inline void write_integer(format_buffer& out, uint64_t magnitude, bool negative, const format_spec& spec)
+{
+	char digits[64];
+	char* end = digits + sizeof(digits);
+	char* begin = end;
+	const char* prefix = negative ? "-" : "";
+	size_t prefixLength = negative ? 1 : 0;
+	switch (spec.type)
+	{
+	case 'x':
+	case 'X':
+	case 'p':
+	{
+		const char* hex = (spec.type == 'X') ? "0123456789ABCDEF" : "0123456789abcdef";
+		do {
+			*--begin = hex[magnitude & 0xF];
+			magnitude >>= 4;
+		} while (magnitude != 0);
+		if (spec.type == 'p')
+		{
+			prefix = "0x";
+			prefixLength = 2;
+		}
+		break;
+	}
+	case 'b':
+	case 'o':
+	{
+		const unsigned int shift = (spec.type == 'b') ? 1 : 3;
+		const uint64_t mask = (spec.type == 'b') ? 1 : 7;
+		do {
+			*--begin = static_cast<char>('0' + (magnitude & mask));
+			magnitude >>= shift;
+		} while (magnitude != 0);
+		break;
+	}
+	default:
+		if (spec.width == 0)
+		{
+			char* pos = out.reserve(21);
+			*pos = '-';
+			out.commit(static_cast<size_t>(write_decimal(pos + prefixLength, magnitude) - pos));
+			return;
+		}
+		begin = digits;
+		end = write_decimal(digits, magnitude);
+		break;
+	}
+	write_padded(out, prefix, prefixLength, begin, static_cast<size_t>(end - begin), spec, '>');
+}
+
+inline void write_uppercase(format_buffer& out, char* str, size_t length, const format_spec& spec)
+{
+	if (spec.type == 'E' || spec.type == 'F' || spec.type == 'G')
+	{
+		for (size_t i = 0; i < length; ++i)
+		{
+			str[i] = (str[i] >= 'a' && str[i] <= 'z') ? static_cast<char>(str[i] - 'a' + 'A') : str[i];
+		}
+	}
+	const bool negative = (str[0] == '-');
+	write_padded(out, "-", negative ? 1 : 0, str + negative, length - negative, spec, '>');
+}
+
+// Hexadecimal floating point goes through snprintf, its decimal point follows
+// LC_NUMERIC.
+inline void write_hexfloat(format_buffer& out, double value, const format_spec& spec)
+{
+	const char* format = (spec.precision >= 0)
+		? ((spec.type == 'A') ? "%.*A" : "%.*a")
+		: ((spec.type == 'A') ? "%A" : "%a");
+	char buf[64];
+	const int precision = ::std::min(spec.precision, 1000);
+	const int length = (spec.precision >= 0)
+		? ::std::snprintf(buf, sizeof(buf), format, precision, value)
+		: ::std::snprintf(buf, sizeof(buf), format, value);
+	if (length < 0)
+	{
+		return;
+	}
+	const bool negative = (buf[0] == '-');
+	if (static_cast<size_t>(length) < sizeof(buf))
+	{
+		write_padded(out, "-", negative ? 1 : 0, buf + negative, static_cast<size_t>(length) - negative, spec, '>');
+		return;
+	}
+	::std::string str;
+	if (spec.precision >= 0)
+		::stl::format_append(str, format, precision, value);
+	else
+		::stl::format_append(str, format, value);
+	write_padded(out, "-", negative ? 1 : 0, str.data() + negative, str.size() - negative, spec, '>');
+}
+
+template <class Float>
+inline void write_floating(format_buffer& out, Float value, const format_spec& spec)
+{
+	if (spec.type == 0 && spec.precision < 0)
+	{
+		char buf[40];
+		const char* end = ::stl::to_chars(buf, buf + sizeof(buf), value).ptr;
+		const bool negative = (buf[0] == '-');
+		write_padded(out, "-", negative ? 1 : 0, buf + negative, static_cast<size_t>(end - buf) - negative, spec, '>');
+		return;
+	}
+	if (spec.type == 'a' || spec.type == 'A')
+	{
+		write_hexfloat(out, static_cast<double>(value), spec);
+		return;
+	}
+	const chars_format format = (spec.type == 'f' || spec.type == 'F') ? chars_format::fixed
+		: (spec.type == 'e' || spec.type == 'E') ? chars_format::scientific
+		: chars_format::general;
+	const int precision = (spec.precision >= 0) ? ::std::min(spec.precision, 1000) : 6;
+	char buf[64];
+	const to_chars_result result = ::stl::to_chars(buf, buf + sizeof(buf), value, format, precision);
+	if (result.ec == ::std::errc())
+	{
+		write_uppercase(out, buf, static_cast<size_t>(result.ptr - buf), spec);
+		return;
+	}
+	// The integer part of a double has at most 309 digits.
+	::std::string str(static_cast<size_t>(precision) + 320, '\0');
+	const to_chars_result longResult = ::stl::to_chars(&str[0], &str[0] + str.size(), value, format, precision);
+	write_uppercase(out, &str[0], static_cast<size_t>(longResult.ptr - &str[0]), spec);
+}
+
+} // namespace internal
+
+template <class Type, class = void>
+struct formatter
+{
+	static_assert(sizeof(Type) == 0, "no stl::formatter specialization for this type");
+};
+
+template <class Type>
+struct formatter<Type, typename ::std::enable_if<::std::is_integral<Type>::value && !::std::is_same<Type, bool>::value
+	&& !::std::is_same<Type, char>::value>::type>
+{
+	static constexpr bool accepts(char type) { return internal::is_integer_type(type); }
+
+	static void format(format_buffer& out, Type value, const format_spec& spec)
+	{
+		using unsigned_type = typename ::std::make_unsigned<Type>::type;
+		const bool negative = value < 0;
+		const uint64_t magnitude = negative
+			? uint64_t(0) - static_cast<uint64_t>(value)
+			: static_cast<uint64_t>(static_cast<unsigned_type>(value));
+		internal::write_integer(out, magnitude, negative, spec);
+	}
+};
+
+template <class Type>
+struct formatter<Type, typename ::std::enable_if<::std::is_floating_point<Type>::value>::type>
+{
+	static constexpr bool accepts(char type) { return internal::is_floating_type(type); }
+
+	static void format(format_buffer& out, Type value, const format_spec& spec)
+	{
+		using float_type = typename ::std::conditional<::std::is_same<Type, float>::value, float, double>::type;
+		internal::write_floating(out, static_cast<float_type>(value), spec);
+	}
+};
+
+template <class Type>
+struct formatter<Type, typename ::std::enable_if<::std::is_enum<Type>::value>::type>
+{
+	static constexpr bool accepts(char type) { return internal::is_integer_type(type); }
+
+	static void format(format_buffer& out, Type value, const format_spec& spec)
+	{
+		using underlying_type = typename ::std::underlying_type<Type>::type;
+		formatter<underlying_type>::format(out, static_cast<underlying_type>(value), spec);
+	}
+};
+
+template <>
+struct formatter<bool>
+{
+	static constexpr bool accepts(char type) { return type == 's' || internal::is_integer_type(type); }
+
+	static void format(format_buffer& out, bool value, const format_spec& spec)
+	{
+		if (spec.type != 0 && spec.type != 's')
+		{
+			internal::write_integer(out, value ? 1 : 0, false, spec);
+			return;
+		}
+		internal::write_padded(out, "", 0, value ? "true" : "false", value ? 4 : 5, spec, '<');
+	}
+};
+
+template <>
+struct formatter<char>
+{
+	static constexpr bool accepts(char type) { return type == 'c' || internal::is_integer_type(type); }
+
+	static void format(format_buffer& out, char value, const format_spec& spec)
+	{
+		if (spec.type != 0 && spec.type != 'c')
+		{
+			formatter<int>::format(out, value, spec);
+			return;
+		}
+		internal::write_padded(out, "", 0, &value, 1, spec, '<');
+	}
+};
+
+template <>
+struct formatter<::std::string_view>
+{
+	static constexpr bool accepts(char type) { return type == 0 || type == 's'; }
+
+	static void format(format_buffer& out, ::std::string_view value, const format_spec& spec)
+	{
+		if (spec.precision >= 0 && static_cast<size_t>(spec.precision) < value.size())
+		{
+			value = value.substr(0, static_cast<size_t>(spec.precision));
+		}
+		if (spec.width == 0)
+		{
+			out.append(value.data(), value.size());
+			return;
+		}
+		internal::write_padded(out, "", 0, value.data(), value.size(), spec, '<');
+	}
+};
+
+template <>
+struct formatter<const char*>
+{
+	static constexpr bool accepts(char type) { return type == 0 || type == 's'; }
+
+	static void format(format_buffer& out, const char* value, const format_spec& spec)
+	{
+		formatter<::std::string_view>::format(out, (value != nullptr) ? ::std::string_view(value) : ::std::string_view("(null)"), spec);
+	}
+};
+
+template <>
+struct formatter<char*> : formatter<const char*> {};
+
+template <class Traits, class Allocator>
+struct formatter<::std::basic_string<char, Traits, Allocator>>
+{
+	static constexpr bool accepts(char type) { return type == 0 || type == 's'; }
+
+	static void format(format_buffer& out, const ::std::basic_string<char, Traits, Allocator>& value, const format_spec& spec)
+	{
+		formatter<::std::string_view>::format(out, ::std::string_view(value.data(), value.size()), spec);
+	}
+};
+
+template <class Type>
+struct formatter<Type*>
+{
+	static constexpr bool accepts(char type) { return type == 0 || type == 'p'; }
+
+	static void format(format_buffer& out, const Type* value, const format_spec& spec)
+	{
+		format_spec pointer = spec;
+		pointer.type = 'p';
+		internal::write_integer(out, reinterpret_cast<uintptr_t>(value), false, pointer);
+	}
+};
+
+template <>
+struct formatter<::std::nullptr_t>
+{
+	static constexpr bool accepts(char type) { return type == 0 || type == 'p'; }
+
+	static void format(format_buffer& out, ::std::nullptr_t, const format_spec& spec)
+	{
+		formatter<const void*>::format(out, nullptr, spec);
+	}
+};
+
+// DataEnums are written by name, or by value with an integer or floating point type.
+template <class EnumDefinition>
+struct formatter<::util::DataEnum<EnumDefinition>>
+{
+	static constexpr bool accepts(char type)
+	{
+		return type == 's' || formatter<typename ::util::DataEnum<EnumDefinition>::underlying_type>::accepts(type);
+	}
+
+	static void format(format_buffer& out, const ::util::DataEnum<EnumDefinition>& value, const format_spec& spec)
+	{
+		if (spec.type != 0 && spec.type != 's')
+		{
+			using underlying_type = typename ::util::DataEnum<EnumDefinition>::underlying_type;
+			formatter<underlying_type>::format(out, value.value(), spec);
+			return;
+		}
+		formatter<const char*>::format(out, value.name(), spec);
+	}
+};
+
+namespace internal {
+
+template <class Format, size_t Index, class Tuple>
+inline void write_format_op(format_buffer& out, const Tuple& args)
+{
+	constexpr format_op op = compiled_format<Format>::value.ops[Index];
+	if constexpr (op.arg < 0)
+	{
+		out.append(Format::data() + op.begin, op.length);
+	}
+	else
+	{
+		using type = typename ::std::decay<typename ::std::tuple_element<op.arg, Tuple>::type>::type;
+		formatter<type>::format(out, ::std::get<op.arg>(args), op.spec);
+	}
+}
+
+template <class Type, class = void>
+struct has_accepts : ::std::false_type {};
+
+template <class Type>
+struct has_accepts<Type, decltype(formatter<Type>::accepts(char()), void())> : ::std::true_type {};
+
+template <class Type>
+constexpr bool accepts_type(char type)
+{
+	if constexpr (has_accepts<Type>::value)
+	{
+		return formatter<Type>::accepts(type);
+	}
+	else
+	{
+		(void)type;
+		return true;
+	}
+}
+
+// True if every field of the format has a type its argument accepts.
+template <class Format, class... Args>
+constexpr bool format_types_match()
+{
+	using compiled = compiled_format<Format>;
+	constexpr bool (*accepts[])(char) = { &accepts_type<typename ::std::decay<Args>::type>..., nullptr };
+	for (size_t i = 0; i < compiled::count; ++i)
+	{
+		const format_op& op = compiled::value.ops[i];
+		if (op.arg >= 0 && static_cast<size_t>(op.arg) < sizeof...(Args) && !accepts[op.arg](op.spec.type))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+template <class Format, class Tuple, size_t... Indices>
+inline void write_format(format_buffer& out, const Tuple& args, ::std::index_sequence<Indices...>)
+{
+	(write_format_op<Format, Indices>(out, args), ...);
+}
+
+template <class String>
+inline void grow_string(format_buffer& buffer, size_t required)
+{
+	String& str = *static_cast<String*>(buffer.context());
+	str.resize(::std::max(buffer.size() + required, str.size() * 2));
+	buffer.reset(&str[0], str.size());
+}
+
+} // namespace internal
+
+template <class Format, class... Args, class = internal::enable_if_format<Format>>
+inline void format_to(format_buffer& out, Format, const Args&... args)
+{
+	using compiled = internal::compiled_format<Format>;
+	static_assert(compiled::value.args == sizeof...(Args), "number of arguments does not match the format string");
+	static_assert(internal::format_types_match<Format, Args...>(), "format type does not match the argument type");
+	internal::write_format<Format>(out, ::std::forward_as_tuple(args...), ::std::make_index_sequence<compiled::count>());
+}
+
+// Appends to str, reusing its spare capacity.
+template <class String, class Format, class... Args, class = internal::enable_if_format<Format>>
+inline void format_append(String& str, Format fmt, const Args&... args)
+{
+	static_assert(::std::is_same<typename String::value_type, char>::value, "only char strings are supported");
+	const size_t size = str.size();
+	const size_t estimate = internal::compiled_format<Format>::value.literals + 16 * sizeof...(Args);
+	str.resize(size + estimate);
+	format_buffer out(&str[0], size, str.size(), &internal::grow_string<String>, &str);
+	try
+	{
+		format_to(out, fmt, args...);
+	}
+	catch (...)
+	{
+		str.resize(size);
+		throw;
+	}
+	str.resize(out.size());
+}
+
+template <class String, class Format, class... Args, class = internal::enable_if_format<Format>>
+inline void format_to(String& str, Format fmt, const Args&... args)
+{
+	str.clear();
+	format_append(str, fmt, args...);
+}
+
+template <class Format, class... Args, class = internal::enable_if_format<Format>>
+inline ::std::string format(Format fmt, const Args&... args)
+{
+	::std::string str;
+	format_append(str, fmt, args...);
+	return str;
+}
+
+} // namespace stl
+
+#ifdef FORMAT_TEST
+#include <cstdio>
+
+// Fields whose type the argument does not accept must not compile, checked
+// with static_assert, and formatting results of the supported types.
+
+namespace internal_format_test {
+
+#define FORMAT_TEST_STRING(name, str) \
+	struct name : ::stl::format_string \
+	{ \
+		static constexpr const char* data() { return str; } \
+	}
+
+FORMAT_TEST_STRING(string_field, "{:s}");
+FORMAT_TEST_STRING(integer_fields, "{:d} {:x}");
+FORMAT_TEST_STRING(floating_fields, "{:.2F} {:a} {:e}");
+FORMAT_TEST_STRING(pointer_field, "{:p}");
+
+static_assert(!::stl::internal::format_types_match<string_field, double>(), "{:s} with a double");
+static_assert(!::stl::internal::format_types_match<string_field, int>(), "{:s} with an int");
+static_assert(!::stl::internal::format_types_match<integer_fields, double, int>(), "{:d} with a double");
+static_assert(!::stl::internal::format_types_match<integer_fields, int, double>(), "{:x} with a double");
+static_assert(!::stl::internal::format_types_match<floating_fields, double, int, double>(), "{:a} with an int");
+static_assert(!::stl::internal::format_types_match<pointer_field, const char*>(), "{:p} with a string");
+static_assert(::stl::internal::format_types_match<string_field, ::std::string>(), "{:s} with a string");
+static_assert(::stl::internal::format_types_match<string_field, bool>(), "{:s} with a bool");
+static_assert(::stl::internal::format_types_match<integer_fields, char, unsigned long>(), "{:d} with a char");
+static_assert(::stl::internal::format_types_match<floating_fields, double, float, long double>(), "floating types");
+static_assert(::stl::internal::format_types_match<pointer_field, void*>(), "{:p} with a pointer");
+
+#undef FORMAT_TEST_STRING
+
+inline int check(const ::std::string& result, const char* expected)
+{
+	if (result == expected)
+	{
+		return 0;
+	}
+	::std::printf("format: expected \"%s\", got \"%s\"\n", expected, result.c_str());
+	return 1;
+}
+
+// Returns the number of failures.
+inline int run()
+{
+	int failures = 0;
+	failures += check(::stl::format(STL_FMT("{} {:x} {:X} {:b} {:o} {:05d} {:<4}|"), -42, 255, 255, 5, 8, -7, 1), "-42 ff FF 101 10 -0007 1   |");
+	failures += check(::stl::format(STL_FMT("{} {} {:.3f} {:.2e} {:G}"), 0.1, 1e300, 2.5, 12345.0, 1e-10), "0.1 1e+300 2.500 1.23e+04 1E-10");
+	failures += check(::stl::format(STL_FMT("{:.1F} {:a}"), 1.25, 1.0), "1.2 0x1p+0");
+	failures += check(::stl::format(STL_FMT("{:.2f} {:.0f} {:.0f} {:.1f} {:.2f}"), 0.125, 2.5, 3.5, 0.95, -0.001), "0.12 2 4 0.9 -0.00");
+	failures += check(::stl::format(STL_FMT("{:.3E} {:G} {:F} {:.3} {:g}"), 99999.5, -::std::numeric_limits<double>::infinity(), 1.5f, 1234.5, 1e-5), "1.000E+05 -INF 1.500000 1.23e+03 1e-05");
+	failures += check(::stl::format(STL_FMT("[{:9.3f}] [{:<9.2e}] [{:09.1f}]"), 3.14159, 0.5, -2.25), "[    3.142] [5.00e-01 ] [-000002.2]");
+	failures += check(::stl::format(STL_FMT("{:.1f}"), 1e70), "10000000000000000725314363815292351261583744096465219555182101554790400.0");
+	failures += check(::stl::format(STL_FMT("{} {:s} {:d} {:c} {:d}"), true, false, true, 'a', 'a'), "true false 1 a 97");
+	failures += check(::stl::format(STL_FMT("[{:>6}] [{:<6}] [{:.2}]"), "ab", ::std::string("cd"), "xyz"), "[    ab] [cd    ] [xy]");
+	failures += check(::stl::format(STL_FMT("{} {:p}"), nullptr, static_cast<void*>(nullptr)), "0x0 0x0");
+	failures += check(::stl::format(STL_FMT("{{}} {}}}"), 1), "{} 1}");
+	return failures;
+}
+
+} // namespace internal_format_test
+
+#endif
+
+#ifdef FORMAT_BENCHMARK
+#include <common/benchmark.h>
+
+// Formats a typical log line with format, string_format and snprintf.
+
+BENCHMARK(format_log_line)
+{
+	::std::string line;
+	const ::std::string user = "account";
+	while (state.keep_running())
+	{
+		::stl::format_to(line, STL_FMT("[{}] order {} of {} filled {} @ {:.2f} ({:x})"),
+			user, 1234567, "EURUSD", -42, 1.08765, 0xBEEFu);
+		::bench::do_not_optimize(line);
+	}
+}
+
+BENCHMARK(string_format_log_line)
+{
+	const ::std::string user = "account";
+	while (state.keep_running())
+	{
+		::std::string line = ::stl::string_format("[%s] order %d of %s filled %d @ %.2f (%x)",
+			user.c_str(), 1234567, "EURUSD", -42, 1.08765, 0xBEEFu);
+		::bench::do_not_optimize(line);
+	}
+}
+
+BENCHMARK(snprintf_log_line)
+{
+	char line[256];
+	const ::std::string user = "account";
+	while (state.keep_running())
+	{
+		::std::snprintf(line, sizeof(line), "[%s] order %d of %s filled %d @ %.2f (%x)",
+			user.c_str(), 1234567, "EURUSD", -42, 1.08765, 0xBEEFu);
+		::bench::do_not_optimize(line);
+	}
+}
+
+#endif
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <new>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+namespace mem {
+
+// Intrusive LIFO lists of free memory blocks. The link is stored in the
+// first bytes of each block, so blocks must be at least pointer sized.
+
+class free_list
+{
+	struct node
+	{
+		node* next;
+	};
+
+public:
+	free_list() = default;
+	free_list(const free_list&) = delete;
+	free_list& operator=(const free_list&) = delete;
+
+	void push(void* ptr) noexcept
+	{
+		node* n = static_cast<node*>(ptr);
+		n->next = m_head;
+		m_head = n;
+	}
+
+	// Pushes blocks first..last that are already linked with link().
+	void push_chain(void* first, void* last) noexcept
+	{
+		static_cast<node*>(last)->next = m_head;
+		m_head = static_cast<node*>(first);
+	}
+
+	void* pop() noexcept
+	{
+		node* n = m_head;
+		if (n != nullptr)
+		{
+			m_head = n->next;
+		}
+		return n;
+	}
+
+	bool empty() const noexcept
+	{
+		return m_head == nullptr;
+	}
+
+	void clear() noexcept
+	{
+		m_head = nullptr;
+	}
+
+	static void link(void* ptr, void* next) noexcept
+	{
+		static_cast<node*>(ptr)->next = static_cast<node*>(next);
+	}
+
+	static void* next(void* ptr) noexcept
+	{
+		return static_cast<node*>(ptr)->next;
+	}
+
+private:
+	node* m_head = nullptr;
+};
+
+// Lock-free Treiber stack. The head pointer is tagged with a modification
+// counter to detect ABA. On 64 bit targets the tag uses the upper 16 bits
+// of the pointer, which user space addresses do not occupy.
+// Blocks may be popped while another thread still reads their link, so
+// the memory behind the blocks must stay mapped while the list is in use.
+
+class atomic_free_list
+{
+	struct node
+	{
+		::std::atomic<node*> next;
+	};
+
+	static constexpr unsigned pointer_bits = (sizeof(void*) == 8) ? 48 : 32;
+	static constexpr uint64_t pointer_mask = (uint64_t(1) << pointer_bits) - 1;
+
+	static uint64_t pack(node* n, uint64_t tag) noexcept
+	{
+		assert((reinterpret_cast<uintptr_t>(n) & ~pointer_mask) == 0);
+		return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(n)) | (tag << pointer_bits);
+	}
+
+	static node* pointer_of(uint64_t head) noexcept
+	{
+		return reinterpret_cast<node*>(static_cast<uintptr_t>(head & pointer_mask));
+	}
+
+	static uint64_t next_tag(uint64_t head) noexcept
+	{
+		return (head >> pointer_bits) + 1;
+	}
+
+public:
+	atomic_free_list() = default;
+	atomic_free_list(const atomic_free_list&) = delete;
+	atomic_free_list& operator=(const atomic_free_list&) = delete;
+
+	void push(void* ptr) noexcept
+	{
+		link(ptr, nullptr);
+		push_chain(ptr, ptr);
+	}
+
+	// Pushes blocks first..last that are already linked with link().
+	void push_chain(void* first, void* last) noexcept
+	{
+		node* f = static_cast<node*>(first);
+		node* l = static_cast<node*>(last);
+		uint64_t head = m_head.load(::std::memory_order_relaxed);
+		do {
+			l->next.store(pointer_of(head), ::std::memory_order_relaxed);
+		} while (!m_head.compare_exchange_weak(head, pack(f, next_tag(head)),
+			::std::memory_order_release, ::std::memory_order_relaxed));
+	}
+
+	void* pop() noexcept
+	{
+		uint64_t head = m_head.load(::std::memory_order_acquire);
+		while (node* n = pointer_of(head))
+		{
+			node* next = n->next.load(::std::memory_order_relaxed);
+			if (m_head.compare_exchange_weak(head, pack(next, next_tag(head)),
+				::std::memory_order_acquire, ::std::memory_order_acquire))
+			{
+				return n;
+			}
+		}
+		return nullptr;
+	}
+
+	// Detaches the whole list. Returns its first block, the remaining
+	// blocks are reached through next().
+	void* pop_all() noexcept
+	{
+		uint64_t head = m_head.load(::std::memory_order_relaxed);
+		while (!m_head.compare_exchange_weak(head, pack(nullptr, next_tag(head)),
+			::std::memory_order_acquire, ::std::memory_order_relaxed))
+		{
+		}
+		return pointer_of(head);
+	}
+
+	bool empty() const noexcept
+	{
+		return pointer_of(m_head.load(::std::memory_order_relaxed)) == nullptr;
+	}
+
+	void clear() noexcept
+	{
+		m_head.store(0, ::std::memory_order_relaxed);
+	}
+
+	static void link(void* ptr, void* next) noexcept
+	{
+		::new (ptr) node{ { static_cast<node*>(next) } };
+	}
+
+	static void* next(void* ptr) noexcept
+	{
+		return static_cast<node*>(ptr)->next.load(::std::memory_order_relaxed);
+	}
+
+private:
+	::std::atomic<uint64_t> m_head{ 0 };
+};
+
+} // namespace mem
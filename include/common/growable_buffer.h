@@ -0,0 +1,260 @@
+#pragma once
+
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <common/mem.h>
+
+namespace mem {
+
+// Contiguous buffer for trivially copyable elements. Elements are relocated
+// with memcpy, which allows growing through the realloc function of the
+// allocator functions (in place or by remapping) before falling back to
+// allocate-copy-free.
+
+template <class Type, class Functions = regular_allocator_functions>
+class growable_buffer
+{
+public:
+	static_assert(::std::is_trivially_copyable<Type>::value,
+		"growable_buffer relocates elements with memcpy and requires trivially copyable types.");
+
+	using value_type = Type;
+	using functions_type = Functions;
+	using size_type = size_t;
+	using pointer = value_type*;
+	using const_pointer = const value_type*;
+	using reference = value_type&;
+	using const_reference = const value_type&;
+	using iterator = pointer;
+	using const_iterator = const_pointer;
+
+	growable_buffer()
+		: m_functions()
+	{
+	}
+
+	explicit growable_buffer(const functions_type& allocFunctions)
+		: m_functions(allocFunctions)
+	{
+	}
+
+	growable_buffer(const growable_buffer& other)
+		: m_functions(other.m_functions)
+	{
+		append(other.data(), other.size());
+	}
+
+	growable_buffer(growable_buffer&& other) noexcept
+		: m_functions(other.m_functions)
+		, m_data(other.m_data)
+		, m_size(other.m_size)
+		, m_capacity(other.m_capacity)
+	{
+		other.m_data = nullptr;
+		other.m_size = 0;
+		other.m_capacity = 0;
+	}
+
+	~growable_buffer()
+	{
+		deallocate();
+	}
+
+	growable_buffer& operator=(const growable_buffer& other)
+	{
+		if (this != &other)
+		{
+			clear();
+			append(other.data(), other.size());
+		}
+		return *this;
+	}
+
+	// Allocator functions do not propagate. Memory is only stolen
+	// from a buffer using equal allocator functions.
+	growable_buffer& operator=(growable_buffer&& other)
+	{
+		if (this != &other)
+		{
+			if (m_functions == other.m_functions)
+			{
+				deallocate();
+				::std::swap(m_data, other.m_data);
+				::std::swap(m_size, other.m_size);
+				::std::swap(m_capacity, other.m_capacity);
+			}
+			else
+			{
+				*this = static_cast<const growable_buffer&>(other);
+			}
+		}
+		return *this;
+	}
+
+	const functions_type& functions() const noexcept { return m_functions; }
+
+	pointer data() noexcept { return m_data; }
+	const_pointer data() const noexcept { return m_data; }
+	size_type size() const noexcept { return m_size; }
+	size_type capacity() const noexcept { return m_capacity; }
+	bool empty() const noexcept { return m_size == 0; }
+
+	iterator begin() noexcept { return m_data; }
+	const_iterator begin() const noexcept { return m_data; }
+	iterator end() noexcept { return m_data + m_size; }
+	const_iterator end() const noexcept { return m_data + m_size; }
+
+	reference operator[](size_type index) { return m_data[index]; }
+	const_reference operator[](size_type index) const { return m_data[index]; }
+	reference back() { return m_data[m_size - 1]; }
+	const_reference back() const { return m_data[m_size - 1]; }
+
+	void reserve(size_type count)
+	{
+		if (count > m_capacity)
+		{
+			reallocate(count);
+		}
+	}
+
+	void resize(size_type count)
+	{
+		resize(count, value_type());
+	}
+
+	void resize(size_type count, const value_type& value)
+	{
+		if (count > m_size)
+		{
+			reserve_for_growth(count);
+			::std::fill(m_data + m_size, m_data + count, value);
+		}
+		m_size = count;
+	}
+
+	// Grows the size without initializing the new elements.
+	pointer grow_uninitialized(size_type count)
+	{
+		reserve_for_growth(m_size + count);
+		pointer ptr = m_data + m_size;
+		m_size += count;
+		return ptr;
+	}
+
+	void push_back(const value_type& value)
+	{
+		if (m_size == m_capacity)
+		{
+			const value_type copy = value;
+			reserve_for_growth(m_size + 1);
+			m_data[m_size++] = copy;
+		}
+		else
+		{
+			m_data[m_size++] = value;
+		}
+	}
+
+	template <class... Args>
+	reference emplace_back(Args&&... args)
+	{
+		value_type value(::std::forward<Args>(args)...);
+		push_back(value);
+		return back();
+	}
+
+	void append(const_pointer ptr, size_type count)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+		if (m_size + count > m_capacity && ptr >= m_data && ptr < m_data + m_size)
+		{
+			// Source aliases this buffer and would be invalidated by the reallocation.
+			const size_type offset = static_cast<size_type>(ptr - m_data);
+			reserve_for_growth(m_size + count);
+			ptr = m_data + offset;
+		}
+		else
+		{
+			reserve_for_growth(m_size + count);
+		}
+		::std::memcpy(m_data + m_size, ptr, count * sizeof(value_type));
+		m_size += count;
+	}
+
+	void pop_back()
+	{
+		--m_size;
+	}
+
+	void clear() noexcept
+	{
+		m_size = 0;
+	}
+
+	void shrink_to_fit()
+	{
+		if (m_size == 0)
+		{
+			deallocate();
+		}
+		else if (m_size < m_capacity)
+		{
+			reallocate(m_size);
+		}
+	}
+
+private:
+	void reserve_for_growth(size_type count)
+	{
+		if (count > m_capacity)
+		{
+			reallocate(::std::max(count, m_capacity * 2));
+		}
+	}
+
+	void reallocate(size_type capacity)
+	{
+		if (m_data != nullptr)
+		{
+			if (const auto realloc = m_functions.realloc())
+			{
+				if (void* ptr = realloc(m_data, m_capacity, capacity, sizeof(value_type)))
+				{
+					m_data = static_cast<pointer>(ptr);
+					m_capacity = capacity;
+					return;
+				}
+			}
+		}
+		pointer ptr = static_cast<pointer>(m_functions.alloc()(capacity, sizeof(value_type)));
+		if (m_size != 0)
+		{
+			::std::memcpy(ptr, m_data, m_size * sizeof(value_type));
+		}
+		deallocate();
+		m_data = ptr;
+		m_capacity = capacity;
+	}
+
+	void deallocate() noexcept
+	{
+		if (m_data != nullptr)
+		{
+			m_functions.free()(m_data, m_capacity, sizeof(value_type));
+			m_data = nullptr;
+			m_capacity = 0;
+		}
+	}
+
+	functions_type m_functions;
+	pointer m_data = nullptr;
+	size_type m_size = 0;
+	size_type m_capacity = 0;
+};
+
+} // namespace mem
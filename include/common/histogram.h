@@ -0,0 +1,269 @@
+#pragma once
+
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <cstdint>
+#include <ostream>
+#include <iostream>
+#include <algorithm>
+#include <common/stl.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace util {
+namespace internal {
+
+inline unsigned int highest_bit(uint64_t value) noexcept
+{
+#ifdef _MSC_VER
+	unsigned long index;
+#ifdef _M_X64
+	_BitScanReverse64(&index, value);
+#else
+	const uint32_t high = static_cast<uint32_t>(value >> 32);
+	if (high != 0)
+	{
+		_BitScanReverse(&index, high);
+		return static_cast<unsigned int>(index) + 32;
+	}
+	_BitScanReverse(&index, static_cast<uint32_t>(value));
+#endif
+	return static_cast<unsigned int>(index);
+#else
+	return 63u - static_cast<unsigned int>(__builtin_clzll(value));
+#endif
+}
+
+} // namespace internal
+
+// Log-linear (HDR) histogram of unsigned 64 bit values with constant memory.
+// Values below 2^SubBucketBits are counted exactly, larger values in buckets
+// with a relative width of 2^-(SubBucketBits-1), so 7 bits give < 1.6% error.
+template <unsigned int SubBucketBits = 7>
+class hdr_histogram
+{
+	static_assert(SubBucketBits >= 2 && SubBucketBits <= 16, "SubBucketBits out of range");
+
+	static constexpr uint64_t sub_bucket_count = uint64_t(1) << SubBucketBits;
+	static constexpr uint64_t half_count = sub_bucket_count / 2;
+
+public:
+	static constexpr size_t bucket_count = static_cast<size_t>(sub_bucket_count + (64 - SubBucketBits) * half_count);
+
+	hdr_histogram() noexcept
+	{
+		reset();
+	}
+
+	void record(uint64_t value, uint64_t count = 1) noexcept
+	{
+		m_counts[index_of(value)] += count;
+		m_total += count;
+		m_min = ::std::min(m_min, value);
+		m_max = ::std::max(m_max, value);
+		m_sum += static_cast<double>(value) * static_cast<double>(count);
+	}
+
+	void merge(const hdr_histogram& other) noexcept
+	{
+		for (size_t i = 0; i < bucket_count; ++i)
+		{
+			m_counts[i] += other.m_counts[i];
+		}
+		m_total += other.m_total;
+		m_min = ::std::min(m_min, other.m_min);
+		m_max = ::std::max(m_max, other.m_max);
+		m_sum += other.m_sum;
+	}
+
+	void reset() noexcept
+	{
+		::std::fill(m_counts, m_counts + bucket_count, uint64_t(0));
+		m_total = 0;
+		m_min = ::std::numeric_limits<uint64_t>::max();
+		m_max = 0;
+		m_sum = 0.0;
+	}
+
+	uint64_t count() const noexcept { return m_total; }
+	uint64_t min() const noexcept { return m_total != 0 ? m_min : 0; }
+	uint64_t max() const noexcept { return m_max; }
+	double mean() const noexcept { return m_total != 0 ? m_sum / static_cast<double>(m_total) : 0.0; }
+
+	// Returns the highest value equivalent to the given percentile in [0, 100].
+	uint64_t percentile(double percent) const noexcept
+	{
+		if (m_total == 0)
+		{
+			return 0;
+		}
+		percent = ::std::min(::std::max(percent, 0.0), 100.0);
+		uint64_t rank = static_cast<uint64_t>(percent / 100.0 * static_cast<double>(m_total) + 0.5);
+		rank = ::std::max(rank, uint64_t(1));
+		uint64_t seen = 0;
+		for (size_t i = 0; i < bucket_count; ++i)
+		{
+			seen += m_counts[i];
+			if (seen >= rank)
+			{
+				return ::std::min(::std::max(highest_value_of(i), m_min), m_max);
+			}
+		}
+		return m_max;
+	}
+
+	static size_t index_of(uint64_t value) noexcept
+	{
+		if (value < sub_bucket_count)
+		{
+			return static_cast<size_t>(value);
+		}
+		const unsigned int shift = internal::highest_bit(value) - (SubBucketBits - 1);
+		const uint64_t sub = value >> shift;
+		return static_cast<size_t>(sub_bucket_count + (shift - 1) * half_count + (sub - half_count));
+	}
+
+	static uint64_t lowest_value_of(size_t index) noexcept
+	{
+		if (index < sub_bucket_count)
+		{
+			return index;
+		}
+		const uint64_t k = index - sub_bucket_count;
+		const unsigned int shift = static_cast<unsigned int>(k / half_count) + 1;
+		return (k % half_count + half_count) << shift;
+	}
+
+	static uint64_t highest_value_of(size_t index) noexcept
+	{
+		if (index < sub_bucket_count)
+		{
+			return index;
+		}
+		const uint64_t k = index - sub_bucket_count;
+		const unsigned int shift = static_cast<unsigned int>(k / half_count) + 1;
+		return lowest_value_of(index) + ((uint64_t(1) << shift) - 1);
+	}
+
+private:
+	uint64_t m_counts[bucket_count];
+	uint64_t m_total;
+	uint64_t m_min;
+	uint64_t m_max;
+	double m_sum;
+};
+
+using latency_histogram = hdr_histogram<7>;
+
+inline void write_latency_summary(::std::ostream& stream, const latency_histogram& histogram)
+{
+	auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+	stream << ::stl::string_format(
+		"count: %llu mean: %.3f us p50: %.3f us p99: %.3f us p99.9: %.3f us max: %.3f us\n",
+		static_cast<unsigned long long>(histogram.count()), histogram.mean() / 1000.0,
+		us(histogram.percentile(50.0)), us(histogram.percentile(99.0)),
+		us(histogram.percentile(99.9)), us(histogram.max())).c_str();
+}
+
+// Latency histogram with an optional periodic report: with a report interval
+// the summary is written to the stream at most once per interval, checked on
+// every record, and the histogram starts over. Not synchronized, share it
+// between the counters of one thread.
+class latency_recorder
+{
+	using nanoseconds = ::std::chrono::nanoseconds;
+	using steady_clock = ::std::chrono::steady_clock;
+
+public:
+	void record(const nanoseconds& time)
+	{
+		m_histogram.record(static_cast<uint64_t>(::std::max(time.count(), nanoseconds::rep(0))));
+		if (m_stream != nullptr)
+		{
+			report_if_due();
+		}
+	}
+
+	void set_report_interval(nanoseconds interval, ::std::ostream& stream = ::std::cout)
+	{
+		m_interval = interval;
+		m_stream = &stream;
+		m_lastReport = steady_clock::now();
+	}
+
+	void report(::std::ostream& stream) const
+	{
+		write_latency_summary(stream, m_histogram);
+	}
+
+	latency_histogram& histogram() noexcept { return m_histogram; }
+	const latency_histogram& histogram() const noexcept { return m_histogram; }
+
+private:
+	void report_if_due()
+	{
+		const steady_clock::time_point now = steady_clock::now();
+		if (now - m_lastReport >= m_interval)
+		{
+			report(*m_stream);
+			m_histogram.reset();
+			m_lastReport = now;
+		}
+	}
+
+	latency_histogram m_histogram;
+	nanoseconds m_interval = nanoseconds(0);
+	::std::ostream* m_stream = nullptr;
+	steady_clock::time_point m_lastReport;
+};
+
+// time_counter printer recording every measurement in nanoseconds into a
+// latency_recorder, either its own or one shared by many counters:
+//
+//   util::latency_recorder s_recorder;
+//   util::time_counter<nanoseconds, util::time_counter_histogram_printer> counter(
+//       util::time_counter_histogram_printer(s_recorder));
+class time_counter_histogram_printer
+{
+	using nanoseconds = ::std::chrono::nanoseconds;
+
+public:
+	time_counter_histogram_printer()
+		: m_own(new latency_recorder())
+		, m_recorder(m_own.get())
+	{
+	}
+
+	explicit time_counter_histogram_printer(latency_recorder& recorder) noexcept
+		: m_recorder(&recorder)
+	{
+	}
+
+	void print(const nanoseconds& time)
+	{
+		m_recorder->record(time);
+	}
+
+	void set_report_interval(nanoseconds interval, ::std::ostream& stream = ::std::cout)
+	{
+		m_recorder->set_report_interval(interval, stream);
+	}
+
+	void report(::std::ostream& stream) const
+	{
+		m_recorder->report(stream);
+	}
+
+	latency_recorder& recorder() noexcept { return *m_recorder; }
+	latency_histogram& histogram() noexcept { return m_recorder->histogram(); }
+	const latency_histogram& histogram() const noexcept { return m_recorder->histogram(); }
+
+private:
+	::std::unique_ptr<latency_recorder> m_own;
+	latency_recorder* m_recorder;
+};
+
+} // namespace util
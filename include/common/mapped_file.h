@@ -0,0 +1,309 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <gsl/span>
+#include <common/util.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only mapping of a whole file, so loaders can parse straight from the
+// page cache instead of reading into a heap buffer. Pages are faulted in on
+// first access, populate maps them up front (MAP_POPULATE on Linux, a
+// WILLNEED hint elsewhere).
+//
+//   util::mapped_file file("config.json", util::file_access::sequential);
+//   if (!file) ...;
+//   parse(file.view());
+
+namespace util {
+
+enum class file_access
+{
+	normal,
+	sequential,
+	random
+};
+
+class mapped_file
+{
+public:
+	UTILS_DELETE_COPY_CONSTRUCTOR(mapped_file)
+
+	mapped_file() noexcept = default;
+
+	explicit mapped_file(const char* filename, file_access access = file_access::normal, bool populate = false)
+	{
+		open(filename, access, populate);
+	}
+
+#ifdef _WIN32
+	explicit mapped_file(const wchar_t* filename, file_access access = file_access::normal, bool populate = false)
+	{
+		open(filename, access, populate);
+	}
+#endif
+
+	mapped_file(mapped_file&& other) noexcept
+		: m_data(other.m_data)
+		, m_size(other.m_size)
+		, m_open(other.m_open)
+	{
+		other.m_data = nullptr;
+		other.m_size = 0;
+		other.m_open = false;
+	}
+
+	mapped_file& operator=(mapped_file&& other) noexcept
+	{
+		if (this != &other)
+		{
+			close();
+			m_data = other.m_data;
+			m_size = other.m_size;
+			m_open = other.m_open;
+			other.m_data = nullptr;
+			other.m_size = 0;
+			other.m_open = false;
+		}
+		return *this;
+	}
+
+	~mapped_file()
+	{
+		close();
+	}
+
+	// Returns false if the file cannot be opened or mapped, errno (GetLastError()
+	// on Windows) tells why. An empty file opens with no mapping.
+	bool open(const char* filename, file_access access = file_access::normal, bool populate = false)
+	{
+		close();
+#ifdef _WIN32
+		return map(::CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+			OPEN_EXISTING, file_flags(access), nullptr), populate);
+#else
+		return map(::open(filename, O_RDONLY | O_CLOEXEC), access, populate);
+#endif
+	}
+
+#ifdef _WIN32
+	// Wide file names are Windows only.
+	bool open(const wchar_t* filename, file_access access = file_access::normal, bool populate = false)
+	{
+		close();
+		return map(::CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+			OPEN_EXISTING, file_flags(access), nullptr), populate);
+	}
+#endif
+
+	void close() noexcept
+	{
+		if (m_data != nullptr)
+		{
+#ifdef _WIN32
+			::UnmapViewOfFile(m_data);
+#else
+			::munmap(const_cast<char*>(m_data), m_size);
+#endif
+		}
+		m_data = nullptr;
+		m_size = 0;
+		m_open = false;
+	}
+
+	// Changes the read ahead of the mapping, e.g. to random after a sequential
+	// scan of an index. The hint is given when the file is opened on Windows.
+	void advise(file_access access) noexcept
+	{
+#ifdef _WIN32
+		(void)access;
+#else
+		if (m_data != nullptr)
+		{
+			const int advice = (access == file_access::sequential) ? MADV_SEQUENTIAL
+				: (access == file_access::random) ? MADV_RANDOM : MADV_NORMAL;
+			::madvise(const_cast<char*>(m_data), m_size, advice);
+		}
+#endif
+	}
+
+	bool is_open() const noexcept
+	{
+		return m_open;
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return m_open;
+	}
+
+	const char* data() const noexcept
+	{
+		return m_data;
+	}
+
+	size_t size() const noexcept
+	{
+		return m_size;
+	}
+
+	bool empty() const noexcept
+	{
+		return m_size == 0;
+	}
+
+	const char* begin() const noexcept
+	{
+		return m_data;
+	}
+
+	const char* end() const noexcept
+	{
+		return m_data + m_size;
+	}
+
+	::std::string_view view() const noexcept
+	{
+		return ::std::string_view(m_data, m_size);
+	}
+
+	::gsl::span<const char> span() const noexcept
+	{
+		return ::gsl::span<const char>(m_data, m_size);
+	}
+
+private:
+#ifdef _WIN32
+	static DWORD file_flags(file_access access) noexcept
+	{
+		return FILE_ATTRIBUTE_NORMAL | ((access == file_access::sequential) ? FILE_FLAG_SEQUENTIAL_SCAN
+			: (access == file_access::random) ? FILE_FLAG_RANDOM_ACCESS : 0);
+	}
+
+	bool map(HANDLE file, bool populate)
+	{
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		LARGE_INTEGER size;
+		if (!::GetFileSizeEx(file, &size) || static_cast<uint64_t>(size.QuadPart) > static_cast<size_t>(-1))
+		{
+			const DWORD error = ::GetLastError();
+			::CloseHandle(file);
+			::SetLastError(error);
+			return false;
+		}
+		if (size.QuadPart == 0)
+		{
+			::CloseHandle(file);
+			m_open = true;
+			return true;
+		}
+		HANDLE mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		::CloseHandle(file);
+		if (mapping == nullptr)
+		{
+			return false;
+		}
+		void* data = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		::CloseHandle(mapping);
+		if (data == nullptr)
+		{
+			return false;
+		}
+		m_data = static_cast<const char*>(data);
+		m_size = static_cast<size_t>(size.QuadPart);
+		m_open = true;
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+		if (populate)
+		{
+			WIN32_MEMORY_RANGE_ENTRY range{ data, m_size };
+			::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+		}
+#else
+		(void)populate;
+#endif
+		return true;
+	}
+#else
+	bool map(int fd, file_access access, bool populate)
+	{
+		if (fd < 0)
+		{
+			return false;
+		}
+		struct ::stat status;
+		int error = 0;
+		if (::fstat(fd, &status) != 0)
+		{
+			error = errno;
+		}
+		else if (static_cast<uint64_t>(status.st_size) > static_cast<size_t>(-1))
+		{
+			error = EFBIG;
+		}
+		if (error != 0)
+		{
+			::close(fd);
+			errno = error;
+			return false;
+		}
+		const size_t size = static_cast<size_t>(status.st_size);
+		if (size == 0)
+		{
+			::close(fd);
+			m_open = true;
+			return true;
+		}
+		int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+		if (populate)
+		{
+			flags |= MAP_POPULATE;
+		}
+#endif
+		void* data = ::mmap(nullptr, size, PROT_READ, flags, fd, 0);
+		error = errno;
+		::close(fd);
+		if (data == MAP_FAILED)
+		{
+			errno = error;
+			return false;
+		}
+		m_data = static_cast<const char*>(data);
+		m_size = size;
+		m_open = true;
+		if (access != file_access::normal)
+		{
+			advise(access);
+		}
+#ifndef MAP_POPULATE
+		if (populate)
+		{
+			::madvise(data, size, MADV_WILLNEED);
+		}
+#endif
+		return true;
+	}
+#endif
+
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+	bool m_open = false;
+};
+
+} // namespace util
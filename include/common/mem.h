@@ -3,6 +3,7 @@
 
 #include <new>
 #include <memory>
+#include <cassert>
 #include <utility>
 #include <type_traits>
 #include <common/types.h>
@@ -147,6 +148,29 @@ public:
 	}
 };
 
+// Calls the free function of an allocator_context with its context.
+struct context_free_func
+{
+	void operator()(void* ptr, size_t count, size_t size) const {
+		func(ctx, ptr, count, size);
+	}
+	void* ctx;
+	free_ctx_func func;
+};
+
+class context_free
+{
+public:
+	constexpr context_free(const context_free_func free) noexcept
+		: m_free(free)
+	{}
+	context_free_func free() const noexcept {
+		return m_free;
+	}
+private:
+	const context_free_func m_free;
+};
+
 class custom_allocator_functions
 {
 public:
@@ -154,12 +178,14 @@ public:
 
 	constexpr custom_allocator_functions(
 		const alloc_func_not_null alloc,
-		const free_func_not_null free) noexcept
+		const free_func_not_null free,
+		const realloc_func realloc = nullptr) noexcept
 		: m_alloc(alloc)
 		, m_free(free)
+		, m_realloc(realloc)
 	{}
 	bool operator==(const custom_allocator_functions& other) const noexcept {
-		return (m_alloc == other.m_alloc) && (m_free == other.m_free);
+		return (m_alloc == other.m_alloc) && (m_free == other.m_free) && (m_realloc == other.m_realloc);
 	}
 	bool operator!=(const custom_allocator_functions& other) const noexcept {
 		return !(*this == other);
@@ -170,9 +196,13 @@ public:
 	free_func_not_null free()  const noexcept {
 		return m_free;
 	}
+	realloc_func realloc() const noexcept {
+		return m_realloc;
+	}
 private:
 	const alloc_func_not_null m_alloc;
 	const free_func_not_null m_free;
+	const realloc_func m_realloc;
 };
 
 class regular_allocator_functions
@@ -180,10 +210,10 @@ class regular_allocator_functions
 public:
 	using free_type = regular_free;
 
-	bool operator==(const custom_allocator_functions&) const noexcept {
+	bool operator==(const regular_allocator_functions&) const noexcept {
 		return true;
 	}
-	bool operator!=(const custom_allocator_functions&) const noexcept {
+	bool operator!=(const regular_allocator_functions&) const noexcept {
 		return false;
 	}
 	alloc_func_not_null alloc() const noexcept {
@@ -192,6 +222,61 @@ public:
 	free_func_not_null free()  const noexcept {
 		return internal::free;
 	}
+	realloc_func realloc() const noexcept {
+		return nullptr;
+	}
+};
+
+class context_allocator_functions
+{
+public:
+	struct alloc_type {
+		void* operator()(size_t count, size_t size) const {
+			return func(ctx, count, size);
+		}
+		void* ctx;
+		alloc_ctx_func func;
+	};
+	using free_type = context_free;
+	struct realloc_type {
+		void* operator()(void* ptr, size_t oldCount, size_t newCount, size_t size) const {
+			return func(ctx, ptr, oldCount, newCount, size);
+		}
+		explicit operator bool() const noexcept {
+			return func != nullptr;
+		}
+		void* ctx;
+		realloc_ctx_func func;
+	};
+
+	explicit context_allocator_functions(const allocator_context& context) noexcept
+		: m_context(context)
+	{
+		assert(context.alloc != nullptr && context.free != nullptr);
+	}
+	bool operator==(const context_allocator_functions& other) const noexcept {
+		return (m_context.ctx == other.m_context.ctx)
+			&& (m_context.alloc == other.m_context.alloc)
+			&& (m_context.free == other.m_context.free)
+			&& (m_context.realloc == other.m_context.realloc);
+	}
+	bool operator!=(const context_allocator_functions& other) const noexcept {
+		return !(*this == other);
+	}
+	alloc_type alloc() const noexcept {
+		return { m_context.ctx, m_context.alloc };
+	}
+	context_free_func free() const noexcept {
+		return { m_context.ctx, m_context.free };
+	}
+	realloc_type realloc() const noexcept {
+		return { m_context.ctx, m_context.realloc };
+	}
+	const allocator_context& context() const noexcept {
+		return m_context;
+	}
+private:
+	allocator_context m_context;
 };
 
 template <class Type, class Functions>
@@ -207,9 +292,18 @@ public:
 	using pointer = value_type*;
 	using size_type = size_t;
 
+	template <class Other>
+	struct rebind {
+		using other = customf_allocator<Other, Functions>;
+	};
+
 	template<class, class> friend class customf_allocator;
 
-	customf_allocator() noexcept = delete;
+	template <class F = Functions, class = typename ::std::enable_if<::std::is_default_constructible<F>::value>::type>
+	customf_allocator() noexcept
+		: m_allocFunctions()
+	{
+	}
 
 	explicit customf_allocator(const functions_type& allocFunctions) noexcept
 		: m_allocFunctions(allocFunctions)
@@ -264,6 +358,11 @@ public:
 	using pointer = value_type*;
 	using size_type = size_t;
 
+	template <class Other>
+	struct rebind {
+		using other = globalf_allocator<Other>;
+	};
+
 	globalf_allocator() noexcept = default;
 
 	globalf_allocator(const globalf_allocator&) noexcept = default;
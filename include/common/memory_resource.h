@@ -0,0 +1,160 @@
+#pragma once
+
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <common/mem.h>
+
+namespace mem {
+
+// Memory resource forwarding to allocator functions. Requests are passed as
+// count = bytes, size = 1. Allocator functions only guarantee fundamental
+// alignment, over-aligned requests are padded and the original pointer is
+// stored in front of the aligned block.
+
+template <class Functions = regular_allocator_functions>
+class functions_memory_resource : public ::std::pmr::memory_resource
+{
+public:
+	using functions_type = Functions;
+
+	functions_memory_resource()
+		: m_functions()
+	{
+	}
+
+	explicit functions_memory_resource(const functions_type& allocFunctions)
+		: m_functions(allocFunctions)
+	{
+	}
+
+	const functions_type& functions() const noexcept
+	{
+		return m_functions;
+	}
+
+protected:
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		bytes = (bytes != 0) ? bytes : 1;
+		if (alignment <= alignof(::std::max_align_t))
+		{
+			return m_functions.alloc()(bytes, 1);
+		}
+		if (bytes > static_cast<size_t>(-1) - alignment)
+		{
+			throw ::std::bad_alloc();
+		}
+		void* ptr = m_functions.alloc()(bytes + alignment, 1);
+		const uintptr_t address = reinterpret_cast<uintptr_t>(ptr) + sizeof(void*);
+		void** aligned = reinterpret_cast<void**>((address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1));
+		aligned[-1] = ptr;
+		return aligned;
+	}
+
+	void do_deallocate(void* ptr, size_t bytes, size_t alignment) override
+	{
+		bytes = (bytes != 0) ? bytes : 1;
+		if (alignment <= alignof(::std::max_align_t))
+		{
+			m_functions.free()(ptr, bytes, 1);
+		}
+		else
+		{
+			m_functions.free()(static_cast<void**>(ptr)[-1], bytes + alignment, 1);
+		}
+	}
+
+	bool do_is_equal(const ::std::pmr::memory_resource& other) const noexcept override
+	{
+		const functions_memory_resource* resource = dynamic_cast<const functions_memory_resource*>(&other);
+		return (resource != nullptr) && (m_functions == resource->m_functions);
+	}
+
+private:
+	const functions_type m_functions;
+};
+
+// Allocator context forwarding to a memory resource instance.
+
+namespace internal {
+
+inline void* __cdecl resource_context_alloc(void* ctx, size_t count, size_t size)
+{
+	if (count == 0)
+	{
+		return nullptr;
+	}
+	if (static_cast<size_t>(-1) / size < count)
+	{
+		throw ::std::bad_alloc();
+	}
+	return static_cast<::std::pmr::memory_resource*>(ctx)->allocate(count * size, alignof(::std::max_align_t));
+}
+
+inline void __cdecl resource_context_free(void* ctx, void* ptr, size_t count, size_t size)
+{
+	if (ptr != nullptr)
+	{
+		static_cast<::std::pmr::memory_resource*>(ctx)->deallocate(ptr, count * size, alignof(::std::max_align_t));
+	}
+}
+
+} // namespace internal
+
+inline allocator_context make_resource_context(::std::pmr::memory_resource* resource) noexcept
+{
+	return { resource, internal::resource_context_alloc, internal::resource_context_free, nullptr };
+}
+
+// Allocator functions forwarding to the memory resource returned by Resource,
+// for example resource_alloc<::std::pmr::get_default_resource>.
+
+using memory_resource_getter = ::std::pmr::memory_resource* (*)();
+
+template <memory_resource_getter Resource>
+inline void* __cdecl resource_alloc(size_t count, size_t size)
+{
+	if (count == 0)
+	{
+		return nullptr;
+	}
+	if (static_cast<size_t>(-1) / size < count)
+	{
+		throw ::std::bad_alloc();
+	}
+	return Resource()->allocate(count * size, alignof(::std::max_align_t));
+}
+
+template <memory_resource_getter Resource>
+inline void __cdecl resource_free(void* ptr, size_t count, size_t size)
+{
+	if (ptr != nullptr)
+	{
+		Resource()->deallocate(ptr, count * size, alignof(::std::max_align_t));
+	}
+}
+
+template <memory_resource_getter Resource>
+class resource_allocator_functions
+{
+public:
+	bool operator==(const resource_allocator_functions&) const noexcept {
+		return true;
+	}
+	bool operator!=(const resource_allocator_functions&) const noexcept {
+		return false;
+	}
+	alloc_func_not_null alloc() const noexcept {
+		return resource_alloc<Resource>;
+	}
+	free_func_not_null free()  const noexcept {
+		return resource_free<Resource>;
+	}
+	realloc_func realloc() const noexcept {
+		return nullptr;
+	}
+};
+
+} // namespace mem
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <new>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <common/mem.h>
+#include <common/free_list.h>
+
+namespace mem {
+
+struct object_pool_statistics
+{
+	size_t chunks;
+	size_t capacity;
+	size_t in_use;
+	size_t allocations;
+};
+
+// Pool of fixed size slots for objects of one type. Slots are carved from
+// chunks obtained through the allocator functions and recycled through an
+// intrusive free list. Chunks are only returned by release_all() or on
+// destruction. With ThreadSafe the free list is lock-free and slots can be
+// allocated and freed from any thread.
+
+template <class Type, class Functions = regular_allocator_functions, bool ThreadSafe = false>
+class object_pool
+{
+	static_assert(alignof(Type) <= alignof(::std::max_align_t),
+		"object_pool does not support over-aligned types.");
+
+	struct chunk
+	{
+		chunk* next;
+	};
+
+	using free_list_type = typename ::std::conditional<ThreadSafe, atomic_free_list, free_list>::type;
+	using counter_type = typename ::std::conditional<ThreadSafe, ::std::atomic<size_t>, size_t>::type;
+	using chunk_list_type = typename ::std::conditional<ThreadSafe, ::std::atomic<chunk*>, chunk*>::type;
+
+	static constexpr size_t slot_align = ::std::max(alignof(Type), alignof(void*));
+	static constexpr size_t slot_size = (::std::max(sizeof(Type), sizeof(void*)) + slot_align - 1) / slot_align * slot_align;
+	static constexpr size_t header_size = (sizeof(chunk) + slot_align - 1) / slot_align * slot_align;
+
+public:
+	using value_type = Type;
+	using functions_type = Functions;
+	using size_type = size_t;
+
+	explicit object_pool(size_type slotsPerChunk = 64, const functions_type& allocFunctions = functions_type())
+		: m_functions(allocFunctions)
+		, m_slotsPerChunk(slotsPerChunk != 0 ? slotsPerChunk : 1)
+		, m_chunks(nullptr)
+		, m_chunkCount(0)
+		, m_allocations(0)
+		, m_deallocations(0)
+	{
+	}
+
+	object_pool(const object_pool&) = delete;
+	object_pool& operator=(const object_pool&) = delete;
+
+	~object_pool()
+	{
+		release_all();
+	}
+
+	template <class... Args>
+	Type* create(Args&&... args)
+	{
+		void* ptr = allocate();
+		try {
+			return ::new (ptr) Type(::std::forward<Args>(args)...);
+		}
+		catch (...) {
+			deallocate(ptr);
+			throw;
+		}
+	}
+
+	void destroy(Type* ptr)
+	{
+		if (ptr != nullptr)
+		{
+			ptr->~Type();
+			deallocate(ptr);
+		}
+	}
+
+	// Returns uninitialized storage for one Type.
+	void* allocate()
+	{
+		void* ptr = m_freeList.pop();
+		if (ptr == nullptr)
+		{
+			ptr = allocate_chunk();
+		}
+		increment(m_allocations);
+		return ptr;
+	}
+
+	void deallocate(void* ptr) noexcept
+	{
+		m_freeList.push(ptr);
+		increment(m_deallocations);
+	}
+
+	// Frees all chunks at once without running destructors.
+	// Must not race with any other pool operation.
+	void release_all() noexcept
+	{
+		chunk* c = load(m_chunks);
+		while (c != nullptr)
+		{
+			chunk* next = c->next;
+			m_functions.free()(c, 1, chunk_bytes());
+			c = next;
+		}
+		m_chunks = nullptr;
+		m_freeList.clear();
+		m_chunkCount = 0;
+		m_allocations = 0;
+		m_deallocations = 0;
+	}
+
+	object_pool_statistics statistics() const noexcept
+	{
+		const size_t chunks = load(m_chunkCount);
+		const size_t allocations = load(m_allocations);
+		const size_t deallocations = load(m_deallocations);
+		return { chunks, chunks * m_slotsPerChunk, allocations - deallocations, allocations };
+	}
+
+	size_type slots_per_chunk() const noexcept
+	{
+		return m_slotsPerChunk;
+	}
+
+	const functions_type& functions() const noexcept
+	{
+		return m_functions;
+	}
+
+private:
+	size_t chunk_bytes() const noexcept
+	{
+		return header_size + m_slotsPerChunk * slot_size;
+	}
+
+	// Returns the first slot of a new chunk, all other slots go to the free list.
+	void* allocate_chunk()
+	{
+		chunk* c = static_cast<chunk*>(m_functions.alloc()(1, chunk_bytes()));
+		char* first = reinterpret_cast<char*>(c) + header_size;
+		if (m_slotsPerChunk > 1)
+		{
+			char* last = first + (m_slotsPerChunk - 1) * slot_size;
+			free_list_type::link(last, nullptr);
+			for (char* slot = last - slot_size; slot != first; slot -= slot_size)
+			{
+				free_list_type::link(slot, slot + slot_size);
+			}
+			m_freeList.push_chain(first + slot_size, last);
+		}
+		push_chunk(m_chunks, c);
+		increment(m_chunkCount);
+		return first;
+	}
+
+	static void push_chunk(chunk*& list, chunk* c) noexcept
+	{
+		c->next = list;
+		list = c;
+	}
+
+	static void push_chunk(::std::atomic<chunk*>& list, chunk* c) noexcept
+	{
+		c->next = list.load(::std::memory_order_relaxed);
+		while (!list.compare_exchange_weak(c->next, c,
+			::std::memory_order_release, ::std::memory_order_relaxed))
+		{
+		}
+	}
+
+	static void increment(size_t& counter) noexcept { ++counter; }
+	static void increment(::std::atomic<size_t>& counter) noexcept { counter.fetch_add(1, ::std::memory_order_relaxed); }
+
+	template <class Value>
+	static Value load(const Value& value) noexcept { return value; }
+	template <class Value>
+	static Value load(const ::std::atomic<Value>& value) noexcept { return value.load(::std::memory_order_acquire); }
+
+	const functions_type m_functions;
+	const size_type m_slotsPerChunk;
+	free_list_type m_freeList;
+	chunk_list_type m_chunks;
+	counter_type m_chunkCount;
+	counter_type m_allocations;
+	counter_type m_deallocations;
+};
+
+template <class Type, class Functions = regular_allocator_functions>
+using atomic_object_pool = object_pool<Type, Functions, true>;
+
+} // namespace mem
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <new>
+#include <common/types.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Allocator functions that map whole pages from the operating system.
+// Meant for large buffers: on Linux page_realloc grows and shrinks blocks
+// with mremap, which moves page table entries instead of copying memory.
+
+namespace mem {
+namespace internal {
+
+inline size_t page_bytes(size_t count, size_t size)
+{
+	if (static_cast<size_t>(-1) / size < count)
+	{
+		throw ::std::bad_alloc();
+	}
+	return count * size;
+}
+
+} // namespace internal
+
+inline void* __cdecl page_alloc(size_t count, size_t size)
+{
+	if (count == 0)
+	{
+		return nullptr;
+	}
+	const size_t bytes = internal::page_bytes(count, size);
+#ifdef _WIN32
+	void* ptr = ::VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (ptr == nullptr)
+	{
+		throw ::std::bad_alloc();
+	}
+#else
+	void* ptr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED)
+	{
+		throw ::std::bad_alloc();
+	}
+#endif
+	return ptr;
+}
+
+inline void __cdecl page_free(void* ptr, size_t count, size_t size)
+{
+	if (ptr == nullptr)
+	{
+		return;
+	}
+#ifdef _WIN32
+	(void)count;
+	(void)size;
+	::VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+	::munmap(ptr, internal::page_bytes(count, size));
+#endif
+}
+
+inline void* __cdecl page_realloc(void* ptr, size_t oldCount, size_t newCount, size_t size)
+{
+#if defined(__linux__) && defined(MREMAP_MAYMOVE)
+	if (ptr == nullptr || newCount == 0)
+	{
+		return nullptr;
+	}
+	void* newPtr = ::mremap(ptr,
+		internal::page_bytes(oldCount, size),
+		internal::page_bytes(newCount, size),
+		MREMAP_MAYMOVE);
+	return (newPtr != MAP_FAILED) ? newPtr : nullptr;
+#else
+	(void)ptr;
+	(void)oldCount;
+	(void)newCount;
+	(void)size;
+	return nullptr;
+#endif
+}
+
+class page_allocator_functions
+{
+public:
+	bool operator==(const page_allocator_functions&) const noexcept {
+		return true;
+	}
+	bool operator!=(const page_allocator_functions&) const noexcept {
+		return false;
+	}
+	alloc_func_not_null alloc() const noexcept {
+		return page_alloc;
+	}
+	free_func_not_null free()  const noexcept {
+		return page_free;
+	}
+	realloc_func realloc() const noexcept {
+		return page_realloc;
+	}
+};
+
+} // namespace mem
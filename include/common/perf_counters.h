@@ -0,0 +1,255 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <common/stl.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace util {
+
+enum class perf_event : size_t
+{
+	cycles,
+	instructions,
+	l1d_misses,
+	llc_misses,
+	branch_misses,
+	count
+};
+
+struct perf_sample
+{
+	static constexpr size_t event_count = static_cast<size_t>(perf_event::count);
+
+	uint64_t values[event_count] = {};
+	bool valid[event_count] = {};
+
+	bool has(perf_event event) const noexcept
+	{
+		return valid[static_cast<size_t>(event)];
+	}
+
+	uint64_t get(perf_event event) const noexcept
+	{
+		return values[static_cast<size_t>(event)];
+	}
+
+	double instructions_per_cycle() const noexcept
+	{
+		if (!has(perf_event::cycles) || !has(perf_event::instructions) || get(perf_event::cycles) == 0)
+		{
+			return 0.0;
+		}
+		return static_cast<double>(get(perf_event::instructions)) / static_cast<double>(get(perf_event::cycles));
+	}
+
+	perf_sample& operator+=(const perf_sample& other) noexcept
+	{
+		for (size_t i = 0; i < event_count; ++i)
+		{
+			values[i] += other.values[i];
+			valid[i] = valid[i] || other.valid[i];
+		}
+		return *this;
+	}
+};
+
+// Group of hardware counters of the calling thread, read with perf_event_open
+// on Linux. Counters the kernel or the hardware do not provide are skipped.
+// Without any counter (other platforms, containers, perf_event_paranoid)
+// available() is false and stop() returns an empty sample.
+class perf_counter_group
+{
+public:
+	perf_counter_group()
+	{
+		for (int& fd : m_fds)
+		{
+			fd = -1;
+		}
+#ifdef __linux__
+		open(perf_event::cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		open(perf_event::instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		open(perf_event::l1d_misses, PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+			| (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+		open(perf_event::llc_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+		open(perf_event::branch_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+	}
+
+	perf_counter_group(const perf_counter_group&) = delete;
+	perf_counter_group& operator=(const perf_counter_group&) = delete;
+
+	~perf_counter_group()
+	{
+#ifdef __linux__
+		for (int fd : m_fds)
+		{
+			if (fd >= 0)
+			{
+				::close(fd);
+			}
+		}
+#endif
+	}
+
+	bool available() const noexcept
+	{
+		return m_leader >= 0;
+	}
+
+	void start() noexcept
+	{
+#ifdef __linux__
+		if (available())
+		{
+			::ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			::ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+#endif
+	}
+
+	// Values are scaled up if the kernel multiplexed the counters.
+	perf_sample stop() noexcept
+	{
+		perf_sample sample;
+#ifdef __linux__
+		if (!available())
+		{
+			return sample;
+		}
+		::ioctl(m_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+		uint64_t data[3 + perf_sample::event_count] = {};
+		if (::read(m_leader, data, sizeof(data)) < static_cast<ssize_t>(3 * sizeof(uint64_t)))
+		{
+			return sample;
+		}
+		const uint64_t count = data[0];
+		const double scale = (data[2] != 0) ? static_cast<double>(data[1]) / static_cast<double>(data[2]) : 1.0;
+		for (uint64_t i = 0; i < count && i < m_opened; ++i)
+		{
+			const size_t event = m_order[i];
+			sample.values[event] = static_cast<uint64_t>(static_cast<double>(data[3 + i]) * scale);
+			sample.valid[event] = true;
+		}
+#endif
+		return sample;
+	}
+
+private:
+#ifdef __linux__
+	void open(perf_event event, uint32_t type, uint64_t config) noexcept
+	{
+		perf_event_attr attr;
+		::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = (m_leader < 0) ? 1 : 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		const int fd = static_cast<int>(::syscall(__NR_perf_event_open, &attr, 0, -1, m_leader, 0));
+		if (fd < 0)
+		{
+			return;
+		}
+		if (m_leader < 0)
+		{
+			m_leader = fd;
+		}
+		m_fds[static_cast<size_t>(event)] = fd;
+		m_order[m_opened++] = static_cast<size_t>(event);
+	}
+#endif
+
+	int m_leader = -1;
+	int m_fds[perf_sample::event_count];
+	size_t m_order[perf_sample::event_count] = {};
+	size_t m_opened = 0;
+};
+
+// Counts the events of the current scope into a sample.
+class scoped_perf_reader
+{
+public:
+	scoped_perf_reader(perf_counter_group& group, perf_sample& sample)
+		: m_group(group)
+		, m_sample(sample)
+	{
+		m_group.start();
+	}
+
+	scoped_perf_reader(const scoped_perf_reader&) = delete;
+	scoped_perf_reader& operator=(const scoped_perf_reader&) = delete;
+
+	~scoped_perf_reader()
+	{
+		m_sample = m_group.stop();
+	}
+
+private:
+	perf_counter_group& m_group;
+	perf_sample& m_sample;
+};
+
+// Formats IPC and miss counts per unit of work, for example per iteration.
+inline ::std::string format_perf_sample(const perf_sample& sample, double units = 1.0)
+{
+	::std::string text;
+	auto append = [&](perf_event event, const char* label) {
+		if (sample.has(event))
+		{
+			text += ::stl::string_format(" %s: %.2f", label, static_cast<double>(sample.get(event)) / units).c_str();
+		}
+	};
+	if (sample.has(perf_event::cycles) && sample.has(perf_event::instructions))
+	{
+		text += ::stl::string_format("ipc: %.2f", sample.instructions_per_cycle()).c_str();
+	}
+	append(perf_event::cycles, "cycles");
+	append(perf_event::instructions, "instructions");
+	append(perf_event::l1d_misses, "L1d misses");
+	append(perf_event::llc_misses, "LLC misses");
+	append(perf_event::branch_misses, "branch misses");
+	return text.empty() ? ::std::string("perf counters unavailable") : text;
+}
+
+// time_counter printer that counts hardware events between start and stop.
+class time_counter_perf_printer
+{
+	using nanoseconds = ::std::chrono::nanoseconds;
+
+public:
+	void on_start() noexcept
+	{
+		m_group.start();
+	}
+
+	void print(const nanoseconds& time)
+	{
+		m_sample = m_group.stop();
+		::std::cout << ::stl::string_format("Elapsed time in milliseconds: [%.3f] ",
+			static_cast<double>(time.count()) / 1000000.0).c_str()
+			<< format_perf_sample(m_sample) << '\n';
+	}
+
+	const perf_sample& sample() const noexcept
+	{
+		return m_sample;
+	}
+
+private:
+	perf_counter_group m_group;
+	perf_sample m_sample;
+};
+
+} // namespace util
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <ostream>
+#include <algorithm>
+#include <unordered_map>
+#include <common/stl.h>
+#include <common/tsc_clock.h>
+
+// Scoped profiling zones. Zones record begin and end ticks into a lock-free
+// buffer of the current thread. flush() collects the events of all threads,
+// which can then be written as Chrome trace event JSON (chrome://tracing,
+// ui.perfetto.dev) or aggregated into per-zone totals.
+// Zones compile to nothing unless COMMON_PROFILER_ENABLED is set to 1.
+
+#ifndef COMMON_PROFILER_ENABLED
+#define COMMON_PROFILER_ENABLED 0
+#endif
+
+#define PROFILER_CONCAT_IMPL(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_IMPL(a, b)
+
+#if COMMON_PROFILER_ENABLED
+#define PROFILE_ZONE(name) ::util::profiler::zone PROFILER_CONCAT(profilerZone, __LINE__)("" name)
+#define PROFILE_FUNCTION() ::util::profiler::zone PROFILER_CONCAT(profilerZone, __LINE__)(__func__)
+#else
+#define PROFILE_ZONE(name) (void)0
+#define PROFILE_FUNCTION() (void)0
+#endif
+
+namespace util {
+namespace profiler {
+
+struct event
+{
+	const char* name;
+	uint32_t thread;
+	uint32_t depth;
+	uint64_t begin;
+	uint64_t end;
+};
+
+struct zone_totals
+{
+	const char* name;
+	uint64_t count;
+	::std::chrono::nanoseconds total;
+	::std::chrono::nanoseconds max;
+};
+
+// Single producer, single consumer ring of events. Events are dropped
+// when the ring is full until the next flush.
+class thread_buffer
+{
+public:
+	static constexpr size_t capacity = 1 << 14;
+
+	thread_buffer() noexcept = default;
+
+	thread_buffer(const thread_buffer&) = delete;
+	thread_buffer& operator=(const thread_buffer&) = delete;
+
+	void push(const char* name, uint64_t begin, uint64_t end) noexcept
+	{
+		const size_t head = m_head.load(::std::memory_order_relaxed);
+		if (head - m_tail.load(::std::memory_order_acquire) == capacity)
+		{
+			m_dropped.fetch_add(1, ::std::memory_order_relaxed);
+			return;
+		}
+		m_events[head & (capacity - 1)] = { name, m_thread, m_depth, begin, end };
+		m_head.store(head + 1, ::std::memory_order_release);
+	}
+
+	template <class Consumer>
+	void consume(Consumer&& consumer)
+	{
+		const size_t head = m_head.load(::std::memory_order_acquire);
+		size_t tail = m_tail.load(::std::memory_order_relaxed);
+		for (; tail != head; ++tail)
+		{
+			consumer(m_events[tail & (capacity - 1)]);
+		}
+		m_tail.store(tail, ::std::memory_order_release);
+	}
+
+	size_t dropped() const noexcept
+	{
+		return m_dropped.load(::std::memory_order_relaxed);
+	}
+
+	bool empty() const noexcept
+	{
+		return m_head.load(::std::memory_order_acquire) == m_tail.load(::std::memory_order_relaxed);
+	}
+
+	uint32_t enter() noexcept { return m_depth++; }
+	void leave() noexcept { --m_depth; }
+
+private:
+	friend class registry;
+
+	uint32_t m_thread = 0;
+	uint32_t m_depth = 0;
+	bool m_released = false;
+	::std::atomic<size_t> m_head{ 0 };
+	::std::atomic<size_t> m_tail{ 0 };
+	::std::atomic<size_t> m_dropped{ 0 };
+	event m_events[capacity];
+};
+
+class registry
+{
+public:
+	static registry& instance()
+	{
+		static registry s_registry;
+		return s_registry;
+	}
+
+	// The buffer is taken on the first zone of the thread and given back when
+	// the thread exits. It is reused by a new thread once its events have been
+	// flushed, so threads that come and go do not add buffers.
+	static thread_buffer& local_buffer()
+	{
+		static thread_local buffer_owner s_owner;
+		if (s_owner.buffer == nullptr)
+		{
+			s_owner.buffer = instance().acquire_buffer();
+		}
+		return *s_owner.buffer;
+	}
+
+	::std::vector<event> flush()
+	{
+		::std::vector<event> events;
+		::std::lock_guard<::std::mutex> lock(m_mutex);
+		for (const ::std::unique_ptr<thread_buffer>& buffer : m_buffers)
+		{
+			buffer->consume([&](const event& e) { events.push_back(e); });
+		}
+		::std::sort(events.begin(), events.end(), [](const event& a, const event& b) {
+			return a.begin < b.begin;
+		});
+		return events;
+	}
+
+	size_t dropped()
+	{
+		size_t count = 0;
+		::std::lock_guard<::std::mutex> lock(m_mutex);
+		for (const ::std::unique_ptr<thread_buffer>& buffer : m_buffers)
+		{
+			count += buffer->dropped();
+		}
+		return count;
+	}
+
+	uint64_t base() const noexcept
+	{
+		return m_base;
+	}
+
+private:
+	registry()
+		: m_base(tsc_clock::now())
+	{
+	}
+
+	struct buffer_owner
+	{
+		~buffer_owner()
+		{
+			if (buffer != nullptr)
+			{
+				instance().release_buffer(buffer);
+			}
+		}
+
+		thread_buffer* buffer = nullptr;
+	};
+
+	thread_buffer* acquire_buffer()
+	{
+		::std::lock_guard<::std::mutex> lock(m_mutex);
+		thread_buffer* buffer = nullptr;
+		for (const ::std::unique_ptr<thread_buffer>& candidate : m_buffers)
+		{
+			if (candidate->m_released && candidate->empty())
+			{
+				buffer = candidate.get();
+				break;
+			}
+		}
+		if (buffer == nullptr)
+		{
+			m_buffers.emplace_back(new thread_buffer());
+			buffer = m_buffers.back().get();
+		}
+		buffer->m_released = false;
+		buffer->m_depth = 0;
+		buffer->m_thread = m_nextThread++;
+		return buffer;
+	}
+
+	void release_buffer(thread_buffer* buffer)
+	{
+		::std::lock_guard<::std::mutex> lock(m_mutex);
+		buffer->m_released = true;
+	}
+
+	const uint64_t m_base;
+	::std::mutex m_mutex;
+	::std::vector<::std::unique_ptr<thread_buffer>> m_buffers;
+	uint32_t m_nextThread = 0;
+};
+
+class zone
+{
+public:
+	explicit zone(const char* name) noexcept
+		: m_buffer(registry::local_buffer())
+		, m_name(name)
+	{
+		m_buffer.enter();
+		m_begin = tsc_clock::now();
+	}
+
+	zone(const zone&) = delete;
+	zone& operator=(const zone&) = delete;
+
+	~zone()
+	{
+		const uint64_t end = tsc_clock::now();
+		m_buffer.leave();
+		m_buffer.push(m_name, m_begin, end);
+	}
+
+private:
+	thread_buffer& m_buffer;
+	const char* const m_name;
+	uint64_t m_begin;
+};
+
+inline ::std::vector<event> flush()
+{
+	return registry::instance().flush();
+}
+
+inline ::std::vector<zone_totals> aggregate(const ::std::vector<event>& events)
+{
+	::std::unordered_map<const char*, size_t> indices;
+	::std::vector<zone_totals> totals;
+	for (const event& e : events)
+	{
+		auto it = indices.emplace(e.name, totals.size()).first;
+		if (it->second == totals.size())
+		{
+			totals.push_back({ e.name, 0, ::std::chrono::nanoseconds(0), ::std::chrono::nanoseconds(0) });
+		}
+		zone_totals& zone = totals[it->second];
+		const ::std::chrono::nanoseconds duration = tsc_clock::to_nanoseconds(e.end - e.begin);
+		zone.count += 1;
+		zone.total += duration;
+		zone.max = ::std::max(zone.max, duration);
+	}
+	::std::sort(totals.begin(), totals.end(), [](const zone_totals& a, const zone_totals& b) {
+		return a.total > b.total;
+	});
+	return totals;
+}
+
+inline void write_totals(::std::ostream& stream, const ::std::vector<zone_totals>& totals)
+{
+	for (const zone_totals& zone : totals)
+	{
+		const double totalMs = static_cast<double>(zone.total.count()) / 1000000.0;
+		const double averageUs = static_cast<double>(zone.total.count()) / 1000.0 / static_cast<double>(zone.count);
+		const double maxUs = static_cast<double>(zone.max.count()) / 1000.0;
+		stream << ::stl::string_format("%-40s count: %10llu total: %12.3f ms avg: %10.3f us max: %10.3f us\n",
+			zone.name, static_cast<unsigned long long>(zone.count), totalMs, averageUs, maxUs).c_str();
+	}
+}
+
+namespace internal {
+
+inline void write_json_string(::std::ostream& stream, const char* str)
+{
+	stream << '"';
+	for (; *str; ++str)
+	{
+		const char ch = *str;
+		if (ch == '"' || ch == '\\')
+		{
+			stream << '\\' << ch;
+		}
+		else if (static_cast<unsigned char>(ch) < 0x20)
+		{
+			stream << ::stl::string_format("\\u%04x", static_cast<unsigned int>(ch)).c_str();
+		}
+		else
+		{
+			stream << ch;
+		}
+	}
+	stream << '"';
+}
+
+} // namespace internal
+
+// Writes complete ("X") events with microsecond timestamps.
+inline void write_chrome_trace(::std::ostream& stream, const ::std::vector<event>& events)
+{
+	const uint64_t base = registry::instance().base();
+	stream << "{\"traceEvents\":[";
+	bool first = true;
+	for (const event& e : events)
+	{
+		const double ts = static_cast<double>(tsc_clock::to_nanoseconds(e.begin - ::std::min(base, e.begin)).count()) / 1000.0;
+		const double dur = static_cast<double>(tsc_clock::to_nanoseconds(e.end - e.begin).count()) / 1000.0;
+		stream << (first ? "\n" : ",\n") << "{\"name\":";
+		internal::write_json_string(stream, e.name);
+		stream << ::stl::string_format(",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+			e.thread, ts, dur).c_str();
+		first = false;
+	}
+	stream << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+inline void flush_chrome_trace(::std::ostream& stream)
+{
+	write_chrome_trace(stream, flush());
+}
+
+inline void flush_totals(::std::ostream& stream)
+{
+	write_totals(stream, aggregate(flush()));
+}
+
+} // namespace profiler
+} // namespace util
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstddef>
+#include <common/mem.h>
+
+namespace mem {
+
+// LIFO bump allocator over one fixed memory frame. Allocations advance the
+// top pointer, rewinding to a marker releases everything allocated after it.
+// Deallocating the topmost block pops it, other deallocations are no-ops.
+
+class scratch_stack
+{
+public:
+	static constexpr size_t alignment = alignof(::std::max_align_t);
+
+	explicit scratch_stack(size_t capacity)
+		: m_begin(static_cast<char*>(internal::alloc(round_up(capacity), 1)))
+		, m_top(m_begin)
+		, m_end(m_begin + round_up(capacity))
+	{
+	}
+
+	scratch_stack(const scratch_stack&) = delete;
+	scratch_stack& operator=(const scratch_stack&) = delete;
+
+	~scratch_stack()
+	{
+		internal::free(m_begin, capacity(), 1);
+	}
+
+	// Returns null if the frame has no room left.
+	void* allocate(size_t bytes) noexcept
+	{
+		const size_t aligned = round_up(bytes);
+		if (aligned < bytes || aligned > static_cast<size_t>(m_end - m_top))
+		{
+			return nullptr;
+		}
+		void* ptr = m_top;
+		m_top += aligned;
+		return ptr;
+	}
+
+	void deallocate(void* ptr, size_t bytes) noexcept
+	{
+		if (static_cast<char*>(ptr) + round_up(bytes) == m_top)
+		{
+			m_top = static_cast<char*>(ptr);
+		}
+	}
+
+	bool owns(const void* ptr) const noexcept
+	{
+		return (ptr >= m_begin) && (ptr < m_end);
+	}
+
+	size_t marker() const noexcept
+	{
+		return static_cast<size_t>(m_top - m_begin);
+	}
+
+	void rewind(size_t marker) noexcept
+	{
+		m_top = m_begin + marker;
+	}
+
+	size_t used() const noexcept
+	{
+		return static_cast<size_t>(m_top - m_begin);
+	}
+
+	size_t capacity() const noexcept
+	{
+		return static_cast<size_t>(m_end - m_begin);
+	}
+
+private:
+	static size_t round_up(size_t bytes) noexcept
+	{
+		return (bytes + alignment - 1) & ~(alignment - 1);
+	}
+
+	char* const m_begin;
+	char* m_top;
+	char* const m_end;
+};
+
+namespace internal {
+
+inline ::std::atomic<size_t>& scratch_capacity()
+{
+	static ::std::atomic<size_t> s_capacity(1024 * 1024);
+	return s_capacity;
+}
+
+} // namespace internal
+
+// Sets the frame size of threads that have not used their scratch stack yet.
+inline void set_scratch_capacity(size_t bytes)
+{
+	internal::scratch_capacity().store(bytes, ::std::memory_order_relaxed);
+}
+
+inline scratch_stack& local_scratch()
+{
+	static thread_local scratch_stack s_stack(internal::scratch_capacity().load(::std::memory_order_relaxed));
+	return s_stack;
+}
+
+// Releases all scratch memory of the current thread allocated during its lifetime.
+// Containers using scratch memory must not outlive the scope.
+class scratch_scope
+{
+public:
+	scratch_scope()
+		: m_stack(local_scratch())
+		, m_marker(m_stack.marker())
+	{
+	}
+
+	scratch_scope(const scratch_scope&) = delete;
+	scratch_scope& operator=(const scratch_scope&) = delete;
+
+	~scratch_scope()
+	{
+		m_stack.rewind(m_marker);
+	}
+
+private:
+	scratch_stack& m_stack;
+	const size_t m_marker;
+};
+
+// Allocator functions on the scratch stack of the calling thread. Requests
+// that do not fit fall back to the heap. Scratch memory must be freed on
+// the thread that allocated it.
+
+inline void* __cdecl scratch_alloc(size_t count, size_t size)
+{
+	if (count == 0)
+	{
+		return nullptr;
+	}
+	if (static_cast<size_t>(-1) / size < count)
+	{
+		throw ::std::bad_alloc();
+	}
+	if (void* ptr = local_scratch().allocate(count * size))
+	{
+		return ptr;
+	}
+	return internal::alloc(count, size);
+}
+
+inline void __cdecl scratch_free(void* ptr, size_t count, size_t size)
+{
+	scratch_stack& stack = local_scratch();
+	if (stack.owns(ptr))
+	{
+		stack.deallocate(ptr, count * size);
+	}
+	else
+	{
+		internal::free(ptr, count, size);
+	}
+}
+
+class scratch_allocator_functions
+{
+public:
+	bool operator==(const scratch_allocator_functions&) const noexcept {
+		return true;
+	}
+	bool operator!=(const scratch_allocator_functions&) const noexcept {
+		return false;
+	}
+	alloc_func_not_null alloc() const noexcept {
+		return scratch_alloc;
+	}
+	free_func_not_null free()  const noexcept {
+		return scratch_free;
+	}
+	realloc_func realloc() const noexcept {
+		return nullptr;
+	}
+};
+
+template <class Type>
+using scratch_allocator = customf_allocator<Type, scratch_allocator_functions>;
+
+using scratch_string = ::std::basic_string<char, ::std::char_traits<char>, scratch_allocator<char>>;
+using scratch_wstring = ::std::basic_string<wchar_t, ::std::char_traits<wchar_t>, scratch_allocator<wchar_t>>;
+
+} // namespace mem
@@ -6,6 +6,9 @@
 #include <memory>
 #include <algorithm>
 #include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <common/stl_search.h>
 
 namespace stl {
 
@@ -21,20 +24,118 @@ inline int nprintf(wchar_t* buf, size_t count, const wchar_t* format, Args... ar
 	return ::std::swprintf(buf, count, format, args...);
 }
 
+namespace internal {
+
+// snprintf reports the required length of truncated output, swprintf only fails.
+template <class Char>
+struct nprintf_reports_size : ::std::false_type {};
+
+template <>
+struct nprintf_reports_size<char> : ::std::true_type {};
+
+constexpr size_t format_initial_space = 64;
+constexpr size_t format_probe_space = 256;
+constexpr size_t format_max_space = size_t(1) << 24;
+
+template <class Type, class = void>
+struct is_format_string : ::std::false_type {};
+
+template <class Type>
+struct is_format_string<Type, decltype(::std::declval<Type&>().capacity(), void())> : ::std::true_type {};
+
+} // namespace internal
+
+// Appends the formatted text to str. The first attempt formats into the
+// spare capacity, of which at most format_probe_space characters are zero
+// filled, so character strings allocate at most once: when the text does not
+// fit, it is formatted again into exactly the reported length.
+template <class String, class... Args>
+inline void format_append(String& str, const typename String::value_type* format, Args... args)
+{
+	using char_type = typename String::value_type;
+	const size_t offset = str.size();
+	const size_t spare = ::std::min(str.capacity() - offset, internal::format_probe_space);
+	size_t space = internal::nprintf_reports_size<char_type>::value ? spare : ::std::max(spare, internal::format_initial_space);
+	for (;;)
+	{
+		str.resize(offset + space);
+		const int n = ::stl::nprintf(&str[offset], space + 1, format, args...);
+		if (n >= 0 && static_cast<size_t>(n) <= space)
+		{
+			str.resize(offset + static_cast<size_t>(n));
+			return;
+		}
+		if (n >= 0)
+		{
+			space = static_cast<size_t>(n);
+		}
+		else if (!internal::nprintf_reports_size<char_type>::value && space < internal::format_max_space)
+		{
+			space *= 2;
+		}
+		else
+		{
+			str.resize(offset);
+			throw ::std::invalid_argument("Encoding error occured");
+		}
+	}
+}
+
+// Replaces the contents of str, keeping its capacity.
+template <class String, class... Args>
+inline typename ::std::enable_if<internal::is_format_string<String>::value>::type
+	format_to(String& str, const typename String::value_type* format, Args... args)
+{
+	str.clear();
+	format_append(str, format, args...);
+}
+
+// Formats into a caller provided buffer of size characters including the
+// terminating null. Returns the length of the text, or -1 if it did not fit.
+template <class Char, class... Args>
+inline int format_to(Char* buf, size_t size, const Char* format, Args... args)
+{
+	const int n = ::stl::nprintf(buf, size, format, args...);
+	return (n >= 0 && static_cast<size_t>(n) < size) ? n : -1;
+}
+
+template <class Char, size_t Size, class... Args>
+inline int format_to(Char (&buf)[Size], const Char* format, Args... args)
+{
+	return format_to(static_cast<Char*>(buf), Size, format, args...);
+}
+
+// Writes the formatted text to an output iterator and returns the iterator
+// past the last character. Allocates only for text longer than 256 characters.
+template <class OutputIterator, class Char, class... Args>
+inline typename ::std::enable_if<!internal::is_format_string<OutputIterator>::value, OutputIterator>::type
+	format_to(OutputIterator out, const Char* format, Args... args)
+{
+	Char buf[256];
+	const int n = ::stl::nprintf(buf, sizeof(buf) / sizeof(Char), format, args...);
+	if (n >= 0 && static_cast<size_t>(n) < sizeof(buf) / sizeof(Char))
+	{
+		return ::std::copy(buf, buf + n, out);
+	}
+	::std::basic_string<Char> str;
+	format_append(str, format, args...);
+	return ::std::copy(str.begin(), str.end(), out);
+}
+
+// Formats into a stack buffer of Size characters first and allocates the
+// result exactly once. Longer output is formatted again into the string.
 template <class String, size_t Size, class... Args>
 inline String string_format_tn(const typename String::allocator_type& allocator,
                                const typename String::value_type* format, Args... args)
 {
 	typename String::value_type buf[Size];
 	const int n = ::stl::nprintf(buf, Size, format, args...);
-	if (n >= Size) {
-		throw ::std::length_error("Size is too small");
-	}
-	if (n < 0) {
-		throw ::std::invalid_argument("Encoding error occured");
+	if (n >= 0 && static_cast<size_t>(n) < Size) {
+		return String(buf, buf + n, allocator);
 	}
 	String str(allocator);
-	str.assign(buf, buf + Size);
+	str.reserve((n >= 0) ? static_cast<size_t>(n) : Size * 2);
+	format_append(str, format, args...);
 	return str;
 }
 
@@ -100,20 +201,6 @@ inline bool find_and_erase_if(Container& container, const Predicate& predicate)
 	return false;
 }
 
-template <class Iterator, class Value, class Compare = ::std::less<>>
-inline Iterator binary_find(Iterator first, Iterator last, const Value& value, Compare comp = {})
-{
-	first = ::std::lower_bound(first, last, value, comp);
-	return (first != last) && !comp(value, *first) ? first : last;
-}
-
-template <class Iterator, class Value, class Compare = ::std::less<>>
-inline typename Iterator::difference_type binary_find_index(Iterator first, Iterator last, const Value& value, Compare comp = {})
-{
-	Iterator it = binary_find(first, last, value, comp);
-	return ::std::distance(first, it);
-}
-
 template <class Type>
 inline void clear_mem(Type& object)
 {
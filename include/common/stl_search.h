@@ -0,0 +1,632 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COMMON_SEARCH_SSE2 1
+#include <emmintrin.h>
+#else
+#define COMMON_SEARCH_SSE2 0
+#endif
+
+#if COMMON_SEARCH_SSE2 && (defined(__SSE4_2__) || defined(__AVX__))
+#define COMMON_SEARCH_SSE42 1
+#include <nmmintrin.h>
+#else
+#define COMMON_SEARCH_SSE42 0
+#endif
+
+// Searches over sorted contiguous ranges of arithmetic keys.
+//
+// branchless_lower_bound halves the range with a conditional move instead of
+// a branch and prefetches both candidates of the next level, so lookups in
+// large arrays overlap their cache misses instead of mispredicting.
+// simd_lower_bound splits large ranges into five parts per level, comparing
+// four pivots at once, which saves dependent cache misses, halves the range
+// branchless below 4096 keys and counts the keys less than the value in the
+// last 16 with vector compares. It is available for 32 bit keys with SSE2 and for
+// 64 bit keys with SSE4.2 (double with SSE2) and falls back to the
+// branchless search otherwise. lower_bound_batch searches many values in
+// lockstep so the memory accesses of independent searches overlap.
+//
+// stl::lower_bound and stl::binary_find select these at compile time for
+// pointers and vector iterators to arithmetic keys compared with std::less.
+
+namespace stl {
+namespace internal {
+
+inline void prefetch(const void* ptr) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(ptr);
+#elif COMMON_SEARCH_SSE2
+	_mm_prefetch(static_cast<const char*>(ptr), _MM_HINT_T0);
+#else
+	(void)ptr;
+#endif
+}
+
+constexpr size_t simd_search_leaf = 16;
+constexpr size_t simd_search_kary = 4096;
+
+template <class Type, class = void>
+struct simd_search
+{
+	static constexpr bool enabled = false;
+};
+
+#if COMMON_SEARCH_SSE2
+
+inline unsigned int count_bits4(int mask) noexcept
+{
+	static constexpr unsigned char s_bits[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+	return s_bits[mask & 0xF];
+}
+
+// Signed and unsigned 32 bit integers. Unsigned keys are compared as signed
+// after flipping the sign bit.
+template <class Type>
+struct simd_search<Type, typename ::std::enable_if<::std::is_integral<Type>::value && sizeof(Type) == 4>::type>
+{
+	static constexpr bool enabled = true;
+	using vector = __m128i;
+
+	static vector bias() noexcept
+	{
+		return _mm_set1_epi32(::std::is_signed<Type>::value ? 0 : INT32_MIN);
+	}
+
+	static vector broadcast(Type value) noexcept
+	{
+		return _mm_xor_si128(_mm_set1_epi32(static_cast<int32_t>(value)), bias());
+	}
+
+	static unsigned int count_less(vector keys, vector value) noexcept
+	{
+		return count_bits4(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(value, _mm_xor_si128(keys, bias())))));
+	}
+
+	static unsigned int count_pivots(const Type* base, size_t step, vector value) noexcept
+	{
+		const vector keys = _mm_set_epi32(static_cast<int32_t>(base[4 * step]), static_cast<int32_t>(base[3 * step]),
+			static_cast<int32_t>(base[2 * step]), static_cast<int32_t>(base[step]));
+		return count_less(keys, value);
+	}
+
+	static unsigned int count_block(const Type* base, size_t n, vector value, Type scalar) noexcept
+	{
+		unsigned int count = 0;
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			count += count_less(_mm_loadu_si128(reinterpret_cast<const __m128i*>(base + i)), value);
+		}
+		for (; i < n; ++i)
+		{
+			count += (base[i] < scalar);
+		}
+		return count;
+	}
+};
+
+template <>
+struct simd_search<float>
+{
+	static constexpr bool enabled = true;
+	using vector = __m128;
+
+	static vector broadcast(float value) noexcept
+	{
+		return _mm_set1_ps(value);
+	}
+
+	static unsigned int count_pivots(const float* base, size_t step, vector value) noexcept
+	{
+		const vector keys = _mm_set_ps(base[4 * step], base[3 * step], base[2 * step], base[step]);
+		return count_bits4(_mm_movemask_ps(_mm_cmplt_ps(keys, value)));
+	}
+
+	static unsigned int count_block(const float* base, size_t n, vector value, float scalar) noexcept
+	{
+		unsigned int count = 0;
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			count += count_bits4(_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(base + i), value)));
+		}
+		for (; i < n; ++i)
+		{
+			count += (base[i] < scalar);
+		}
+		return count;
+	}
+};
+
+template <>
+struct simd_search<double>
+{
+	static constexpr bool enabled = true;
+	using vector = __m128d;
+
+	static vector broadcast(double value) noexcept
+	{
+		return _mm_set1_pd(value);
+	}
+
+	static unsigned int count_less(vector low, vector high, vector value) noexcept
+	{
+		return count_bits4(_mm_movemask_pd(_mm_cmplt_pd(low, value)) | (_mm_movemask_pd(_mm_cmplt_pd(high, value)) << 2));
+	}
+
+	static unsigned int count_pivots(const double* base, size_t step, vector value) noexcept
+	{
+		return count_less(_mm_set_pd(base[2 * step], base[step]), _mm_set_pd(base[4 * step], base[3 * step]), value);
+	}
+
+	static unsigned int count_block(const double* base, size_t n, vector value, double scalar) noexcept
+	{
+		unsigned int count = 0;
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			count += count_less(_mm_loadu_pd(base + i), _mm_loadu_pd(base + i + 2), value);
+		}
+		for (; i < n; ++i)
+		{
+			count += (base[i] < scalar);
+		}
+		return count;
+	}
+};
+
+#if COMMON_SEARCH_SSE42
+
+template <class Type>
+struct simd_search<Type, typename ::std::enable_if<::std::is_integral<Type>::value && sizeof(Type) == 8>::type>
+{
+	static constexpr bool enabled = true;
+	using vector = __m128i;
+
+	static vector bias() noexcept
+	{
+		return _mm_set1_epi64x(::std::is_signed<Type>::value ? 0 : INT64_MIN);
+	}
+
+	static vector broadcast(Type value) noexcept
+	{
+		return _mm_xor_si128(_mm_set1_epi64x(static_cast<int64_t>(value)), bias());
+	}
+
+	static unsigned int count_less(vector low, vector high, vector value) noexcept
+	{
+		const int lowMask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(value, _mm_xor_si128(low, bias()))));
+		const int highMask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(value, _mm_xor_si128(high, bias()))));
+		return count_bits4(lowMask | (highMask << 2));
+	}
+
+	static unsigned int count_pivots(const Type* base, size_t step, vector value) noexcept
+	{
+		return count_less(
+			_mm_set_epi64x(static_cast<int64_t>(base[2 * step]), static_cast<int64_t>(base[step])),
+			_mm_set_epi64x(static_cast<int64_t>(base[4 * step]), static_cast<int64_t>(base[3 * step])), value);
+	}
+
+	static unsigned int count_block(const Type* base, size_t n, vector value, Type scalar) noexcept
+	{
+		unsigned int count = 0;
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			count += count_less(_mm_loadu_si128(reinterpret_cast<const __m128i*>(base + i)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(base + i + 2)), value);
+		}
+		for (; i < n; ++i)
+		{
+			count += (base[i] < scalar);
+		}
+		return count;
+	}
+};
+
+#endif
+#endif
+
+template <class Compare, class Type>
+struct is_less_compare : ::std::integral_constant<bool,
+	::std::is_same<Compare, ::std::less<>>::value || ::std::is_same<Compare, ::std::less<Type>>::value> {};
+
+// Address of the element for pointers and vector iterators.
+template <class Iterator>
+inline auto contiguous_address(Iterator it) -> typename ::std::enable_if<::std::is_pointer<Iterator>::value, Iterator>::type
+{
+	return it;
+}
+
+template <class Iterator>
+inline auto contiguous_address(Iterator it) -> typename ::std::enable_if<
+	::std::is_same<Iterator, typename ::std::vector<typename ::std::iterator_traits<Iterator>::value_type>::iterator>::value ||
+	::std::is_same<Iterator, typename ::std::vector<typename ::std::iterator_traits<Iterator>::value_type>::const_iterator>::value,
+	decltype(&*it)>::type
+{
+	return &*it;
+}
+
+template <class Iterator, class = void>
+struct is_contiguous_iterator : ::std::false_type {};
+
+template <class Iterator>
+struct is_contiguous_iterator<Iterator, decltype(contiguous_address(::std::declval<Iterator>()), void())> : ::std::true_type {};
+
+template <class Iterator, class Value, class Compare>
+struct use_fast_search
+{
+	using key_type = typename ::std::remove_cv<typename ::std::iterator_traits<Iterator>::value_type>::type;
+	static constexpr bool value = is_contiguous_iterator<Iterator>::value
+		&& ::std::is_arithmetic<key_type>::value
+		&& ::std::is_same<typename ::std::decay<Value>::type, key_type>::value
+		&& is_less_compare<Compare, key_type>::value;
+};
+
+} // namespace internal
+
+template <class Type, class Compare = ::std::less<>>
+inline const Type* branchless_lower_bound(const Type* first, const Type* last, const Type& value, Compare comp = {})
+{
+	size_t n = static_cast<size_t>(last - first);
+	if (n == 0)
+	{
+		return first;
+	}
+	const Type* base = first;
+	while (n > 1)
+	{
+		const size_t half = n / 2;
+		internal::prefetch(base + half / 2);
+		internal::prefetch(base + half + half / 2);
+		base = comp(base[half], value) ? base + half : base;
+		n -= half;
+	}
+	return base + (comp(*base, value) ? 1 : 0);
+}
+
+namespace internal {
+
+template <class Type>
+inline const Type* simd_lower_bound(const Type* first, const Type* last, const Type& value, ::std::true_type)
+{
+	using search = simd_search<typename ::std::remove_cv<Type>::type>;
+	const typename search::vector key = search::broadcast(value);
+	const Type* base = first;
+	size_t n = static_cast<size_t>(last - first);
+	while (n > simd_search_kary)
+	{
+		const size_t step = n / 5;
+		const unsigned int pivots = search::count_pivots(base, step, key);
+		base += pivots * step;
+		n = (pivots == 4) ? n - 4 * step : step;
+	}
+	while (n > simd_search_leaf)
+	{
+		const size_t half = n / 2;
+		base = (base[half] < value) ? base + half : base;
+		n -= half;
+	}
+	return base + search::count_block(base, n, key, value);
+}
+
+template <class Type>
+inline const Type* simd_lower_bound(const Type* first, const Type* last, const Type& value, ::std::false_type)
+{
+	return ::stl::branchless_lower_bound(first, last, value);
+}
+
+} // namespace internal
+
+template <class Type>
+inline const Type* simd_lower_bound(const Type* first, const Type* last, const Type& value)
+{
+	using enabled = ::std::integral_constant<bool, internal::simd_search<typename ::std::remove_cv<Type>::type>::enabled>;
+	return internal::simd_lower_bound(first, last, value, enabled());
+}
+
+namespace internal {
+
+template <class Iterator, class Value, class Compare>
+inline Iterator lower_bound(Iterator first, Iterator last, const Value& value, Compare comp, ::std::true_type)
+{
+	(void)comp;
+	if (first == last)
+	{
+		return first;
+	}
+	const auto* begin = contiguous_address(first);
+	const auto* found = ::stl::simd_lower_bound(begin, begin + (last - first), value);
+	return first + (found - begin);
+}
+
+template <class Iterator, class Value, class Compare>
+inline Iterator lower_bound(Iterator first, Iterator last, const Value& value, Compare comp, ::std::false_type)
+{
+	return ::std::lower_bound(first, last, value, comp);
+}
+
+} // namespace internal
+
+// std::lower_bound, with the searches above for contiguous arithmetic keys.
+template <class Iterator, class Value, class Compare = ::std::less<>>
+inline Iterator lower_bound(Iterator first, Iterator last, const Value& value, Compare comp = {})
+{
+	using fast = ::std::integral_constant<bool, internal::use_fast_search<Iterator, Value, Compare>::value>;
+	return internal::lower_bound(first, last, value, comp, fast());
+}
+
+template <class Iterator, class Value, class Compare = ::std::less<>>
+inline Iterator binary_find(Iterator first, Iterator last, const Value& value, Compare comp = {})
+{
+	first = ::stl::lower_bound(first, last, value, comp);
+	return (first != last) && !comp(value, *first) ? first : last;
+}
+
+template <class Iterator, class Value, class Compare = ::std::less<>>
+inline typename ::std::iterator_traits<Iterator>::difference_type binary_find_index(Iterator first, Iterator last, const Value& value, Compare comp = {})
+{
+	Iterator it = binary_find(first, last, value, comp);
+	return ::std::distance(first, it);
+}
+
+// Writes the lower bound index of every value to indices.
+template <class Type, class Compare = ::std::less<>>
+inline void lower_bound_batch(const Type* first, const Type* last, const Type* values, size_t count, size_t* indices, Compare comp = {})
+{
+	constexpr size_t group = 8;
+	const size_t total = static_cast<size_t>(last - first);
+	for (size_t i = 0; i < count; i += group)
+	{
+		const size_t width = ::std::min(group, count - i);
+		if (total == 0)
+		{
+			::std::fill(indices + i, indices + i + width, size_t(0));
+			continue;
+		}
+		const Type* bases[group];
+		::std::fill(bases, bases + width, first);
+		size_t n = total;
+		while (n > 1)
+		{
+			const size_t half = n / 2;
+			for (size_t j = 0; j < width; ++j)
+			{
+				bases[j] = comp(bases[j][half], values[i + j]) ? bases[j] + half : bases[j];
+				internal::prefetch(bases[j] + (n - half) / 2);
+			}
+			n -= half;
+		}
+		for (size_t j = 0; j < width; ++j)
+		{
+			indices[i + j] = static_cast<size_t>(bases[j] - first) + (comp(*bases[j], values[i + j]) ? 1 : 0);
+		}
+	}
+}
+
+// Writes the index of every value to indices, or the size of the range if it is not found.
+template <class Type, class Compare = ::std::less<>>
+inline void binary_find_batch(const Type* first, const Type* last, const Type* values, size_t count, size_t* indices, Compare comp = {})
+{
+	lower_bound_batch(first, last, values, count, indices, comp);
+	const size_t total = static_cast<size_t>(last - first);
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (indices[i] != total && comp(values[i], first[indices[i]]))
+		{
+			indices[i] = total;
+		}
+	}
+}
+
+} // namespace stl
+
+#ifdef SEARCH_BENCHMARK
+#include <random>
+#include <common/benchmark.h>
+
+// Random lookups of existing keys in sorted int32 arrays of 1K, 64K and 16M keys.
+
+namespace internal_search_benchmark {
+
+template <size_t Size>
+struct data
+{
+	::std::vector<int32_t> keys;
+	::std::vector<int32_t> lookups;
+
+	static const data& get()
+	{
+		static const data s_data = [] {
+			data d;
+			::std::mt19937 rng(42);
+			d.keys.resize(Size);
+			for (size_t i = 0; i < Size; ++i)
+				d.keys[i] = static_cast<int32_t>(i * 3);
+			d.lookups.resize(4096);
+			for (int32_t& value : d.lookups)
+				value = d.keys[rng() % Size];
+			return d;
+		}();
+		return s_data;
+	}
+};
+
+template <size_t Size, int Kind>
+inline void run(::bench::state& state)
+{
+	const data<Size>& d = data<Size>::get();
+	const int32_t* first = d.keys.data();
+	const int32_t* last = first + d.keys.size();
+	size_t i = 0;
+	if (Kind == 3)
+	{
+		size_t indices[64];
+		while (state.keep_running())
+		{
+			::stl::lower_bound_batch(first, last, d.lookups.data() + (i & 4095 & ~size_t(63)), 64, indices);
+			::bench::do_not_optimize(indices);
+			i += 64;
+		}
+		state.set_items_processed(state.iterations() * 64);
+		return;
+	}
+	while (state.keep_running())
+	{
+		const int32_t value = d.lookups[i++ & 4095];
+		const int32_t* found = (Kind == 0) ? ::std::lower_bound(first, last, value)
+			: (Kind == 1) ? ::stl::branchless_lower_bound(first, last, value)
+			: ::stl::simd_lower_bound(first, last, value);
+		::bench::do_not_optimize(found);
+	}
+	state.set_items_processed(state.iterations());
+}
+
+} // namespace internal_search_benchmark
+
+#define SEARCH_BENCHMARK_SIZE(size) \
+	BENCHMARK(std_lower_bound_##size) { internal_search_benchmark::run<size, 0>(state); } \
+	BENCHMARK(branchless_lower_bound_##size) { internal_search_benchmark::run<size, 1>(state); } \
+	BENCHMARK(simd_lower_bound_##size) { internal_search_benchmark::run<size, 2>(state); } \
+	BENCHMARK(lower_bound_batch_##size) { internal_search_benchmark::run<size, 3>(state); }
+
+SEARCH_BENCHMARK_SIZE(1024)
+SEARCH_BENCHMARK_SIZE(65536)
+SEARCH_BENCHMARK_SIZE(16777216)
+
+#endif
+#ifdef STL_SEARCH_TEST
+#include <cstdio>
+#include <limits>
+#include <random>
+
+// Every search compared with std::lower_bound over sorted keys with runs of
+// equal keys and the limits of the type, at sizes around the leaf and k-ary
+// thresholds of simd_lower_bound.
+
+#ifndef STL_SEARCH_TEST_SEED
+#define STL_SEARCH_TEST_SEED 42
+#endif
+
+namespace internal_stl_search_test {
+
+template <class Type>
+inline Type random_key(::std::mt19937_64& rng)
+{
+	const uint64_t kind = rng() % 16;
+	if (kind == 0)
+	{
+		return ::std::numeric_limits<Type>::lowest();
+	}
+	if (kind == 1)
+	{
+		return ::std::numeric_limits<Type>::max();
+	}
+	if (kind < 10)
+	{
+		// Few distinct keys, fractions for floating point keys.
+		return static_cast<Type>(static_cast<Type>(static_cast<int>(rng() % 512) - 256) / 8);
+	}
+	return static_cast<Type>(static_cast<int64_t>(rng()));
+}
+
+template <class Type>
+inline int search_size(::std::mt19937_64& rng, const char* name, size_t size)
+{
+	::std::vector<Type> keys(size);
+	for (Type& key : keys)
+	{
+		key = random_key<Type>(rng);
+	}
+	::std::sort(keys.begin(), keys.end());
+	::std::vector<Type> values(keys);
+	values.push_back(::std::numeric_limits<Type>::lowest());
+	values.push_back(::std::numeric_limits<Type>::min());
+	values.push_back(::std::numeric_limits<Type>::max());
+	for (int i = 0; i < 64; ++i)
+	{
+		values.push_back(random_key<Type>(rng));
+	}
+	const Type* first = keys.data();
+	const Type* last = first + size;
+	::std::vector<size_t> batch(values.size());
+	::std::vector<size_t> batchFound(values.size());
+	::stl::lower_bound_batch(first, last, values.data(), values.size(), batch.data());
+	::stl::binary_find_batch(first, last, values.data(), values.size(), batchFound.data());
+	for (size_t i = 0; i < values.size(); ++i)
+	{
+		const Type value = values[i];
+		const size_t expected = static_cast<size_t>(::std::lower_bound(first, last, value) - first);
+		const size_t expectedFound = (expected != size && !(value < keys[expected])) ? expected : size;
+		const char* const searches[] = {
+			"branchless_lower_bound", "simd_lower_bound", "lower_bound", "lower_bound of iterators",
+			"lower_bound_batch", "binary_find", "binary_find_batch"
+		};
+		const size_t results[] = {
+			static_cast<size_t>(::stl::branchless_lower_bound(first, last, value) - first),
+			static_cast<size_t>(::stl::simd_lower_bound(first, last, value) - first),
+			static_cast<size_t>(::stl::lower_bound(first, last, value) - first),
+			static_cast<size_t>(::stl::lower_bound(keys.cbegin(), keys.cend(), value) - keys.cbegin()),
+			batch[i],
+			static_cast<size_t>(::stl::binary_find(first, last, value) - first),
+			batchFound[i]
+		};
+		for (size_t j = 0; j < 7; ++j)
+		{
+			const size_t wanted = (j < 5) ? expected : expectedFound;
+			if (results[j] != wanted)
+			{
+				::std::printf("stl_search: %s of %.17g in %zu %s keys returned %zu instead of %zu\n",
+					searches[j], static_cast<double>(value), size, name, results[j], wanted);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+template <class Type>
+inline int search_type(::std::mt19937_64& rng, const char* name)
+{
+	const size_t leaf = ::stl::internal::simd_search_leaf;
+	const size_t kary = ::stl::internal::simd_search_kary;
+	const size_t sizes[] = {
+		0, 1, 2, 3, 4, 5, leaf - 1, leaf, leaf + 1, 2 * leaf + 1, 1000,
+		kary - 1, kary, kary + 1, 5 * kary + 4, 5 * kary + 5, 25 * kary + 3
+	};
+	int failures = 0;
+	for (size_t size : sizes)
+	{
+		failures += search_size<Type>(rng, name, size);
+	}
+	return failures;
+}
+
+// Returns the number of failures.
+inline int run()
+{
+	::std::mt19937_64 rng(STL_SEARCH_TEST_SEED);
+	int failures = 0;
+	failures += search_type<int16_t>(rng, "int16");
+	failures += search_type<int32_t>(rng, "int32");
+	failures += search_type<uint32_t>(rng, "uint32");
+	failures += search_type<int64_t>(rng, "int64");
+	failures += search_type<uint64_t>(rng, "uint64");
+	failures += search_type<float>(rng, "float");
+	failures += search_type<double>(rng, "double");
+	return failures;
+}
+
+} // namespace internal_stl_search_test
+
+#endif
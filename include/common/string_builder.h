@@ -0,0 +1,376 @@
+#pragma once
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <cstring>
+#include <ostream>
+#include <algorithm>
+#include <string_view>
+#include <type_traits>
+#include <common/stl.h>
+#include <common/format.h>
+#include <common/charconv.h>
+
+namespace stl {
+
+// Append only character buffer for building text from many pieces. The first
+// InlineSize characters are stored in the object, longer text grows on the
+// heap through the allocator, e.g. a mem::customf_allocator<char, ...>.
+// reset() keeps the capacity, so a builder reused for every log line or
+// message stops allocating once it has seen the longest one.
+//
+//   stl::string_builder builder;
+//   builder << "order " << id << " filled at " << price;
+//   builder.append_format(STL_FMT(" ({} lots)"), lots);
+//   util::clog(builder.view());
+
+template <size_t InlineSize = 256, class Allocator = ::std::allocator<char>>
+class basic_string_builder
+{
+	static_assert(InlineSize > 0, "InlineSize must not be zero");
+	static_assert(::std::is_same<typename Allocator::value_type, char>::value, "Allocator must allocate char");
+
+	using allocator_traits = ::std::allocator_traits<Allocator>;
+
+public:
+	using allocator_type = Allocator;
+	using size_type = size_t;
+	using value_type = char;
+	using iterator = char*;
+	using const_iterator = const char*;
+
+	basic_string_builder() noexcept(noexcept(Allocator()))
+		: m_allocator()
+	{
+	}
+
+	explicit basic_string_builder(const allocator_type& allocator) noexcept
+		: m_allocator(allocator)
+	{
+	}
+
+	basic_string_builder(const basic_string_builder& other)
+		: m_allocator(allocator_traits::select_on_container_copy_construction(other.m_allocator))
+	{
+		append(other.data(), other.size());
+	}
+
+	basic_string_builder(basic_string_builder&& other) noexcept
+		: m_allocator(::std::move(other.m_allocator))
+	{
+		steal(other);
+	}
+
+	~basic_string_builder()
+	{
+		deallocate();
+	}
+
+	basic_string_builder& operator=(const basic_string_builder& other)
+	{
+		if (this != &other)
+		{
+			reset();
+			append(other.data(), other.size());
+		}
+		return *this;
+	}
+
+	// The allocator does not propagate. Heap memory is only stolen
+	// from a builder using an equal allocator.
+	basic_string_builder& operator=(basic_string_builder&& other)
+	{
+		if (this != &other)
+		{
+			if (m_allocator == other.m_allocator)
+			{
+				deallocate();
+				steal(other);
+			}
+			else
+			{
+				*this = static_cast<const basic_string_builder&>(other);
+			}
+		}
+		return *this;
+	}
+
+	allocator_type get_allocator() const { return m_allocator; }
+
+	char* data() noexcept { return m_data; }
+	const char* data() const noexcept { return m_data; }
+	size_type size() const noexcept { return m_size; }
+	size_type length() const noexcept { return m_size; }
+	size_type capacity() const noexcept { return m_capacity; }
+	bool empty() const noexcept { return m_size == 0; }
+
+	iterator begin() noexcept { return m_data; }
+	const_iterator begin() const noexcept { return m_data; }
+	iterator end() noexcept { return m_data + m_size; }
+	const_iterator end() const noexcept { return m_data + m_size; }
+
+	char& operator[](size_type index) { return m_data[index]; }
+	const char& operator[](size_type index) const { return m_data[index]; }
+
+	::std::string_view view() const noexcept
+	{
+		return ::std::string_view(m_data, m_size);
+	}
+
+	operator ::std::string_view() const noexcept
+	{
+		return view();
+	}
+
+	// The storage always has room for the terminating null.
+	const char* c_str() noexcept
+	{
+		m_data[m_size] = 0;
+		return m_data;
+	}
+
+	::std::string str() const
+	{
+		return ::std::string(m_data, m_size);
+	}
+
+	template <class String>
+	String str_as(const typename String::allocator_type& allocator = typename String::allocator_type()) const
+	{
+		return String(m_data, m_data + m_size, allocator);
+	}
+
+	// Empties the builder and keeps the capacity.
+	void reset() noexcept
+	{
+		m_size = 0;
+	}
+
+	void clear() noexcept
+	{
+		m_size = 0;
+	}
+
+	// Returns to the inline storage.
+	void release()
+	{
+		deallocate();
+		m_data = m_inline;
+		m_size = 0;
+		m_capacity = InlineSize - 1;
+	}
+
+	void reserve(size_type count)
+	{
+		if (count > m_capacity)
+		{
+			reallocate(count);
+		}
+	}
+
+	void resize(size_type count, char ch = 0)
+	{
+		if (count > m_size)
+		{
+			append(count - m_size, ch);
+		}
+		m_size = count;
+	}
+
+	void pop_back() noexcept
+	{
+		--m_size;
+	}
+
+	// Returns space for count characters, which become part of the text with commit().
+	char* prepare(size_type count)
+	{
+		reserve_for_growth(m_size + count);
+		return m_data + m_size;
+	}
+
+	void commit(size_type count) noexcept
+	{
+		m_size += count;
+	}
+
+	basic_string_builder& append(const char* str, size_type count)
+	{
+		if (m_size + count > m_capacity && str >= m_data && str < m_data + m_size)
+		{
+			const size_type offset = static_cast<size_type>(str - m_data);
+			reserve_for_growth(m_size + count);
+			str = m_data + offset;
+		}
+		else
+		{
+			reserve_for_growth(m_size + count);
+		}
+		::std::memcpy(m_data + m_size, str, count);
+		m_size += count;
+		return *this;
+	}
+
+	basic_string_builder& append(::std::string_view str)
+	{
+		return append(str.data(), str.size());
+	}
+
+	basic_string_builder& append(const char* str)
+	{
+		return append(str, ::std::strlen(str));
+	}
+
+	basic_string_builder& append(size_type count, char ch)
+	{
+		::std::memset(prepare(count), ch, count);
+		m_size += count;
+		return *this;
+	}
+
+	basic_string_builder& append(char ch)
+	{
+		if (m_size == m_capacity)
+		{
+			reserve_for_growth(m_size + 1);
+		}
+		m_data[m_size++] = ch;
+		return *this;
+	}
+
+	basic_string_builder& append(bool value)
+	{
+		return value ? append("true", 4) : append("false", 5);
+	}
+
+	template <class Number, class = typename ::std::enable_if<::std::is_arithmetic<Number>::value
+		&& !::std::is_same<Number, bool>::value && !::std::is_same<Number, char>::value>::type>
+	basic_string_builder& append(Number value)
+	{
+		using number_type = typename ::std::conditional<::std::is_same<Number, long double>::value, double, Number>::type;
+		char* const pos = prepare(40);
+		m_size += static_cast<size_type>(::stl::to_chars(pos, pos + 40, static_cast<number_type>(value)).ptr - pos);
+		return *this;
+	}
+
+	// Appends {} formatted text, see format.h.
+	template <class Format, class... Args, class = internal::enable_if_format<Format>>
+	basic_string_builder& append_format(Format fmt, const Args&... args)
+	{
+		format_buffer out(m_data, m_size, m_capacity, &basic_string_builder::grow_format_buffer, this);
+		::stl::format_to(out, fmt, args...);
+		m_size = out.size();
+		return *this;
+	}
+
+	// Appends printf formatted text, using the spare capacity first.
+	template <class... Args>
+	basic_string_builder& append_printf(const char* format, Args... args)
+	{
+		const size_type space = m_capacity - m_size;
+		const int n = ::stl::nprintf(m_data + m_size, space + 1, format, args...);
+		if (n < 0)
+		{
+			throw ::std::invalid_argument("Encoding error occured");
+		}
+		if (static_cast<size_type>(n) > space)
+		{
+			reserve_for_growth(m_size + static_cast<size_type>(n));
+			::stl::nprintf(m_data + m_size, static_cast<size_type>(n) + 1, format, args...);
+		}
+		m_size += static_cast<size_type>(n);
+		return *this;
+	}
+
+	template <class Type>
+	basic_string_builder& operator<<(const Type& value)
+	{
+		return append(value);
+	}
+
+	// Both return false if not all characters were written.
+	bool write_to(::std::ostream& stream) const
+	{
+		return static_cast<bool>(stream.write(m_data, static_cast<::std::streamsize>(m_size)));
+	}
+
+	bool write_to(::std::FILE* file) const
+	{
+		return ::std::fwrite(m_data, 1, m_size, file) == m_size;
+	}
+
+private:
+	bool is_inline() const noexcept
+	{
+		return m_data == m_inline;
+	}
+
+	void steal(basic_string_builder& other) noexcept
+	{
+		if (other.is_inline())
+		{
+			::std::memcpy(m_inline, other.m_inline, other.m_size);
+			m_data = m_inline;
+			m_capacity = InlineSize - 1;
+		}
+		else
+		{
+			m_data = other.m_data;
+			m_capacity = other.m_capacity;
+			other.m_data = other.m_inline;
+			other.m_capacity = InlineSize - 1;
+		}
+		m_size = other.m_size;
+		other.m_size = 0;
+	}
+
+	void reserve_for_growth(size_type count)
+	{
+		if (count > m_capacity)
+		{
+			reallocate(::std::max(count, m_capacity * 2 + 1));
+		}
+	}
+
+	void reallocate(size_type capacity)
+	{
+		char* data = allocator_traits::allocate(m_allocator, capacity + 1);
+		::std::memcpy(data, m_data, m_size);
+		deallocate();
+		m_data = data;
+		m_capacity = capacity;
+	}
+
+	void deallocate() noexcept
+	{
+		if (!is_inline())
+		{
+			allocator_traits::deallocate(m_allocator, m_data, m_capacity + 1);
+		}
+	}
+
+	static void grow_format_buffer(format_buffer& buffer, size_t required)
+	{
+		basic_string_builder& builder = *static_cast<basic_string_builder*>(buffer.context());
+		builder.m_size = buffer.size();
+		builder.reserve_for_growth(builder.m_size + required);
+		buffer.reset(builder.m_data, builder.m_capacity);
+	}
+
+	allocator_type m_allocator;
+	char* m_data = m_inline;
+	size_type m_size = 0;
+	size_type m_capacity = InlineSize - 1;
+	char m_inline[InlineSize];
+};
+
+using string_builder = basic_string_builder<>;
+
+template <size_t InlineSize, class Allocator>
+inline ::std::ostream& operator<<(::std::ostream& stream, const basic_string_builder<InlineSize, Allocator>& builder)
+{
+	return stream.write(builder.data(), static_cast<::std::streamsize>(builder.size()));
+}
+
+} // namespace stl
@@ -4,6 +4,7 @@
 #include <chrono>
 #include <string>
 #include <memory>
+#include <utility>
 #include <iostream>
 #include <common/stl.h>
 
@@ -11,6 +12,7 @@ namespace util {
 
 class time_counter_default_printer
 {
+public:
 	void print(const ::std::chrono::nanoseconds&) {}
 };
 
@@ -24,38 +26,92 @@ public:
 	{
 		rep ns = time.count();
 		double elapsedSeconds = static_cast<double>(ns) / 1000000000.0;
-		double elapsedMilliseconds = static_cast<double>(ns) / 1000.0;
+		double elapsedMilliseconds = static_cast<double>(ns) / 1000000.0;
 		::std::cout << ::stl::string_format("Elapsed time in seconds: [%.3f] in milliseconds: [%.3f]",
 			elapsedSeconds, elapsedMilliseconds).c_str() << ::std::endl;
 	}
 };
 
-template <class TimeUnit, class Printer = time_counter_stdout_printer>
+// Clock policy of time_counter. Clocks other than std::chrono clocks
+// specialize it, see tsc_clock.h.
+template <class Clock>
+struct clock_traits
+{
+	using time_point = typename Clock::time_point;
+
+	static time_point now() noexcept
+	{
+		return Clock::now();
+	}
+
+	static time_point now_stop() noexcept
+	{
+		return Clock::now();
+	}
+
+	template <class TimeUnit>
+	static TimeUnit elapsed(time_point start, time_point stop) noexcept
+	{
+		return ::std::chrono::duration_cast<TimeUnit>(stop - start);
+	}
+};
+
+namespace internal {
+
+// Printers with an on_start() member are notified when a measurement starts.
+template <class Printer>
+inline auto notify_start(Printer& printer, int) -> decltype(printer.on_start(), void())
+{
+	printer.on_start();
+}
+
+template <class Printer>
+inline void notify_start(Printer&, long)
+{
+}
+
+} // namespace internal
+
+template <class TimeUnit, class Printer = time_counter_stdout_printer, class Clock = ::std::chrono::steady_clock>
 class time_counter : public Printer
 {
 public:
 	using time_unit = TimeUnit;
-	using time_point = ::std::chrono::time_point<::std::chrono::steady_clock>;
-	using clock = ::std::chrono::high_resolution_clock;
-	using duration = typename time_point::duration;
+	using clock = Clock;
+	using traits = clock_traits<clock>;
+	using time_point = typename traits::time_point;
 	using rep = typename time_unit::rep;
 
 	time_counter()
-		: m_startTime(clock::now())
+		: m_startTime(traits::now())
 		, m_stopTime(time_point())
-	{}
+	{
+		internal::notify_start<Printer>(*this, 0);
+		m_startTime = traits::now();
+	}
+
+	// Starts with the given printer, e.g. one recording into a shared histogram.
+	explicit time_counter(Printer printer)
+		: Printer(::std::move(printer))
+		, m_startTime(traits::now())
+		, m_stopTime(time_point())
+	{
+		internal::notify_start<Printer>(*this, 0);
+		m_startTime = traits::now();
+	}
 
 	inline void start()
 	{
-		m_startTime = clock::now();
+		internal::notify_start<Printer>(*this, 0);
+		m_startTime = traits::now();
 		m_stopTime = time_point();
 	}
 
 	inline time_unit stop()
 	{
-		m_stopTime = clock::now();
+		m_stopTime = traits::now_stop();
 		time_unit elapsedTime = getElapsedTime();
-		print(::std::chrono::duration_cast<::std::chrono::nanoseconds>(elapsedTime));
+		this->print(::std::chrono::duration_cast<::std::chrono::nanoseconds>(elapsedTime));
 		return elapsedTime;
 	}
 
@@ -69,8 +125,8 @@ public:
 	inline time_unit getElapsedTime()
 	{
 		bool wasStopped = (m_stopTime != time_point());
-		time_point stopTime = wasStopped ? m_stopTime : clock::now();
-		return ::std::chrono::duration_cast<time_unit, rep>(stopTime - m_startTime);
+		time_point stopTime = wasStopped ? m_stopTime : traits::now_stop();
+		return traits::template elapsed<time_unit>(m_startTime, stopTime);
 	}
 
 private:
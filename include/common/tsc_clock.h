@@ -0,0 +1,168 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <common/time_counter.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define COMMON_TSC_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#else
+#define COMMON_TSC_X86 0
+#endif
+
+namespace util {
+
+// Clock reading the time stamp counter. Ticks are converted to nanoseconds only
+// when an elapsed time is requested, using a frequency calibrated once against
+// steady_clock. Without an invariant TSC the clock reads steady_clock instead,
+// with one tick per nanosecond.
+
+class tsc_clock
+{
+public:
+	using time_point = uint64_t;
+
+	static time_point now() noexcept
+	{
+#if COMMON_TSC_X86
+		if (calibration().invariant)
+		{
+			return __rdtsc();
+		}
+#endif
+		return steady_ticks();
+	}
+
+	// Waits for all previous instructions before reading the counter.
+	static time_point now_serialized() noexcept
+	{
+#if COMMON_TSC_X86
+		if (calibration().invariant)
+		{
+			unsigned int aux;
+			return __rdtscp(&aux);
+		}
+#endif
+		return steady_ticks();
+	}
+
+	static bool is_invariant() noexcept
+	{
+		return calibration().invariant;
+	}
+
+	static double ticks_per_nanosecond() noexcept
+	{
+		return calibration().ticksPerNanosecond;
+	}
+
+	static ::std::chrono::nanoseconds to_nanoseconds(uint64_t ticks) noexcept
+	{
+		return ::std::chrono::nanoseconds(static_cast<int64_t>(static_cast<double>(ticks) / ticks_per_nanosecond()));
+	}
+
+	// Calibrates on first use. Call at startup to keep the calibration
+	// time out of the first measurement.
+	static void calibrate() noexcept
+	{
+		calibration();
+	}
+
+private:
+	struct calibration_data
+	{
+		bool invariant;
+		double ticksPerNanosecond;
+	};
+
+	static uint64_t steady_ticks() noexcept
+	{
+		return static_cast<uint64_t>(::std::chrono::duration_cast<::std::chrono::nanoseconds>(
+			::std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	static bool detect_invariant_tsc() noexcept
+	{
+#if COMMON_TSC_X86
+		// CPUID.80000007H:EDX[8] reports an invariant TSC.
+		unsigned int regs[4] = {};
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0x80000000);
+		if (static_cast<unsigned int>(info[0]) < 0x80000007u)
+		{
+			return false;
+		}
+		__cpuid(info, 0x80000007);
+		regs[3] = static_cast<unsigned int>(info[3]);
+#else
+		if (__get_cpuid_max(0x80000000u, nullptr) < 0x80000007u)
+		{
+			return false;
+		}
+		__get_cpuid(0x80000007u, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+		return (regs[3] & (1u << 8)) != 0;
+#else
+		return false;
+#endif
+	}
+
+	static calibration_data calibrate_tsc() noexcept
+	{
+		calibration_data data = { detect_invariant_tsc(), 1.0 };
+#if COMMON_TSC_X86
+		if (data.invariant)
+		{
+			using steady_clock = ::std::chrono::steady_clock;
+			const steady_clock::time_point start = steady_clock::now();
+			const uint64_t startTicks = __rdtsc();
+			steady_clock::time_point stop;
+			do {
+				stop = steady_clock::now();
+			} while (stop - start < ::std::chrono::milliseconds(10));
+			const uint64_t stopTicks = __rdtsc();
+			const auto ns = ::std::chrono::duration_cast<::std::chrono::nanoseconds>(stop - start).count();
+			data.ticksPerNanosecond = static_cast<double>(stopTicks - startTicks) / static_cast<double>(ns);
+		}
+#endif
+		return data;
+	}
+
+	static const calibration_data& calibration() noexcept
+	{
+		static const calibration_data s_data = calibrate_tsc();
+		return s_data;
+	}
+};
+
+template <>
+struct clock_traits<tsc_clock>
+{
+	using time_point = tsc_clock::time_point;
+
+	static time_point now() noexcept
+	{
+		return tsc_clock::now();
+	}
+
+	static time_point now_stop() noexcept
+	{
+		return tsc_clock::now_serialized();
+	}
+
+	template <class TimeUnit>
+	static TimeUnit elapsed(time_point start, time_point stop) noexcept
+	{
+		const double ns = static_cast<double>(stop - start) / tsc_clock::ticks_per_nanosecond();
+		return ::std::chrono::duration_cast<TimeUnit>(::std::chrono::duration<double, ::std::nano>(ns));
+	}
+};
+
+} // namespace util
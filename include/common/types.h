@@ -26,6 +26,7 @@ typedef struct uint64
 
 typedef void* alloc_func;
 typedef void* free_func;
+typedef void* realloc_func;
 
 #else
 #ifdef MQL4
@@ -40,8 +41,9 @@ typedef void* free_func;
 #define uint64_t ulong
 #define size_t   uint32_t
 
-typedef void* (* alloc_func)(size_t count, size_t size);
-typedef void  (* free_func )(void* ptr, size_t count, size_t size);
+typedef void* (* alloc_func  )(size_t count, size_t size);
+typedef void  (* free_func   )(void* ptr, size_t count, size_t size);
+typedef void* (* realloc_func)(void* ptr, size_t oldCount, size_t newCount, size_t size);
 
 #else
 
@@ -53,8 +55,25 @@ typedef void  (* free_func )(void* ptr, size_t count, size_t size);
 #include <stdint.h>
 #endif // __cplusplus
 
-typedef void* (__cdecl* alloc_func)(size_t count, size_t size);
-typedef void  (__cdecl* free_func )(void* ptr, size_t count, size_t size);
+typedef void* (__cdecl* alloc_func  )(size_t count, size_t size);
+typedef void  (__cdecl* free_func   )(void* ptr, size_t count, size_t size);
+
+// Optional resize function. Returns the resized block, which may have moved,
+// or null if the block cannot be resized. On null the original block is untouched.
+typedef void* (__cdecl* realloc_func)(void* ptr, size_t oldCount, size_t newCount, size_t size);
+
+// Allocator functions with a user context pointer for per-instance heaps.
+typedef void* (__cdecl* alloc_ctx_func  )(void* ctx, size_t count, size_t size);
+typedef void  (__cdecl* free_ctx_func   )(void* ctx, void* ptr, size_t count, size_t size);
+typedef void* (__cdecl* realloc_ctx_func)(void* ctx, void* ptr, size_t oldCount, size_t newCount, size_t size);
+
+typedef struct allocator_context
+{
+	void* ctx;
+	alloc_ctx_func alloc;
+	free_ctx_func free;
+	realloc_ctx_func realloc; // optional, may be null
+} allocator_context;
 
 #ifdef __cplusplus
 #include <gsl/pointers>
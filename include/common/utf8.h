@@ -1,81 +1,929 @@
 
 #pragma once
 
-#include <codecvt>
 #include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COMMON_UTF8_SSE2 1
+#include <emmintrin.h>
+#else
+#define COMMON_UTF8_SSE2 0
+#endif
+
+#if COMMON_UTF8_SSE2 && defined(__AVX2__)
+#define COMMON_UTF8_AVX2 1
+#include <immintrin.h>
+#else
+#define COMMON_UTF8_AVX2 0
+#endif
+
+// UTF-8 to and from UTF-16 and UTF-32 without locale facets or allocations
+// besides the result. Input is validated strictly: truncated sequences, stray
+// continuation bytes, overlong forms, encoded surrogates, code points above
+// U+10FFFF and unpaired UTF-16 surrogates are errors. Runs of ASCII are
+// converted 32 (AVX2) or 16 (SSE2) characters at a time, other characters
+// one code point at a time.
+//
+// The convert functions write to caller memory and report the position of
+// the first invalid input unit. convert_into stops at a full output buffer,
+// the length functions give the exact output size of valid input without
+// converting and append converts into the spare capacity of a string, so
+// buffers can be sized once and reused. The to_ functions return strings and throw
+// std::range_error like wstring_convert did. wchar_t strings are UTF-16 where
+// wchar_t has 16 bits and UTF-32 otherwise, except that to_ucs2 rejects code
+// points above U+FFFF on 16 bit wchar_t.
 
 namespace utf8 {
 
+enum class error
+{
+	none,
+	truncated,    // the input ends inside a sequence
+	invalid_byte, // continuation byte without a lead byte or byte never used in UTF-8
+	overlong,     // code point encoded with more bytes than needed
+	surrogate,    // encoded surrogate code point or unpaired UTF-16 surrogate
+	too_large,    // above U+10FFFF, or above U+FFFF for UCS-2
+	no_space      // the output is full, position is where to continue
+};
+
+struct result
+{
+	error status;
+	size_t position; // input units read, or position of the first invalid unit
+	size_t written;  // output units written
+
+	explicit operator bool() const noexcept
+	{
+		return status == error::none;
+	}
+};
+
+inline const char* error_message(error status) noexcept
+{
+	switch (status)
+	{
+	case error::none:
+		return "no error";
+	case error::truncated:
+		return "truncated sequence";
+	case error::invalid_byte:
+		return "invalid byte";
+	case error::overlong:
+		return "overlong sequence";
+	case error::surrogate:
+		return "surrogate code point";
+	case error::too_large:
+		return "code point out of range";
+	case error::no_space:
+		return "output buffer too small";
+	}
+	return "unknown error";
+}
+
+namespace internal {
+
+template <class Char>
+constexpr bool is_utf16() noexcept
+{
+	return sizeof(Char) == 2;
+}
+
+// Length of the longest prefix of whole blocks of ASCII, widened to out.
+template <class Char>
+inline size_t widen_ascii(const char* in, size_t size, Char* out) noexcept
+{
+	size_t i = 0;
+#if COMMON_UTF8_AVX2
+	for (; i + 32 <= size; i += 32)
+	{
+		const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+		if (_mm256_movemask_epi8(bytes) != 0)
+		{
+			break;
+		}
+		const __m128i low = _mm256_castsi256_si128(bytes);
+		const __m128i high = _mm256_extracti128_si256(bytes, 1);
+		__m256i* const dst = reinterpret_cast<__m256i*>(out + i);
+		if constexpr (is_utf16<Char>())
+		{
+			_mm256_storeu_si256(dst, _mm256_cvtepu8_epi16(low));
+			_mm256_storeu_si256(dst + 1, _mm256_cvtepu8_epi16(high));
+		}
+		else
+		{
+			_mm256_storeu_si256(dst, _mm256_cvtepu8_epi32(low));
+			_mm256_storeu_si256(dst + 1, _mm256_cvtepu8_epi32(_mm_srli_si128(low, 8)));
+			_mm256_storeu_si256(dst + 2, _mm256_cvtepu8_epi32(high));
+			_mm256_storeu_si256(dst + 3, _mm256_cvtepu8_epi32(_mm_srli_si128(high, 8)));
+		}
+	}
+#elif COMMON_UTF8_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= size; i += 16)
+	{
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		if (_mm_movemask_epi8(bytes) != 0)
+		{
+			break;
+		}
+		const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+		const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+		__m128i* const dst = reinterpret_cast<__m128i*>(out + i);
+		if constexpr (is_utf16<Char>())
+		{
+			_mm_storeu_si128(dst, low);
+			_mm_storeu_si128(dst + 1, high);
+		}
+		else
+		{
+			_mm_storeu_si128(dst, _mm_unpacklo_epi16(low, zero));
+			_mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(low, zero));
+			_mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(high, zero));
+			_mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(high, zero));
+		}
+	}
+#else
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		::std::memcpy(&word, in + i, sizeof(word));
+		if ((word & 0x8080808080808080ull) != 0)
+		{
+			break;
+		}
+		for (size_t k = 0; k < 8; ++k)
+		{
+			out[i + k] = static_cast<Char>(in[i + k]);
+		}
+	}
+#endif
+	return i;
+}
+
+// Length of the longest prefix of whole blocks of ASCII, narrowed to out.
+template <class Char>
+inline size_t narrow_ascii(const Char* in, size_t size, char* out) noexcept
+{
+	size_t i = 0;
+#if COMMON_UTF8_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	if constexpr (is_utf16<Char>())
+	{
+#if COMMON_UTF8_AVX2
+		const __m256i mask = _mm256_set1_epi16(static_cast<short>(0xff80));
+		for (; i + 32 <= size; i += 32)
+		{
+			const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+			const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 16));
+			if (!_mm256_testz_si256(_mm256_or_si256(a, b), mask))
+			{
+				break;
+			}
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+		}
+#else
+		const __m128i mask = _mm_set1_epi16(static_cast<short>(0xff80));
+		for (; i + 16 <= size; i += 16)
+		{
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 8));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(_mm_or_si128(a, b), mask), zero)) != 0xffff)
+			{
+				break;
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(a, b));
+		}
+#endif
+	}
+	else
+	{
+		const __m128i mask = _mm_set1_epi32(static_cast<int>(0xffffff80));
+		for (; i + 16 <= size; i += 16)
+		{
+			const __m128i* const src = reinterpret_cast<const __m128i*>(in + i);
+			const __m128i a = _mm_loadu_si128(src);
+			const __m128i b = _mm_loadu_si128(src + 1);
+			const __m128i c = _mm_loadu_si128(src + 2);
+			const __m128i d = _mm_loadu_si128(src + 3);
+			const __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(any, mask), zero)) != 0xffff)
+			{
+				break;
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+		}
+	}
+#else
+	(void)in;
+	(void)size;
+	(void)out;
+#endif
+	return i;
+}
+
+// Counts the bytes that start a sequence and, with Long, also the 4 byte leads.
+template <bool Long>
+inline size_t count_leads(const char* in, size_t size) noexcept
+{
+	const unsigned char* const bytes = reinterpret_cast<const unsigned char*>(in);
+	size_t count = 0;
+	size_t i = 0;
+#if COMMON_UTF8_SSE2
+	// Matches are counted in bytes, summed up before they can overflow.
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i continuation = _mm_set1_epi8(-65);
+	const __m128i longLead = _mm_set1_epi8(static_cast<char>(0xf0));
+	__m128i total = zero;
+	while (i + 16 <= size)
+	{
+		const size_t blocks = ::std::min<size_t>((size - i) / 16, 127);
+		__m128i counts = zero;
+		for (size_t block = 0; block < blocks; ++block, i += 16)
+		{
+			const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			counts = _mm_sub_epi8(counts, _mm_cmpgt_epi8(data, continuation));
+			if (Long)
+			{
+				counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(_mm_max_epu8(data, longLead), data));
+			}
+		}
+		total = _mm_add_epi64(total, _mm_sad_epu8(counts, zero));
+	}
+	alignas(16) uint64_t lanes[2];
+	_mm_store_si128(reinterpret_cast<__m128i*>(lanes), total);
+	count = static_cast<size_t>(lanes[0] + lanes[1]);
+#endif
+	for (; i < size; ++i)
+	{
+		count += ((bytes[i] & 0xc0) != 0x80) + (Long && bytes[i] >= 0xf0);
+	}
+	return count;
+}
+
+inline bool is_continuation(unsigned char byte) noexcept
+{
+	return (byte & 0xc0) == 0x80;
+}
+
+// Decodes the sequence at in[i] and advances i past it.
+inline error decode(const unsigned char* in, size_t size, size_t& i, char32_t& codePoint) noexcept
+{
+	const unsigned char lead = in[i];
+	if (lead < 0x80)
+	{
+		codePoint = lead;
+		++i;
+		return error::none;
+	}
+	size_t length;
+	if (lead < 0xc0)
+	{
+		return error::invalid_byte;
+	}
+	else if (lead < 0xe0)
+	{
+		length = 2;
+		codePoint = lead & 0x1f;
+	}
+	else if (lead < 0xf0)
+	{
+		length = 3;
+		codePoint = lead & 0x0f;
+	}
+	else if (lead < 0xf8)
+	{
+		length = 4;
+		codePoint = lead & 0x07;
+	}
+	else
+	{
+		return error::invalid_byte;
+	}
+	const size_t available = (size - i < length) ? size - i : length;
+	for (size_t k = 1; k < available; ++k)
+	{
+		if (!is_continuation(in[i + k]))
+		{
+			return error::truncated;
+		}
+		codePoint = (codePoint << 6) | (in[i + k] & 0x3f);
+	}
+	if (available < length)
+	{
+		return error::truncated;
+	}
+	static constexpr char32_t minimum[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+	if (codePoint < minimum[length])
+	{
+		return error::overlong;
+	}
+	if (codePoint >= 0xd800 && codePoint <= 0xdfff)
+	{
+		return error::surrogate;
+	}
+	if (codePoint > 0x10ffff)
+	{
+		return error::too_large;
+	}
+	i += length;
+	return error::none;
+}
+
+inline size_t encode(char32_t codePoint, char* out) noexcept
+{
+	if (codePoint < 0x80)
+	{
+		out[0] = static_cast<char>(codePoint);
+		return 1;
+	}
+	if (codePoint < 0x800)
+	{
+		out[0] = static_cast<char>(0xc0 | (codePoint >> 6));
+		out[1] = static_cast<char>(0x80 | (codePoint & 0x3f));
+		return 2;
+	}
+	if (codePoint < 0x10000)
+	{
+		out[0] = static_cast<char>(0xe0 | (codePoint >> 12));
+		out[1] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+		out[2] = static_cast<char>(0x80 | (codePoint & 0x3f));
+		return 3;
+	}
+	out[0] = static_cast<char>(0xf0 | (codePoint >> 18));
+	out[1] = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3f));
+	out[2] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+	out[3] = static_cast<char>(0x80 | (codePoint & 0x3f));
+	return 4;
+}
+
+// Ucs2 rejects code points that need a surrogate pair.
+template <class Char, bool Ucs2 = false>
+inline result utf8_to_utf16(const char* in, size_t size, Char* out) noexcept
+{
+	const unsigned char* const bytes = reinterpret_cast<const unsigned char*>(in);
+	size_t i = 0;
+	size_t o = 0;
+	while (i < size)
+	{
+		if (bytes[i] < 0x80)
+		{
+			const size_t n = widen_ascii(in + i, size - i, out + o);
+			i += n;
+			o += n;
+			if (n == 0)
+			{
+				out[o++] = static_cast<Char>(bytes[i++]);
+			}
+			continue;
+		}
+		char32_t codePoint;
+		const error status = decode(bytes, size, i, codePoint);
+		if (status != error::none)
+		{
+			return { status, i, o };
+		}
+		if (codePoint < 0x10000)
+		{
+			out[o++] = static_cast<Char>(codePoint);
+		}
+		else if (Ucs2)
+		{
+			return { error::too_large, i - 4, o };
+		}
+		else
+		{
+			codePoint -= 0x10000;
+			out[o++] = static_cast<Char>(0xd800 + (codePoint >> 10));
+			out[o++] = static_cast<Char>(0xdc00 + (codePoint & 0x3ff));
+		}
+	}
+	return { error::none, i, o };
+}
+
+template <class Char>
+inline result utf8_to_utf32(const char* in, size_t size, Char* out) noexcept
+{
+	const unsigned char* const bytes = reinterpret_cast<const unsigned char*>(in);
+	size_t i = 0;
+	size_t o = 0;
+	while (i < size)
+	{
+		if (bytes[i] < 0x80)
+		{
+			const size_t n = widen_ascii(in + i, size - i, out + o);
+			i += n;
+			o += n;
+			if (n == 0)
+			{
+				out[o++] = static_cast<Char>(bytes[i++]);
+			}
+			continue;
+		}
+		char32_t codePoint;
+		const error status = decode(bytes, size, i, codePoint);
+		if (status != error::none)
+		{
+			return { status, i, o };
+		}
+		out[o++] = static_cast<Char>(codePoint);
+	}
+	return { error::none, i, o };
+}
+
+template <class Char>
+inline result utf16_to_utf8(const Char* in, size_t size, char* out) noexcept
+{
+	size_t i = 0;
+	size_t o = 0;
+	while (i < size)
+	{
+		const char32_t unit = static_cast<char16_t>(in[i]);
+		if (unit < 0x80)
+		{
+			const size_t n = narrow_ascii(in + i, size - i, out + o);
+			i += n;
+			o += n;
+			if (n == 0)
+			{
+				out[o++] = static_cast<char>(unit);
+				++i;
+			}
+			continue;
+		}
+		char32_t codePoint = unit;
+		if (unit >= 0xd800 && unit <= 0xdfff)
+		{
+			const char32_t next = (i + 1 < size) ? static_cast<char16_t>(in[i + 1]) : 0;
+			if (unit > 0xdbff || next < 0xdc00 || next > 0xdfff)
+			{
+				return { error::surrogate, i, o };
+			}
+			codePoint = 0x10000 + ((unit - 0xd800) << 10) + (next - 0xdc00);
+			++i;
+		}
+		o += encode(codePoint, out + o);
+		++i;
+	}
+	return { error::none, i, o };
+}
+
+template <class Char>
+inline result utf32_to_utf8(const Char* in, size_t size, char* out) noexcept
+{
+	size_t i = 0;
+	size_t o = 0;
+	while (i < size)
+	{
+		const char32_t codePoint = static_cast<char32_t>(in[i]);
+		if (codePoint < 0x80)
+		{
+			const size_t n = narrow_ascii(in + i, size - i, out + o);
+			i += n;
+			o += n;
+			if (n == 0)
+			{
+				out[o++] = static_cast<char>(codePoint);
+				++i;
+			}
+			continue;
+		}
+		if (codePoint >= 0xd800 && codePoint <= 0xdfff)
+		{
+			return { error::surrogate, i, o };
+		}
+		if (codePoint > 0x10ffff)
+		{
+			return { error::too_large, i, o };
+		}
+		o += encode(codePoint, out + o);
+		++i;
+	}
+	return { error::none, i, o };
+}
+
+[[noreturn]] inline void throw_error(const result& r, const char* encoding)
+{
+	throw ::std::range_error(::std::string("Invalid ") + encoding + " at position "
+		+ ::std::to_string(r.position) + ": " + error_message(r.status));
+}
+
+template <class String, class Convert>
+inline String convert_string(size_t capacity, const char* encoding, Convert convert)
+{
+	String out;
+	out.resize(capacity);
+	const result r = convert(&out[0]);
+	if (!r)
+	{
+		throw_error(r, encoding);
+	}
+	out.resize(r.written);
+	return out;
+}
+
+} // namespace internal
+
+// Checks that the input is valid UTF-8.
+inline result validate(const char* in, size_t size) noexcept
+{
+	const unsigned char* const bytes = reinterpret_cast<const unsigned char*>(in);
+	size_t i = 0;
+	while (i < size)
+	{
+		if (bytes[i] < 0x80)
+		{
+			size_t n = 0;
+#if COMMON_UTF8_SSE2
+			while (i + n + 16 <= size && _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + n))) == 0)
+			{
+				n += 16;
+			}
+#endif
+			i += (n != 0) ? n : 1;
+			continue;
+		}
+		char32_t codePoint;
+		const error status = internal::decode(bytes, size, i, codePoint);
+		if (status != error::none)
+		{
+			return { status, i, 0 };
+		}
+	}
+	return { error::none, i, 0 };
+}
+
+// UTF-8 to UTF-16, out needs room for size units.
+inline result convert(const char* in, size_t size, char16_t* out) noexcept
+{
+	return internal::utf8_to_utf16(in, size, out);
+}
+
+// UTF-8 to UTF-32, out needs room for size units.
+inline result convert(const char* in, size_t size, char32_t* out) noexcept
+{
+	return internal::utf8_to_utf32(in, size, out);
+}
+
+inline result convert(const char* in, size_t size, wchar_t* out) noexcept
+{
+	if constexpr (internal::is_utf16<wchar_t>())
+		return internal::utf8_to_utf16(in, size, out);
+	else
+		return internal::utf8_to_utf32(in, size, out);
+}
+
+// UTF-16 to UTF-8, out needs room for 3 * size bytes.
+inline result convert(const char16_t* in, size_t size, char* out) noexcept
+{
+	return internal::utf16_to_utf8(in, size, out);
+}
+
+// UTF-32 to UTF-8, out needs room for 4 * size bytes.
+inline result convert(const char32_t* in, size_t size, char* out) noexcept
+{
+	return internal::utf32_to_utf8(in, size, out);
+}
+
+inline result convert(const wchar_t* in, size_t size, char* out) noexcept
+{
+	if constexpr (internal::is_utf16<wchar_t>())
+		return internal::utf16_to_utf8(in, size, out);
+	else
+		return internal::utf32_to_utf8(in, size, out);
+}
+
+// Output lengths of valid input, invalid input is reported by the conversion.
+
+inline size_t utf16_length(const char* begin, const char* end) noexcept
+{
+	return internal::count_leads<true>(begin, static_cast<size_t>(end - begin));
+}
+
+inline size_t utf32_length(const char* begin, const char* end) noexcept
+{
+	return internal::count_leads<false>(begin, static_cast<size_t>(end - begin));
+}
+
+inline size_t wchar_length(const char* begin, const char* end) noexcept
+{
+	return internal::is_utf16<wchar_t>() ? utf16_length(begin, end) : utf32_length(begin, end);
+}
+
+inline size_t utf8_length(const char16_t* begin, const char16_t* end) noexcept
+{
+	size_t length = 0;
+	for (; begin != end; ++begin)
+	{
+		const uint32_t unit = *begin;
+		length += 1 + (unit >= 0x80) + ((unit >= 0x800) & ((unit - 0xd800) >= 0x800));
+	}
+	return length;
+}
+
+inline size_t utf8_length(const char32_t* begin, const char32_t* end) noexcept
+{
+	size_t length = 0;
+	for (; begin != end; ++begin)
+	{
+		const uint32_t codePoint = *begin;
+		length += 1 + (codePoint >= 0x80) + (codePoint >= 0x800) + (codePoint >= 0x10000);
+	}
+	return length;
+}
+
+inline size_t utf8_length(const wchar_t* begin, const wchar_t* end) noexcept
+{
+	if constexpr (internal::is_utf16<wchar_t>())
+		return utf8_length(reinterpret_cast<const char16_t*>(begin), reinterpret_cast<const char16_t*>(end));
+	else
+		return utf8_length(reinterpret_cast<const char32_t*>(begin), reinterpret_cast<const char32_t*>(end));
+}
+
+namespace internal {
+
+// Length of the sequence starting at in[0], at most size.
+inline size_t sequence_length(const char* in, size_t size) noexcept
+{
+	const unsigned char lead = static_cast<unsigned char>(in[0]);
+	const size_t length = (lead < 0xc0) ? 1 : (lead < 0xe0) ? 2 : (lead < 0xf0) ? 3 : 4;
+	return (length < size) ? length : size;
+}
+
+inline size_t sequence_length(const char16_t* in, size_t size) noexcept
+{
+	return (size > 1 && in[0] >= 0xd800 && in[0] <= 0xdbff) ? 2 : 1;
+}
+
+inline size_t sequence_length(const char32_t*, size_t) noexcept
+{
+	return 1;
+}
+
+inline size_t sequence_length(const wchar_t* in, size_t size) noexcept
+{
+	if constexpr (is_utf16<wchar_t>())
+		return sequence_length(reinterpret_cast<const char16_t*>(in), size);
+	else
+		return 1;
+}
+
+// Moves end back to the start of the sequence it points into.
+inline size_t sequence_start(const char* in, size_t begin, size_t end) noexcept
+{
+	while (end > begin && is_continuation(static_cast<unsigned char>(in[end])))
+	{
+		--end;
+	}
+	return end;
+}
+
+template <class Char>
+inline size_t sequence_start(const Char* in, size_t begin, size_t end) noexcept
+{
+	if constexpr (is_utf16<Char>())
+	{
+		if (end > begin && in[end - 1] >= 0xd800 && in[end - 1] <= 0xdbff)
+		{
+			--end;
+		}
+	}
+	return end;
+}
+
+// Converts the single sequence in [in, in + size) with the scalar helpers,
+// the vector paths of convert store whole blocks.
+template <class Out>
+inline result convert_sequence(const char* in, size_t size, Out* out) noexcept
+{
+	size_t i = 0;
+	char32_t codePoint;
+	const error status = decode(reinterpret_cast<const unsigned char*>(in), size, i, codePoint);
+	if (status != error::none)
+	{
+		return { status, i, 0 };
+	}
+	if (!is_utf16<Out>() || codePoint < 0x10000)
+	{
+		out[0] = static_cast<Out>(codePoint);
+		return { error::none, i, 1 };
+	}
+	codePoint -= 0x10000;
+	out[0] = static_cast<Out>(0xd800 + (codePoint >> 10));
+	out[1] = static_cast<Out>(0xdc00 + (codePoint & 0x3ff));
+	return { error::none, i, 2 };
+}
+
+template <class In>
+inline result convert_sequence(const In* in, size_t size, char* out) noexcept
+{
+	char32_t codePoint = static_cast<char32_t>(in[0]);
+	size_t length = 1;
+	if (is_utf16<In>())
+	{
+		codePoint = static_cast<char16_t>(in[0]);
+		if (codePoint >= 0xd800 && codePoint <= 0xdfff)
+		{
+			const char32_t next = (size > 1) ? static_cast<char16_t>(in[1]) : 0;
+			if (codePoint > 0xdbff || next < 0xdc00 || next > 0xdfff)
+			{
+				return { error::surrogate, 0, 0 };
+			}
+			codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (next - 0xdc00);
+			length = 2;
+		}
+	}
+	else if (codePoint >= 0xd800 && codePoint <= 0xdfff)
+	{
+		return { error::surrogate, 0, 0 };
+	}
+	else if (codePoint > 0x10ffff)
+	{
+		return { error::too_large, 0, 0 };
+	}
+	return { error::none, length, encode(codePoint, out) };
+}
+
+// Converts chunks that fit the output in the worst case, ending on sequence
+// boundaries, and the last code points through a small buffer.
+template <class In, class Out>
+inline result convert_into(const In* in, size_t size, Out* out, size_t capacity, size_t ratio) noexcept
+{
+	size_t i = 0;
+	size_t o = 0;
+	while (i < size)
+	{
+		size_t end = i + ::std::min(size - i, (capacity - o) / ratio);
+		if (end < size)
+		{
+			end = sequence_start(in, i, end);
+		}
+		if (end == i)
+		{
+			Out buffer[4];
+			const size_t length = sequence_length(in + i, size - i);
+			const result r = convert_sequence(in + i, length, buffer);
+			if (!r)
+			{
+				return { r.status, i + r.position, o };
+			}
+			if (r.written > capacity - o)
+			{
+				return { error::no_space, i, o };
+			}
+			::std::memcpy(out + o, buffer, r.written * sizeof(Out));
+			i += length;
+			o += r.written;
+			continue;
+		}
+		const result r = convert(in + i, end - i, out + o);
+		if (!r)
+		{
+			return { r.status, i + r.position, o + r.written };
+		}
+		i = end;
+		o += r.written;
+	}
+	return { error::none, i, o };
+}
+
+} // namespace internal
+
+// Checked conversions, writing at most capacity units. If the output is
+// full the result is error::no_space with the position to continue from.
+
+inline result convert_into(const char* in, size_t size, char16_t* out, size_t capacity) noexcept
+{
+	return internal::convert_into(in, size, out, capacity, 1);
+}
+
+inline result convert_into(const char* in, size_t size, char32_t* out, size_t capacity) noexcept
+{
+	return internal::convert_into(in, size, out, capacity, 1);
+}
+
+inline result convert_into(const char* in, size_t size, wchar_t* out, size_t capacity) noexcept
+{
+	return internal::convert_into(in, size, out, capacity, 1);
+}
+
+inline result convert_into(const char16_t* in, size_t size, char* out, size_t capacity) noexcept
+{
+	return internal::convert_into(in, size, out, capacity, 3);
+}
+
+inline result convert_into(const char32_t* in, size_t size, char* out, size_t capacity) noexcept
+{
+	return internal::convert_into(in, size, out, capacity, 4);
+}
+
+inline result convert_into(const wchar_t* in, size_t size, char* out, size_t capacity) noexcept
+{
+	return internal::convert_into(in, size, out, capacity, internal::is_utf16<wchar_t>() ? 3 : 4);
+}
+
+// Appends the converted input to a string of char16_t, char32_t or wchar_t
+// for UTF-8 input, or to a string of char for UTF-16 or UTF-32 input. The
+// string grows by the exact length, so reserved capacity avoids allocations.
+// On error the string is left unchanged.
+template <class String, class Char>
+inline result append(String& out, const Char* begin, const Char* end)
+{
+	size_t length;
+	if constexpr (::std::is_same<Char, char>::value)
+		length = internal::is_utf16<typename String::value_type>() ? utf16_length(begin, end) : utf32_length(begin, end);
+	else
+		length = utf8_length(begin, end);
+	const size_t size = out.size();
+	out.resize(size + length);
+	const result r = convert_into(begin, static_cast<size_t>(end - begin), &out[0] + size, length);
+	out.resize(r ? size + r.written : size);
+	return r;
+}
+
+template <class String, class Traits, class Allocator>
+inline result append(String& out, const ::std::basic_string<char, Traits, Allocator>& in)
+{
+	return append(out, in.data(), in.data() + in.size());
+}
+
+inline ::std::u16string to_utf16(const char* begin, const char* end)
+{
+	const size_t size = static_cast<size_t>(end - begin);
+	return internal::convert_string<::std::u16string>(size, "UTF-8", [&](char16_t* out) {
+		return internal::utf8_to_utf16(begin, size, out);
+	});
+}
+
 inline ::std::u16string to_utf16(const ::std::string& str)
 {
-	::std::wstring_convert<::std::codecvt_utf8_utf16<char16_t>, char16_t> c;
-	return c.from_bytes(str);
+	return to_utf16(str.data(), str.data() + str.size());
 }
 
 inline ::std::u16string to_utf16(const char* str)
 {
-	::std::wstring_convert<::std::codecvt_utf8_utf16<char16_t>, char16_t> c;
-	return c.from_bytes(str);
+	return to_utf16(str, str + ::std::strlen(str));
 }
 
-inline ::std::u16string to_utf16(const char* begin, const char* end)
+inline ::std::wstring to_ucs2(const char* begin, const char* end)
 {
-	::std::wstring_convert<::std::codecvt_utf8_utf16<char16_t>, char16_t> c;
-	return c.from_bytes(begin, end);
+	const size_t size = static_cast<size_t>(end - begin);
+	return internal::convert_string<::std::wstring>(size, "UTF-8", [&](wchar_t* out) {
+		if constexpr (internal::is_utf16<wchar_t>())
+			return internal::utf8_to_utf16<wchar_t, true>(begin, size, out);
+		else
+			return internal::utf8_to_utf32(begin, size, out);
+	});
 }
 
 inline ::std::wstring to_ucs2(const ::std::string& str)
 {
-	::std::wstring_convert<::std::codecvt_utf8<wchar_t>, wchar_t> c;
-	return c.from_bytes(str);
+	return to_ucs2(str.data(), str.data() + str.size());
 }
 
 inline ::std::wstring to_ucs2(const char* str)
 {
-	::std::wstring_convert<::std::codecvt_utf8<wchar_t>, wchar_t> c;
-	return c.from_bytes(str);
+	return to_ucs2(str, str + ::std::strlen(str));
 }
 
-inline ::std::wstring to_ucs2(const char* begin, const char* end)
+inline ::std::string to_utf8(const char16_t* begin, const char16_t* end)
 {
-	::std::wstring_convert<::std::codecvt_utf8<wchar_t>, wchar_t> c;
-	return c.from_bytes(begin, end);
+	const size_t size = static_cast<size_t>(end - begin);
+	return internal::convert_string<::std::string>(3 * size, "UTF-16", [&](char* out) {
+		return internal::utf16_to_utf8(begin, size, out);
+	});
 }
 
 inline ::std::string to_utf8(const ::std::u16string& str)
 {
-	::std::wstring_convert<::std::codecvt_utf8_utf16<char16_t>, char16_t> c;
-	return c.to_bytes(str);
+	return to_utf8(str.data(), str.data() + str.size());
 }
 
 inline ::std::string to_utf8(const char16_t* str)
 {
-	::std::wstring_convert<::std::codecvt_utf8_utf16<char16_t>, char16_t> c;
-	return c.to_bytes(str);
+	return to_utf8(str, str + ::std::char_traits<char16_t>::length(str));
 }
 
-inline ::std::string to_utf8(const char16_t* begin, const char16_t* end)
+inline ::std::string to_utf8(const wchar_t* begin, const wchar_t* end)
 {
-	::std::wstring_convert<::std::codecvt_utf8_utf16<char16_t>, char16_t> c;
-	return c.to_bytes(begin, end);
+	const size_t size = static_cast<size_t>(end - begin);
+	return internal::convert_string<::std::string>(4 * size, internal::is_utf16<wchar_t>() ? "UTF-16" : "UTF-32", [&](char* out) {
+		return convert(begin, size, out);
+	});
 }
 
 inline ::std::string to_utf8(const ::std::wstring& str)
 {
-	::std::wstring_convert<::std::codecvt_utf8<wchar_t>, wchar_t> c;
-	return c.to_bytes(str);
+	return to_utf8(str.data(), str.data() + str.size());
 }
 
 inline ::std::string to_utf8(const wchar_t* str)
 {
-	::std::wstring_convert<::std::codecvt_utf8<wchar_t>, wchar_t> c;
-	return c.to_bytes(str);
-}
-
-inline ::std::string to_utf8(const wchar_t* begin, const wchar_t* end)
-{
-	::std::wstring_convert<::std::codecvt_utf8<wchar_t>, wchar_t> c;
-	return c.to_bytes(begin, end);
+	return to_utf8(str, str + ::std::wcslen(str));
 }
 
 // Intentional string pass-through for platform dependent string types
@@ -91,3 +939,360 @@ inline ::std::string to_utf8(const char* str)
 }
 
 } // namespace utf8
+
+#ifdef UTF8_BENCHMARK
+#include <codecvt>
+#include <locale>
+#include <common/benchmark.h>
+
+// Throughput of the conversions against wstring_convert for ASCII text and
+// for text mixing ASCII with 2, 3 and 4 byte sequences, 1 MiB of UTF-8 each,
+// and of converting into a reused string.
+
+namespace internal_utf8_benchmark {
+
+inline const ::std::string& text(bool ascii)
+{
+	static const ::std::string s_ascii = [] {
+		::std::string str;
+		while (str.size() < (1 << 20))
+			str += "The quick brown fox jumps over the lazy dog 0123456789. ";
+		return str;
+	}();
+	static const ::std::string s_mixed = [] {
+		::std::string str;
+		while (str.size() < (1 << 20))
+			str += "Price: 12\xe2\x82\xac, Stra\xc3\x9f" "e \xd0\x9c\xd0\xbe\xd1\x81\xd0\xba\xd0\xb2\xd0\xb0 \xe6\x9d\xb1\xe4\xba\xac \xf0\x9f\x98\x80 ok. ";
+		return str;
+	}();
+	return ascii ? s_ascii : s_mixed;
+}
+
+template <int Kind>
+inline void run(::bench::state& state, bool ascii)
+{
+	const ::std::string& str = text(ascii);
+	const ::std::u16string wide = ::utf8::to_utf16(str);
+	::std::wstring_convert<::std::codecvt_utf8_utf16<char16_t>, char16_t> codecvt;
+	::std::u16string reused;
+	while (state.keep_running())
+	{
+		if (Kind == 0)
+			::bench::do_not_optimize(::utf8::to_utf16(str));
+		else if (Kind == 1)
+			::bench::do_not_optimize(codecvt.from_bytes(str));
+		else if (Kind == 2)
+			::bench::do_not_optimize(::utf8::to_utf8(wide));
+		else if (Kind == 3)
+			::bench::do_not_optimize(codecvt.to_bytes(wide));
+		else if (Kind == 4)
+			::bench::do_not_optimize(::utf8::validate(str.data(), str.size()));
+		else if (Kind == 5)
+			::bench::do_not_optimize(::utf8::utf16_length(str.data(), str.data() + str.size()));
+		else
+		{
+			reused.clear();
+			::bench::do_not_optimize(::utf8::append(reused, str));
+		}
+	}
+	state.set_bytes_processed(state.iterations() * str.size());
+}
+
+} // namespace internal_utf8_benchmark
+
+#define UTF8_BENCHMARK_TEXT(name, ascii) \
+	BENCHMARK(utf8_to_utf16_##name) { internal_utf8_benchmark::run<0>(state, ascii); } \
+	BENCHMARK(codecvt_from_bytes_##name) { internal_utf8_benchmark::run<1>(state, ascii); } \
+	BENCHMARK(utf16_to_utf8_##name) { internal_utf8_benchmark::run<2>(state, ascii); } \
+	BENCHMARK(codecvt_to_bytes_##name) { internal_utf8_benchmark::run<3>(state, ascii); } \
+	BENCHMARK(utf8_validate_##name) { internal_utf8_benchmark::run<4>(state, ascii); } \
+	BENCHMARK(utf16_length_##name) { internal_utf8_benchmark::run<5>(state, ascii); } \
+	BENCHMARK(utf8_append_reused_##name) { internal_utf8_benchmark::run<6>(state, ascii); }
+
+UTF8_BENCHMARK_TEXT(ascii, true)
+UTF8_BENCHMARK_TEXT(mixed, false)
+
+#endif
+#ifdef UTF8_TEST
+#include <cstdio>
+#include <common/utf8_stream.h>
+
+// Strict validation and the position of the first invalid unit behind ASCII
+// runs of every length, convert_into resumed after error::no_space at every
+// capacity, append on error and stream_transcoder with every chunk size.
+
+namespace internal_utf8_test {
+
+// The same text as UTF-8, UTF-16 and UTF-32, with 1 to 4 byte sequences.
+#define UTF8_TEST_TEXT(prefix, euro, sharp, face) \
+	prefix##"Price: 12" euro ", Stra" sharp "e " face " The quick brown fox jumps over the lazy dog. "
+
+inline ::std::string text8()
+{
+	::std::string text;
+	for (int i = 0; i < 4; ++i)
+		text += UTF8_TEST_TEXT(, "\xe2\x82\xac", "\xc3\x9f", "\xf0\x9f\x98\x80");
+	return text;
+}
+
+inline ::std::u16string text16()
+{
+	::std::u16string text;
+	for (int i = 0; i < 4; ++i)
+		text += UTF8_TEST_TEXT(u, u"\u20ac", u"\u00df", u"\U0001F600");
+	return text;
+}
+
+inline ::std::u32string text32()
+{
+	::std::u32string text;
+	for (int i = 0; i < 4; ++i)
+		text += UTF8_TEST_TEXT(U, U"\u20ac", U"\u00df", U"\U0001F600");
+	return text;
+}
+
+#undef UTF8_TEST_TEXT
+
+inline int check(const char* what, size_t size, const ::utf8::result& r, ::utf8::error status, size_t position)
+{
+	if (r.status == status && r.position == position)
+	{
+		return 0;
+	}
+	::std::printf("utf8: %s of %zu units returned \"%s\" at %zu instead of \"%s\" at %zu\n", what, size,
+		::utf8::error_message(r.status), r.position, ::utf8::error_message(status), position);
+	return 1;
+}
+
+inline int check(const char* what, bool passed)
+{
+	if (!passed)
+	{
+		::std::printf("utf8: %s failed\n", what);
+	}
+	return passed ? 0 : 1;
+}
+
+// Invalid sequences behind ASCII runs that cover the vector widths.
+inline int invalid_utf8()
+{
+	struct invalid
+	{
+		const char* text;
+		::utf8::error status;
+	};
+	const invalid cases[] = {
+		{ "\x80", ::utf8::error::invalid_byte },
+		{ "\xbf", ::utf8::error::invalid_byte },
+		{ "\xf8\x88\x80\x80\x80", ::utf8::error::invalid_byte },
+		{ "\xff", ::utf8::error::invalid_byte },
+		{ "\xc3", ::utf8::error::truncated },
+		{ "\xe2\x82", ::utf8::error::truncated },
+		{ "\xf0\x9f\x98", ::utf8::error::truncated },
+		{ "\xe2(\xac", ::utf8::error::truncated },
+		{ "\xc0\x80", ::utf8::error::overlong },
+		{ "\xc1\xbf", ::utf8::error::overlong },
+		{ "\xe0\x9f\xbf", ::utf8::error::overlong },
+		{ "\xf0\x8f\xbf\xbf", ::utf8::error::overlong },
+		{ "\xed\xa0\x80", ::utf8::error::surrogate },
+		{ "\xed\xbf\xbf", ::utf8::error::surrogate },
+		{ "\xf4\x90\x80\x80", ::utf8::error::too_large },
+		{ "\xf7\xbf\xbf\xbf", ::utf8::error::too_large }
+	};
+	int failures = 0;
+	for (const invalid& bad : cases)
+	{
+		for (size_t prefix = 0; prefix <= 70; ++prefix)
+		{
+			const ::std::string input = ::std::string(prefix, 'a') + bad.text + "tail";
+			char16_t utf16[128];
+			char32_t utf32[128];
+			failures += check("validate", input.size(), ::utf8::validate(input.data(), input.size()), bad.status, prefix);
+			failures += check("convert to UTF-16", input.size(), ::utf8::convert(input.data(), input.size(), utf16), bad.status, prefix);
+			failures += check("convert to UTF-32", input.size(), ::utf8::convert(input.data(), input.size(), utf32), bad.status, prefix);
+			failures += check("convert_into", input.size(), ::utf8::convert_into(input.data(), input.size(), utf16, 128), bad.status, prefix);
+		}
+	}
+	return failures;
+}
+
+// The shortest and longest code point of every length and those around the
+// surrogates.
+inline int valid_utf8()
+{
+	const char input[] = "\x7f" "\xc2\x80" "\xdf\xbf" "\xe0\xa0\x80" "\xed\x9f\xbf" "\xee\x80\x80" "\xef\xbf\xbf" "\xf0\x90\x80\x80" "\xf4\x8f\xbf\xbf";
+	const char32_t expected[] = { 0x7f, 0x80, 0x7ff, 0x800, 0xd7ff, 0xe000, 0xffff, 0x10000, 0x10ffff };
+	const size_t size = sizeof(input) - 1;
+	char32_t utf32[16];
+	const ::utf8::result r = ::utf8::convert(input, size, utf32);
+	int failures = 0;
+	failures += check("validate of the limits", size, ::utf8::validate(input, size), ::utf8::error::none, size);
+	failures += check("convert of the limits", r && r.written == 9 && ::std::equal(expected, expected + 9, utf32));
+	failures += check("to_utf8 of the limits", ::utf8::to_utf8(::utf8::to_utf16(input)) == input);
+	failures += check("utf16_length of the limits", ::utf8::utf16_length(input, input + size) == ::utf8::to_utf16(input).size());
+	return failures;
+}
+
+inline int invalid_utf16_utf32()
+{
+	int failures = 0;
+	char out[256];
+	for (size_t prefix = 0; prefix <= 40; ++prefix)
+	{
+		const ::std::u16string ascii16(prefix, u'a');
+		const char16_t* const bad16[] = { u"\xd800", u"\xdc00x", u"\xd800x", u"\xdbff\xdbff" };
+		for (const char16_t* bad : bad16)
+		{
+			const ::std::u16string input = ascii16 + bad;
+			failures += check("convert of UTF-16", input.size(), ::utf8::convert(input.data(), input.size(), out), ::utf8::error::surrogate, prefix);
+		}
+		const ::std::u32string ascii32(prefix, U'a');
+		const ::std::u32string surrogate = ascii32 + char32_t(0xdfff) + U"x";
+		const ::std::u32string large = ascii32 + char32_t(0x110000) + U"x";
+		failures += check("convert of UTF-32", surrogate.size(), ::utf8::convert(surrogate.data(), surrogate.size(), out), ::utf8::error::surrogate, prefix);
+		failures += check("convert of UTF-32", large.size(), ::utf8::convert(large.data(), large.size(), out), ::utf8::error::too_large, prefix);
+	}
+	bool thrown = false;
+	try
+	{
+		::utf8::to_utf16("ab\xc0\x80");
+	}
+	catch (const ::std::range_error&)
+	{
+		thrown = true;
+	}
+	failures += check("to_utf16 throwing range_error", thrown);
+	return failures;
+}
+
+// Converts in calls of at most capacity units, continuing at the position
+// of error::no_space, and returns the final status and position.
+template <class In, class Out>
+inline ::utf8::result convert_resumed(const ::std::basic_string<In>& input, size_t capacity, ::std::basic_string<Out>& output)
+{
+	Out buffer[128];
+	size_t i = 0;
+	for (;;)
+	{
+		const ::utf8::result r = ::utf8::convert_into(input.data() + i, input.size() - i, buffer, capacity);
+		output.append(buffer, r.written);
+		if (r.status != ::utf8::error::no_space || (r.position == 0 && r.written == 0))
+		{
+			return { r.status, i + r.position, output.size() };
+		}
+		i += r.position;
+	}
+}
+
+// Every capacity from the longest sequence of the output on.
+template <class In, class Out>
+inline int resume(const char* what, const ::std::basic_string<In>& input, const ::std::basic_string<Out>& expected, size_t longest)
+{
+	int failures = 0;
+	Out buffer[4];
+	failures += check(what, input.size(), ::utf8::convert_into(input.data(), input.size(), buffer, 0), ::utf8::error::no_space, 0);
+	for (size_t capacity = longest; capacity <= 128; ++capacity)
+	{
+		::std::basic_string<Out> output;
+		failures += check(what, input.size(), convert_resumed(input, capacity, output), ::utf8::error::none, input.size());
+		failures += check(what, output == expected);
+		::std::basic_string<In> bad = input;
+		bad.insert(bad.size() / 2, 1, static_cast<In>((sizeof(In) == 1) ? 0x80 : 0xdc00));
+		output.clear();
+		failures += check(what, bad.size(), convert_resumed(bad, capacity, output), (sizeof(In) == 1) ? ::utf8::error::invalid_byte : ::utf8::error::surrogate, input.size() / 2);
+	}
+	return failures;
+}
+
+inline int append()
+{
+	int failures = 0;
+	::std::u16string wide = u"xy";
+	wide.reserve(256);
+	const ::std::string bad = text8() + "\xe2\x82";
+	failures += check("append", bad.size(), ::utf8::append(wide, bad), ::utf8::error::truncated, bad.size() - 2);
+	failures += check("append leaving the string unchanged", wide == u"xy");
+	failures += check("append", !!::utf8::append(wide, text8()) && wide == u"xy" + text16());
+	::std::string narrow = "xy";
+	const ::std::u16string bad16 = text16() + u"\xd800";
+	failures += check("append", bad16.size(), ::utf8::append(narrow, bad16.data(), bad16.data() + bad16.size()), ::utf8::error::surrogate, bad16.size() - 1);
+	failures += check("append leaving the string unchanged", narrow == "xy");
+	const ::std::u32string text = text32();
+	failures += check("append", !!::utf8::append(narrow, text.data(), text.data() + text.size()) && narrow == "xy" + text8());
+	return failures;
+}
+
+// Chunks of every size up to 9 units, so sequences are cut at every byte.
+template <size_t BufferSize, class In, class Out>
+inline int stream_chunks(const char* what, const ::std::basic_string<In>& input, const ::std::basic_string<Out>& expected)
+{
+	int failures = 0;
+	for (size_t chunk = 1; chunk <= 9; ++chunk)
+	{
+		::utf8::stream_transcoder<In, Out, BufferSize> stream;
+		::std::basic_string<Out> output;
+		auto sink = [&](const Out* data, size_t size) { output.append(data, size); };
+		bool passed = true;
+		for (size_t i = 0; i < input.size(); i += chunk)
+		{
+			passed &= !!stream.write(input.data() + i, ::std::min(chunk, input.size() - i), sink);
+		}
+		passed &= !!stream.finish(sink);
+		failures += check(what, passed && output == expected && stream.position() == input.size());
+	}
+	return failures;
+}
+
+inline int stream_errors()
+{
+	int failures = 0;
+	auto sink16 = [](const char16_t*, size_t) {};
+	auto sink8 = [](const char*, size_t) {};
+	::utf8::utf8_to_utf16_stream stream;
+	failures += check("stream write", 3, stream.write("ab\xe2", 3, sink16), ::utf8::error::none, 3);
+	failures += check("stream write", 1, stream.write("\x82", 1, sink16), ::utf8::error::none, 1);
+	failures += check("stream finish", 4, stream.finish(sink16), ::utf8::error::truncated, 0);
+	failures += check("stream error_position", stream.error_position() == 2);
+	stream.reset();
+	failures += check("stream write", 3, stream.write("abc", 3, sink16), ::utf8::error::none, 3);
+	failures += check("stream write", 3, stream.write("d\x80" "e", 3, sink16), ::utf8::error::invalid_byte, 1);
+	failures += check("stream error_position", stream.error_position() == 4);
+	stream.reset();
+	failures += check("stream write", 2, stream.write("a\xe2", 2, sink16), ::utf8::error::none, 2);
+	failures += check("stream write", 3, stream.write("(bc", 3, sink16), ::utf8::error::truncated, 0);
+	failures += check("stream error_position", stream.error_position() == 1);
+	::utf8::utf16_to_utf8_stream stream16;
+	failures += check("stream write", 2, stream16.write(u"a\xd83d", 2, sink8), ::utf8::error::none, 2);
+	failures += check("stream finish", 2, stream16.finish(sink8), ::utf8::error::surrogate, 0);
+	failures += check("stream error_position", stream16.error_position() == 1);
+	return failures;
+}
+
+// Returns the number of failures.
+inline int run()
+{
+	const ::std::string utf8 = text8();
+	const ::std::u16string utf16 = text16();
+	const ::std::u32string utf32 = text32();
+	int failures = 0;
+	failures += invalid_utf8();
+	failures += valid_utf8();
+	failures += invalid_utf16_utf32();
+	failures += check("to_utf16", ::utf8::to_utf16(utf8) == utf16);
+	failures += check("to_utf8", ::utf8::to_utf8(utf16) == utf8);
+	failures += resume("convert_into UTF-8 to UTF-16", utf8, utf16, 2);
+	failures += resume("convert_into UTF-8 to UTF-32", utf8, utf32, 1);
+	failures += resume("convert_into UTF-16 to UTF-8", utf16, utf8, 4);
+	failures += resume("convert_into UTF-32 to UTF-8", utf32, utf8, 4);
+	failures += append();
+	failures += stream_chunks<40>("stream UTF-8 to UTF-16", utf8, utf16);
+	failures += stream_chunks<4096>("stream UTF-8 to UTF-32", utf8, utf32);
+	failures += stream_chunks<37>("stream UTF-16 to UTF-8", utf16, utf8);
+	failures += stream_chunks<4096>("stream UTF-32 to UTF-8", utf32, utf8);
+	failures += stream_errors();
+	return failures;
+}
+
+} // namespace internal_utf8_test
+
+#endif
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <common/utf8.h>
+
+namespace utf8 {
+
+// Converts a stream given in chunks of any size, e.g. reads from a socket or
+// windows of a mapped file. Sequences cut by a chunk boundary are carried to
+// the next chunk, output is collected in a buffer of BufferSize units that is
+// handed to the sink, a callable taking (const Out* data, size_t size), when
+// it is full and on flush() and finish(). Memory use does not depend on the
+// input size.
+//
+//   utf8::utf8_to_utf16_stream stream;
+//   auto sink = [&](const char16_t* data, size_t size) { out.write(data, size); };
+//   while (size_t n = read(socket, chunk, sizeof(chunk)))
+//       if (!stream.write(chunk, n, sink)) ...;
+//   if (!stream.finish(sink)) ...;
+
+template <class In, class Out, size_t BufferSize = 4096>
+class stream_transcoder
+{
+	static_assert(BufferSize >= 4, "BufferSize must hold the longest sequence");
+	static_assert((sizeof(In) == 1) != (sizeof(Out) == 1), "Either the input or the output must be UTF-8");
+
+public:
+	stream_transcoder() noexcept = default;
+
+	// Returns the error of the first invalid sequence. position is relative
+	// to the chunk and error_position() gives the position in the stream.
+	template <class Sink>
+	result write(const In* data, size_t size, Sink&& sink)
+	{
+		size_t i = 0;
+		size_t written = 0;
+		if (m_pendingSize != 0)
+		{
+			const size_t expected = pending_length();
+			while (m_pendingSize < expected && i < size)
+			{
+				m_pending[m_pendingSize++] = data[i++];
+			}
+			if (m_pendingSize < expected)
+			{
+				m_position += i;
+				return { error::none, i, 0 };
+			}
+			const result r = put(m_pending, m_pendingSize, sink);
+			if (!r)
+			{
+				m_errorPosition = m_position + i - m_pendingSize + r.position;
+				m_pendingSize = 0;
+				return { r.status, 0, r.written };
+			}
+			written += r.written;
+			m_pendingSize = 0;
+		}
+		const size_t end = i + complete_length(data + i, size - i);
+		const result r = put(data + i, end - i, sink);
+		if (!r)
+		{
+			m_errorPosition = m_position + i + r.position;
+			return { r.status, i + r.position, written + r.written };
+		}
+		for (size_t k = end; k < size; ++k)
+		{
+			m_pending[m_pendingSize++] = data[k];
+		}
+		m_position += size;
+		return { error::none, size, written + r.written };
+	}
+
+	// Passes the buffered output to the sink.
+	template <class Sink>
+	void flush(Sink&& sink)
+	{
+		if (m_size != 0)
+		{
+			sink(static_cast<const Out*>(m_buffer), m_size);
+			m_size = 0;
+		}
+	}
+
+	// Ends the stream, an unfinished sequence at its end is an error.
+	template <class Sink>
+	result finish(Sink&& sink)
+	{
+		flush(sink);
+		if (m_pendingSize != 0)
+		{
+			m_errorPosition = m_position - m_pendingSize;
+			m_pendingSize = 0;
+			return { (sizeof(In) == 1) ? error::truncated : error::surrogate, 0, 0 };
+		}
+		return { error::none, 0, 0 };
+	}
+
+	void reset() noexcept
+	{
+		m_size = 0;
+		m_pendingSize = 0;
+		m_position = 0;
+		m_errorPosition = 0;
+	}
+
+	// Input units written so far.
+	uint64_t position() const noexcept
+	{
+		return m_position;
+	}
+
+	uint64_t error_position() const noexcept
+	{
+		return m_errorPosition;
+	}
+
+private:
+	size_t pending_length() const noexcept
+	{
+		return (sizeof(In) == 1) ? internal::sequence_length(m_pending, 4) : 2;
+	}
+
+	// Length of the input without a sequence cut off at its end.
+	static size_t complete_length(const In* in, size_t size) noexcept
+	{
+		if constexpr (sizeof(In) == 1)
+		{
+			size_t start = size;
+			while (start != 0 && size - start < 3 && internal::is_continuation(static_cast<unsigned char>(in[start - 1])))
+			{
+				--start;
+			}
+			if (start != 0 && internal::sequence_length(in + start - 1, 4) > size - start + 1)
+			{
+				return start - 1;
+			}
+			return size;
+		}
+		else
+		{
+			return internal::sequence_start(in, 0, size);
+		}
+	}
+
+	template <class Sink>
+	result put(const In* in, size_t size, Sink& sink)
+	{
+		size_t i = 0;
+		size_t written = 0;
+		while (i < size)
+		{
+			const result r = convert_into(in + i, size - i, m_buffer + m_size, BufferSize - m_size);
+			m_size += r.written;
+			written += r.written;
+			if (r.status != error::no_space)
+			{
+				return { r.status, i + r.position, written };
+			}
+			i += r.position;
+			flush(sink);
+		}
+		return { error::none, i, written };
+	}
+
+	Out m_buffer[BufferSize];
+	size_t m_size = 0;
+	In m_pending[4];
+	size_t m_pendingSize = 0;
+	uint64_t m_position = 0;
+	uint64_t m_errorPosition = 0;
+};
+
+using utf8_to_utf16_stream = stream_transcoder<char, char16_t>;
+using utf8_to_utf32_stream = stream_transcoder<char, char32_t>;
+using utf8_to_wchar_stream = stream_transcoder<char, wchar_t>;
+using utf16_to_utf8_stream = stream_transcoder<char16_t, char>;
+using utf32_to_utf8_stream = stream_transcoder<char32_t, char>;
+using wchar_to_utf8_stream = stream_transcoder<wchar_t, char>;
+
+} // namespace utf8
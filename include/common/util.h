@@ -3,10 +3,28 @@
 
 #include <chrono>
 #include <thread>
-#include <fstream>
 #include <cassert>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <sys/stat.h>
 #include <common/types.h>
 
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+// The pause instruction without the intrinsics headers.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define COMMON_PAUSE_X86 1
+extern "C" void _mm_pause(void);
+#pragma intrinsic(_mm_pause)
+#elif defined(__x86_64__) || defined(__i386__)
+#define COMMON_PAUSE_X86 1
+#else
+#define COMMON_PAUSE_X86 0
+#endif
+
 #define UTILS_DELETE_COPY_CONSTRUCTOR(clazz) \
 	clazz(const clazz&) = delete; \
 	clazz& operator=(const clazz&) = delete;
@@ -61,6 +79,11 @@ inline char to_lower_ascii(char ch)
 	return s_lower_ascii_table[static_cast<unsigned char>(ch)];
 }
 
+inline char to_upper_ascii(char ch)
+{
+	return (ch >= 'a' && ch <= 'z') ? static_cast<char>(ch - ('a' - 'A')) : ch;
+}
+
 template <class Char>
 inline bool is_valid_string(Char* str)
 {
@@ -91,22 +114,220 @@ inline void SafeRelease(Type*& p) {
 	}
 }
 
-inline bool file_exists(const wchar_t* filename)
+namespace internal {
+
+#ifdef _WIN32
+using file_status = struct ::_stat64;
+
+inline bool stat_file(const char* filename, file_status& status)
+{
+	return ::_stat64(filename, &status) == 0;
+}
+
+inline bool stat_file(const wchar_t* filename, file_status& status)
 {
-	if (filename && filename[0])
+	return ::_wstat64(filename, &status) == 0;
+}
+
+inline bool is_directory(const file_status& status)
+{
+	return (status.st_mode & _S_IFDIR) != 0;
+}
+#else
+using file_status = struct ::stat;
+
+inline bool stat_file(const char* filename, file_status& status)
+{
+	return ::stat(filename, &status) == 0;
+}
+
+inline bool is_directory(const file_status& status)
+{
+	return S_ISDIR(status.st_mode);
+}
+#endif
+
+template <class Char>
+inline bool file_size(const Char* filename, uint64_t& size)
+{
+	file_status status;
+	if (filename && filename[0] && stat_file(filename, status) && !is_directory(status))
 	{
-		::std::ifstream file(filename);
-		return file.good();
+		size = static_cast<uint64_t>(status.st_size);
+		return true;
 	}
 	return false;
 }
 
+} // namespace internal
+
+// Existence and size probes with a single stat call. file_exists is true for
+// everything that exists and is not a directory, including files the process
+// can not read, FIFOs and devices, it does not open the file. The wide
+// overloads are Windows only, other systems have no wide file names.
+
+inline bool file_exists(const char* filename)
+{
+	uint64_t size;
+	return internal::file_size(filename, size);
+}
+
+inline bool file_size(const char* filename, uint64_t& size)
+{
+	return internal::file_size(filename, size);
+}
+
+#ifdef _WIN32
+inline bool file_exists(const wchar_t* filename)
+{
+	uint64_t size;
+	return internal::file_size(filename, size);
+}
+
+inline bool file_size(const wchar_t* filename, uint64_t& size)
+{
+	return internal::file_size(filename, size);
+}
+#endif
+
 template <class Time>
 inline void sleep(Time time)
 {
 	::std::this_thread::sleep_for(time);
 }
 
+// Tells the CPU the thread is spinning, which saves power and hands the core
+// to the other hyper-thread.
+inline void cpu_relax() noexcept
+{
+#if COMMON_PAUSE_X86 && defined(_MSC_VER)
+	_mm_pause();
+#elif COMMON_PAUSE_X86
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#else
+	::std::this_thread::yield();
+#endif
+}
+
+// Exponential backoff for lock-free retry loops: spins 1, 2, 4 ... 64 pauses
+// on consecutive failures, then yields the thread.
+//
+//   util::backoff backoff;
+//   while (!head.compare_exchange_weak(expected, desired))
+//       backoff();
+class backoff
+{
+public:
+	void operator()() noexcept
+	{
+		if (m_spins <= max_spins)
+		{
+			for (uint32_t i = 0; i < m_spins; ++i)
+			{
+				cpu_relax();
+			}
+			m_spins *= 2;
+		}
+		else
+		{
+			::std::this_thread::yield();
+		}
+	}
+
+	void reset() noexcept
+	{
+		m_spins = 1;
+	}
+
+	bool is_yielding() const noexcept
+	{
+		return m_spins > max_spins;
+	}
+
+private:
+	static constexpr uint32_t max_spins = 64;
+
+	uint32_t m_spins = 1;
+};
+
+namespace internal {
+
+// How much later than requested sleep_for returns, from the timer slack of the
+// thread (or the timer resolution) and then learned from every sleep. Jumps to
+// a late wakeup and decays slowly, so it tracks the worst recent oversleep.
+inline ::std::atomic<int64_t>& oversleep_ns() noexcept
+{
+	static ::std::atomic<int64_t> s_oversleep{ [] {
+#if defined(__linux__) && defined(PR_GET_TIMERSLACK)
+		const int slack = ::prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0);
+		return int64_t((slack > 0) ? slack : 50000) + 20000;
+#elif defined(_WIN32)
+		return int64_t(2000000);
+#else
+		return int64_t(100000);
+#endif
+	}() };
+	return s_oversleep;
+}
+
+inline void learn_oversleep(int64_t oversleep) noexcept
+{
+	::std::atomic<int64_t>& estimate = oversleep_ns();
+	const int64_t current = estimate.load(::std::memory_order_relaxed);
+	oversleep = (oversleep < 0) ? 0 : (oversleep > current * 4 + 100000) ? current * 4 + 100000 : oversleep;
+	estimate.store((oversleep > current) ? oversleep : current - (current - oversleep) / 32,
+		::std::memory_order_relaxed);
+}
+
+} // namespace internal
+
+// Sleeps until the deadline with microsecond precision: sleeps for the part of
+// the interval the scheduler is expected to honour, yields while the rest is
+// long and spins the last microseconds. Costs CPU for about the timer slack
+// per call, use sleep() where oversleeping does not matter.
+template <class Clock, class Duration>
+inline void sleep_until(const ::std::chrono::time_point<Clock, Duration>& deadline)
+{
+	using ::std::chrono::nanoseconds;
+	for (;;)
+	{
+		const typename Clock::time_point now = Clock::now();
+		const nanoseconds remaining = ::std::chrono::duration_cast<nanoseconds>(deadline - now);
+		const nanoseconds oversleep(internal::oversleep_ns().load(::std::memory_order_relaxed));
+		if (remaining <= oversleep)
+		{
+			break;
+		}
+		const nanoseconds request = remaining - oversleep;
+		::std::this_thread::sleep_for(request);
+		internal::learn_oversleep((::std::chrono::duration_cast<nanoseconds>(Clock::now() - now) - request).count());
+	}
+	for (;;)
+	{
+		const nanoseconds remaining = ::std::chrono::duration_cast<nanoseconds>(deadline - Clock::now());
+		if (remaining <= nanoseconds(0))
+		{
+			break;
+		}
+		if (remaining > ::std::chrono::microseconds(50))
+		{
+			::std::this_thread::yield();
+		}
+		else
+		{
+			cpu_relax();
+		}
+	}
+}
+
+template <class Time>
+inline void precise_sleep(Time time)
+{
+	sleep_until(::std::chrono::steady_clock::now() + time);
+}
+
 template <class Type>
 inline void verify_initialized_pointers_debug(const Type& object)
 {
@@ -147,3 +368,62 @@ inline void nullify_object_debug(Type& object)
 }
 
 } // namespace util
+
+#ifdef UTIL_SLEEP_BENCHMARK
+#include <iostream>
+#include <common/benchmark.h>
+#include <common/histogram.h>
+
+// Wakeup jitter of sleep_for against precise_sleep for pacing intervals of
+// 100 us and 1 ms. The lateness of every wakeup is recorded and the
+// distribution of each benchmark is written at exit.
+
+namespace internal_sleep_benchmark {
+
+struct jitter
+{
+	explicit jitter(const char* name) : m_name(name) {}
+
+	~jitter()
+	{
+		::std::cout << m_name << " lateness ";
+		::util::write_latency_summary(::std::cout, m_histogram);
+	}
+
+	const char* m_name;
+	::util::latency_histogram m_histogram;
+};
+
+template <bool Precise>
+inline void run(::bench::state& state, jitter& lateness, ::std::chrono::nanoseconds interval)
+{
+	while (state.keep_running())
+	{
+		const auto start = ::std::chrono::steady_clock::now();
+		if (Precise)
+			::util::precise_sleep(interval);
+		else
+			::std::this_thread::sleep_for(interval);
+		const auto late = ::std::chrono::steady_clock::now() - start - interval;
+		lateness.m_histogram.record(static_cast<uint64_t>(::std::max<int64_t>(late.count(), 0)));
+	}
+}
+
+} // namespace internal_sleep_benchmark
+
+#define UTIL_SLEEP_BENCHMARK_INTERVAL(name, interval) \
+	BENCHMARK(sleep_for_##name) \
+	{ \
+		static internal_sleep_benchmark::jitter s_lateness("sleep_for_" #name); \
+		internal_sleep_benchmark::run<false>(state, s_lateness, interval); \
+	} \
+	BENCHMARK(precise_sleep_##name) \
+	{ \
+		static internal_sleep_benchmark::jitter s_lateness("precise_sleep_" #name); \
+		internal_sleep_benchmark::run<true>(state, s_lateness, interval); \
+	}
+
+UTIL_SLEEP_BENCHMARK_INTERVAL(100us, ::std::chrono::microseconds(100))
+UTIL_SLEEP_BENCHMARK_INTERVAL(1ms, ::std::chrono::milliseconds(1))
+
+#endif
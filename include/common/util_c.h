@@ -43,4 +43,12 @@ inline void __cdecl c_free(void* ptr, size_t count, size_t size)
 	free(ptr);
 }
 
+inline void* __cdecl c_realloc(void* ptr, size_t oldCount, size_t newCount, size_t size)
+{
+	(void)oldCount;
+	if (ptr == 0 || newCount == 0)
+		return 0;
+	return realloc(ptr, newCount * size);
+}
+
 #endif // COMMON_UTILSC_H_
@@ -2,32 +2,433 @@
 #pragma once
 
 #include <common/stl.h>
+#include <common/utf8.h>
+#include <common/tsc_clock.h>
+#include <common/binary_log.h>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
+#include <string_view>
+
+// Calls of the UTIL_LOG macros below this level are removed at compile time,
+// e.g. -DUTIL_LOG_MIN_LEVEL=2 keeps info and above.
+#ifndef UTIL_LOG_MIN_LEVEL
+#define UTIL_LOG_MIN_LEVEL 0
+#endif
 
 namespace util {
 
+// Destination of clog and friends instead of the standard streams while it
+// is installed. The async_logger of async_log.h installs itself when it is
+// started, without it all functions write to the standard streams. A sink
+// has to stay valid after it was replaced, calls may still be using it.
+class log_sink
+{
+public:
+	// Queues a complete line including its line break. Returns false if the
+	// sink no longer takes records, the caller then writes to the stream.
+	virtual bool write_line(const char* data, size_t size) = 0;
+
+	// Queues a record written by encode_log_record, returns false like write_line.
+	virtual bool write_record(const char* data, size_t size) = 0;
+
+	// Whether UTIL_CLOG passes records instead of lines, see binary_log.h.
+	virtual bool takes_records() const noexcept = 0;
+
+protected:
+	~log_sink() = default;
+};
+
+namespace internal {
+
+inline ::std::atomic<log_sink*>& log_sink_pointer() noexcept
+{
+	static ::std::atomic<log_sink*> s_sink{ nullptr };
+	return s_sink;
+}
+
+inline ::stl::string_builder& log_line_builder()
+{
+	static thread_local ::stl::string_builder s_builder;
+	return s_builder;
+}
+
+template <class... Args>
+inline bool sink_printf(const char* format, Args... args)
+{
+	log_sink* sink = log_sink_pointer().load(::std::memory_order_acquire);
+	if (sink == nullptr)
+	{
+		return false;
+	}
+	::stl::string_builder& line = log_line_builder();
+	line.reset();
+	line.append_printf(format, args...).append('\n');
+	return sink->write_line(line.data(), line.size());
+}
+
+inline bool sink_write(::std::string_view text)
+{
+	log_sink* sink = log_sink_pointer().load(::std::memory_order_acquire);
+	if (sink == nullptr)
+	{
+		return false;
+	}
+	::stl::string_builder& line = log_line_builder();
+	line.reset();
+	line.append(text).append('\n');
+	return sink->write_line(line.data(), line.size());
+}
+
+template <class T>
+inline const T& printf_arg(const T& value)
+{
+	return value;
+}
+
+template <class Traits, class Allocator>
+inline const char* printf_arg(const ::std::basic_string<char, Traits, Allocator>& value)
+{
+	return value.c_str();
+}
+
+} // namespace internal
+
+// Installs sink, or the standard streams for null, and returns the previous sink.
+inline log_sink* set_log_sink(log_sink* sink) noexcept
+{
+	return internal::log_sink_pointer().exchange(sink, ::std::memory_order_acq_rel);
+}
+
+inline log_sink* get_log_sink() noexcept
+{
+	return internal::log_sink_pointer().load(::std::memory_order_acquire);
+}
+
 template <class... Args>
 inline void clog(const char* format, Args... args)
 {
-	::std::clog << ::stl::string_format(format, args...).c_str() << ::std::endl;
+	if (!internal::sink_printf(format, args...))
+	{
+		::std::clog << ::stl::string_format(format, args...).c_str() << ::std::endl;
+	}
+}
+
+// Writes text without formatting, e.g. the view of a string_builder.
+inline void clog(::std::string_view text)
+{
+	if (!internal::sink_write(text))
+	{
+		::std::clog.write(text.data(), static_cast<::std::streamsize>(text.size())) << ::std::endl;
+	}
 }
 
 template <class... Args>
 inline void wclog(const wchar_t* format, Args... args)
 {
-	::std::wclog << ::stl::wstring_format(format, args...).c_str() << ::std::endl;
+	if (get_log_sink() == nullptr || !internal::sink_write(::utf8::to_utf8(::stl::wstring_format(format, args...))))
+	{
+		::std::wclog << ::stl::wstring_format(format, args...).c_str() << ::std::endl;
+	}
 }
 
 template <class... Args>
 inline void cerr(const char* format, Args... args)
 {
-	::std::cerr << ::stl::string_format(format, args...).c_str() << ::std::endl;
+	if (!internal::sink_printf(format, args...))
+	{
+		::std::cerr << ::stl::string_format(format, args...).c_str() << ::std::endl;
+	}
+}
+
+inline void cerr(::std::string_view text)
+{
+	if (!internal::sink_write(text))
+	{
+		::std::cerr.write(text.data(), static_cast<::std::streamsize>(text.size())) << ::std::endl;
+	}
 }
 
 template <class... Args>
 inline void wcerr(const wchar_t* format, Args... args)
 {
-	::std::wcerr << ::stl::wstring_format(format, args...).c_str() << ::std::endl;
+	if (get_log_sink() == nullptr || !internal::sink_write(::utf8::to_utf8(::stl::wstring_format(format, args...))))
+	{
+		::std::wcerr << ::stl::wstring_format(format, args...).c_str() << ::std::endl;
+	}
+}
+
+enum class log_level
+{
+	trace,
+	debug,
+	info,
+	warning,
+	error,
+	fatal,
+	off
+};
+
+constexpr log_level min_log_level = static_cast<log_level>(UTIL_LOG_MIN_LEVEL);
+
+namespace internal {
+
+inline ::std::atomic<log_level>& log_threshold() noexcept
+{
+	static ::std::atomic<log_level> s_level{ log_level::trace };
+	return s_level;
+}
+
+} // namespace internal
+
+// Runtime threshold of the UTIL_LOG macros, checked before the arguments are evaluated.
+inline void set_log_level(log_level level) noexcept
+{
+	internal::log_threshold().store(level, ::std::memory_order_relaxed);
+}
+
+inline log_level get_log_level() noexcept
+{
+	return internal::log_threshold().load(::std::memory_order_relaxed);
+}
+
+inline bool log_enabled(log_level level) noexcept
+{
+	return level >= internal::log_threshold().load(::std::memory_order_relaxed);
+}
+
+// Lets every n-th call of a UTIL_LOG_EVERY_N site through, every call for n 0 or 1.
+class log_sampler
+{
+public:
+	constexpr log_sampler() noexcept = default;
+
+	log_sampler(const log_sampler&) = delete;
+	log_sampler& operator=(const log_sampler&) = delete;
+
+	bool sample(uint64_t n) noexcept
+	{
+		if (n <= 1 || m_calls.fetch_add(1, ::std::memory_order_relaxed) % n == 0)
+		{
+			return true;
+		}
+		m_suppressed.fetch_add(1, ::std::memory_order_relaxed);
+		return false;
+	}
+
+	uint64_t suppressed() const noexcept
+	{
+		return m_suppressed.load(::std::memory_order_relaxed);
+	}
+
+private:
+	::std::atomic<uint64_t> m_calls{ 0 };
+	::std::atomic<uint64_t> m_suppressed{ 0 };
+};
+
+// Token bucket of a UTIL_LOG_RATE site, kept as the time the bucket will be
+// full again (GCRA), so a check is one clock read and one compare exchange.
+class log_rate_limiter
+{
+public:
+	constexpr log_rate_limiter() noexcept = default;
+
+	log_rate_limiter(const log_rate_limiter&) = delete;
+	log_rate_limiter& operator=(const log_rate_limiter&) = delete;
+
+	// Allows perSecond messages on average and bursts of up to burst messages.
+	// A burst below 1 allows single messages, perSecond of 0 or less none.
+	bool allow(double perSecond, double burst) noexcept
+	{
+		if (!(perSecond > 0.0))
+		{
+			m_suppressed.fetch_add(1, ::std::memory_order_relaxed);
+			return false;
+		}
+		burst = (burst > 1.0) ? burst : 1.0;
+		const int64_t now = static_cast<int64_t>(tsc_clock::now());
+		constexpr double max_ticks = 1e18;
+		const int64_t interval = static_cast<int64_t>(::std::min(tsc_clock::ticks_per_nanosecond() * 1e9 / perSecond, max_ticks));
+		const int64_t tolerance = static_cast<int64_t>(::std::min(static_cast<double>(interval) * (burst - 1.0), max_ticks));
+		int64_t full = m_full.load(::std::memory_order_relaxed);
+		for (;;)
+		{
+			const int64_t start = (full > now) ? full : now;
+			if (start - now > tolerance)
+			{
+				m_suppressed.fetch_add(1, ::std::memory_order_relaxed);
+				return false;
+			}
+			if (m_full.compare_exchange_weak(full, start + interval, ::std::memory_order_relaxed))
+			{
+				return true;
+			}
+		}
+	}
+
+	uint64_t suppressed() const noexcept
+	{
+		return m_suppressed.load(::std::memory_order_relaxed);
+	}
+
+	// Returns the number of messages suppressed since the last call.
+	uint64_t take_suppressed() noexcept
+	{
+		uint64_t reported = m_reported.load(::std::memory_order_relaxed);
+		for (;;)
+		{
+			// Another caller may have reported a newer count than this thread sees.
+			const uint64_t suppressed = m_suppressed.load(::std::memory_order_relaxed);
+			if (suppressed <= reported)
+			{
+				return 0;
+			}
+			if (m_reported.compare_exchange_weak(reported, suppressed, ::std::memory_order_relaxed))
+			{
+				return suppressed - reported;
+			}
+		}
+	}
+
+private:
+	::std::atomic<int64_t> m_full{ 0 };
+	::std::atomic<uint64_t> m_suppressed{ 0 };
+	::std::atomic<uint64_t> m_reported{ 0 };
+};
+
+// Called by UTIL_CLOG. The sink formats the record later if it takes
+// records, see binary_log.h for the supported types.
+template <class... Args>
+inline void clog_deferred(log_site& site, const char* format, const Args&... args)
+{
+	log_sink* sink = get_log_sink();
+	if (sink != nullptr && sink->takes_records())
+	{
+		if (const uint32_t id = site.id(format))
+		{
+			const log_format_args spec = site.args();
+			::stl::string_builder& record = internal::log_line_builder();
+			const size_t size = log_record_size(spec, args...);
+			record.reset();
+			encode_log_record(record.prepare(size), size, id, spec, args...);
+			if (sink->write_record(record.data(), size))
+			{
+				return;
+			}
+		}
+	}
+	clog(format, internal::printf_arg(args)...);
 }
 
 } // namespace util
+
+// util::clog with a format string literal, e.g. UTIL_CLOG("order %d filled at %f", id, price).
+#define UTIL_CLOG(...) \
+	do \
+	{ \
+		static ::util::log_site s_logSite; \
+		::util::clog_deferred(s_logSite, __VA_ARGS__); \
+	} while (false)
+
+// UTIL_CLOG for the level, e.g. UTIL_LOG(debug, "order %d", id). Arguments
+// are not evaluated if the level is disabled.
+#define UTIL_LOG(level, ...) \
+	do \
+	{ \
+		if constexpr (::util::log_level::level >= ::util::min_log_level) \
+		{ \
+			if (::util::log_enabled(::util::log_level::level)) \
+			{ \
+				UTIL_CLOG(__VA_ARGS__); \
+			} \
+		} \
+	} while (false)
+
+// Logs the first and then every n-th call of the site, all calls for n 0 or 1.
+#define UTIL_LOG_EVERY_N(level, n, ...) \
+	do \
+	{ \
+		if constexpr (::util::log_level::level >= ::util::min_log_level) \
+		{ \
+			static ::util::log_sampler s_logSampler; \
+			if (::util::log_enabled(::util::log_level::level) && s_logSampler.sample(n)) \
+			{ \
+				UTIL_CLOG(__VA_ARGS__); \
+			} \
+		} \
+	} while (false)
+
+// Logs at most perSecond messages of the site on average, in bursts of up to
+// burst messages. The number of suppressed messages is logged with the next
+// message that passes.
+#define UTIL_LOG_RATE(level, perSecond, burst, ...) \
+	do \
+	{ \
+		if constexpr (::util::log_level::level >= ::util::min_log_level) \
+		{ \
+			static ::util::log_rate_limiter s_logLimiter; \
+			if (::util::log_enabled(::util::log_level::level) && s_logLimiter.allow(perSecond, burst)) \
+			{ \
+				if (const uint64_t suppressed = s_logLimiter.take_suppressed()) \
+				{ \
+					::util::clog("[%llu messages suppressed at %s:%d]", static_cast<unsigned long long>(suppressed), __FILE__, __LINE__); \
+				} \
+				UTIL_CLOG(__VA_ARGS__); \
+			} \
+		} \
+	} while (false)
+
+#ifdef UTIL_LOG_BENCHMARK
+#include <common/async_log.h>
+#include <common/benchmark.h>
+#include <fcntl.h>
+
+// Cost on the logging thread of a text record and of a deferred record.
+
+BENCHMARK(log_format_text)
+{
+	::stl::string_builder line;
+	const ::std::string user = "account";
+	while (state.keep_running())
+	{
+		line.reset();
+		line.append_printf("[%s] order %d of %s filled %d @ %.2f (%x)", user.c_str(), 1234567, "EURUSD", -42, 1.08765, 0xBEEFu);
+		::bench::do_not_optimize(line);
+	}
+}
+
+BENCHMARK(log_encode_binary)
+{
+	::stl::string_builder record;
+	const ::std::string user = "account";
+	while (state.keep_running())
+	{
+		const size_t size = ::util::log_record_size(user, 1234567, "EURUSD", -42, 1.08765, 0xBEEFu);
+		record.reset();
+		::util::encode_log_record(record.prepare(size), size, 1, user, 1234567, "EURUSD", -42, 1.08765, 0xBEEFu);
+		::bench::do_not_optimize(record);
+	}
+}
+
+BENCHMARK(log_util_clog_binary)
+{
+	::util::async_log_options options;
+#ifdef _WIN32
+	options.fd = ::_open("NUL", _O_WRONLY);
+#else
+	options.fd = ::open("/dev/null", O_WRONLY);
+#endif
+	options.encoding = ::util::log_encoding::binary;
+	options.overflow = ::util::log_overflow::block;
+	options.crashHandler = false;
+	::util::async_logger::instance().start(options);
+	const ::std::string user = "account";
+	while (state.keep_running())
+	{
+		UTIL_CLOG("[%s] order %d of %s filled %d @ %.2f (%x)", user, 1234567, "EURUSD", -42, 1.08765, 0xBEEFu);
+	}
+	::util::async_logger::instance().stop();
+}
+
+#endif
@@ -216,7 +216,7 @@ void vector_map<K, V, T, A >::clear()
 template<typename K, typename V, typename T, typename A>
 void vector_map<K, V, T, A >::clearAndFreeMemory()
 {
-	stl::free_container(m_entries);
+	container_type(m_entries.get_allocator()).swap(m_entries);
 }
 
 template<typename K, typename V, typename T, typename A>